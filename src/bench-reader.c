@@ -0,0 +1,522 @@
+/*
+ * Reader Benchmarks
+ *
+ * This measures the throughput of validating entire messages, comparing
+ * c_dvar_validate() against skipping the message via c_dvar_skip() with "*",
+ * on eager and on lazy readers.
+ * Dictionaries are additionally scanned for their last key via
+ * c_dvar_read_lookup(), compared against the same scan via format strings,
+ * and indexed via c_dvar_read_table(). String- and integer-heavy arrays are
+ * read and written element by element, in both byte orders, and integer
+ * arrays also via a compiled format program. String arrays are also read via
+ * a validation token, skipping all content checks, and as a whole via
+ * c_dvar_read_string_array(). Results are printed in MiB/s of message data.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "c-dvar.h"
+#include "c-dvar-type.h"
+
+#define BENCH_BYTES (UINT64_C(256) * 1024 * 1024)
+
+typedef struct Bench Bench;
+
+struct Bench {
+        const char *name;
+        bool big_endian;
+        size_t n_elements;
+        CDVarType *type;
+        CDVarProgram *program;
+        void *data;
+        size_t n_data;
+};
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+        int r;
+
+        r = clock_gettime(CLOCK_MONOTONIC, &ts);
+        c_assert(!r);
+
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_skip(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        int r;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_skip(&var, "*");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r;
+}
+
+static int bench_skip_lazy(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        int r;
+
+        c_dvar_set_lazy(&var, true);
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_skip(&var, "*");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r;
+}
+
+static int bench_validate(Bench *bench) {
+        return c_dvar_validate(bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+}
+
+static int bench_lookup(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        bool found;
+        int r;
+
+        /* the last key is the worst case, since all entries are scanned */
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_read_lookup(&var, &(CDVarKey){ .str = "Property255" }, &found);
+        c_dvar_skip(&var, "*}]");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r ?: !found;
+}
+
+static int bench_lookup_fmt(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        const char *key;
+        bool found = false;
+        int r;
+
+        /* the same scan as bench_lookup(), but via format strings */
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_read(&var, "[");
+        while (c_dvar_more(&var)) {
+                c_dvar_read(&var, "{s", &key);
+                if (!strcmp(key, "Property255")) {
+                        found = true;
+                        c_dvar_skip(&var, "*}");
+                        break;
+                }
+                c_dvar_skip(&var, "*}");
+        }
+        while (c_dvar_more(&var))
+                c_dvar_skip(&var, "*");
+        c_dvar_read(&var, "]");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r ?: !found;
+}
+
+static int bench_table(Bench *bench) {
+        _c_cleanup_(c_dvar_table_freep) CDVarTable *table = NULL;
+        CDVar var = C_DVAR_INIT;
+        CDVarSpan span;
+        bool found;
+        int r;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_read_table(&var, &table);
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+        if (r)
+                return r;
+
+        found = c_dvar_table_lookup(table, "Property255", &span);
+        return !found;
+}
+
+static int bench_read_strings_from(CDVar *var) {
+        const char *str;
+        int r;
+
+        c_dvar_read(var, "[");
+        while (c_dvar_more(var))
+                c_dvar_read(var, "s", &str);
+        c_dvar_read(var, "]");
+        r = c_dvar_end_read(var);
+        c_dvar_deinit(var);
+
+        return r;
+}
+
+static int bench_read_strings(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        return bench_read_strings_from(&var);
+}
+
+static int bench_read_strings_token(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        CDVarToken token = {
+                .types = bench->type,
+                .n_types = 1,
+                .data = bench->data,
+                .n_data = bench->n_data,
+                .big_endian = bench->big_endian,
+        };
+
+        /* the data was written by c-dvar itself, so it can be trusted */
+        c_dvar_begin_read_token(&var, &token);
+        return bench_read_strings_from(&var);
+}
+
+static int bench_read_string_array(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        const char **strings;
+        size_t *lengths, n_data, n;
+        int r;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+
+        r = c_dvar_peek_array(&var, &n_data, NULL);
+        c_assert(!r);
+
+        n = C_DVAR_STRING_ARRAY_MAX('s', n_data);
+        strings = malloc(n * sizeof(*strings));
+        lengths = malloc(n * sizeof(*lengths));
+        c_assert(strings && lengths);
+
+        r = c_dvar_read_string_array(&var, strings, lengths, n, &n);
+        c_assert(!r && n == bench->n_elements);
+
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+        free(lengths);
+        free(strings);
+
+        return r;
+}
+
+static int bench_read_integers(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        uint64_t u64;
+        uint32_t u32;
+        uint16_t u16;
+        int r;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_read(&var, "[");
+        while (c_dvar_more(&var))
+                c_dvar_read(&var, "(qut)", &u16, &u32, &u64);
+        c_dvar_read(&var, "]");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r;
+}
+
+static int bench_read_integers_program(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        uint64_t u64;
+        uint32_t u32;
+        uint16_t u16;
+        int r;
+
+        c_dvar_begin_read(&var, bench->big_endian, bench->type, 1, bench->data, bench->n_data);
+        c_dvar_read(&var, "[");
+        while (c_dvar_more(&var))
+                c_dvar_program_read(&var, bench->program, &u16, &u32, &u64);
+        c_dvar_read(&var, "]");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r;
+}
+
+static int bench_write_strings(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        size_t i, n_data;
+        void *data;
+        int r;
+
+        c_dvar_begin_write(&var, bench->big_endian, bench->type, 1);
+        c_dvar_write(&var, "[");
+        for (i = 0; i < bench->n_elements; ++i)
+                c_dvar_write(&var, "s", "org.freedesktop.Example");
+        c_dvar_write(&var, "]");
+        r = c_dvar_end_write(&var, &data, &n_data);
+        c_dvar_deinit(&var);
+
+        free(data);
+        return r;
+}
+
+static int bench_write_integers(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        size_t i, n_data;
+        void *data;
+        int r;
+
+        c_dvar_begin_write(&var, bench->big_endian, bench->type, 1);
+        c_dvar_write(&var, "[");
+        for (i = 0; i < bench->n_elements; ++i)
+                c_dvar_write(&var, "(qut)", (uint16_t)i, (uint32_t)i, (uint64_t)i);
+        c_dvar_write(&var, "]");
+        r = c_dvar_end_write(&var, &data, &n_data);
+        c_dvar_deinit(&var);
+
+        free(data);
+        return r;
+}
+
+static int bench_write_integers_program(Bench *bench) {
+        CDVar var = C_DVAR_INIT;
+        size_t i, n_data;
+        void *data;
+        int r;
+
+        c_dvar_begin_write(&var, bench->big_endian, bench->type, 1);
+        c_dvar_write(&var, "[");
+        for (i = 0; i < bench->n_elements; ++i)
+                c_dvar_program_write(&var, bench->program, (uint16_t)i, (uint32_t)i, (uint64_t)i);
+        c_dvar_write(&var, "]");
+        r = c_dvar_end_write(&var, &data, &n_data);
+        c_dvar_deinit(&var);
+
+        free(data);
+        return r;
+}
+
+static void bench_run(Bench *bench, const char *method, int (*fn)(Bench *bench)) {
+        uint64_t i, n, start, nsec;
+        int r;
+
+        n = c_max(BENCH_BYTES / bench->n_data, UINT64_C(1));
+
+        start = bench_now();
+        for (i = 0; i < n; ++i) {
+                r = fn(bench);
+                c_assert(!r);
+        }
+        nsec = c_max(bench_now() - start, UINT64_C(1));
+
+        printf("%-24s %-10s %10.1f MiB/s\n",
+               bench->name,
+               method,
+               (double)(n * bench->n_data) / (1024 * 1024) / ((double)nsec / 1000000000));
+}
+
+static void bench_deinit(Bench *bench) {
+        c_dvar_program_free(bench->program);
+        free(bench->data);
+        c_dvar_type_free(bench->type);
+}
+
+static void bench_init_properties(Bench *bench, bool big_endian) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        char key[32];
+        size_t i;
+        int r;
+
+        /*
+         * A property dictionary, as sent by org.freedesktop.DBus.Properties,
+         * with a mix of basic and container values in its variants.
+         */
+
+        *bench = (Bench){
+                .name = big_endian ? "a{sv} (big-endian)" : "a{sv} (little-endian)",
+                .big_endian = big_endian,
+        };
+
+        r = c_dvar_type_new_from_string(&bench->type, "a{sv}");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, bench->type, 1);
+        c_dvar_write(var, "[");
+
+        for (i = 0; i < 256; ++i) {
+                sprintf(key, "Property%zu", i);
+
+                switch (i % 4) {
+                case 0:
+                        c_dvar_write(var, "{s<s>}", key, c_dvar_type_s, "org.freedesktop.Example");
+                        break;
+                case 1:
+                        c_dvar_write(var, "{s<u>}", key, c_dvar_type_u, (uint32_t)i);
+                        break;
+                case 2:
+                        c_dvar_write(var, "{s<b>}", key, c_dvar_type_b, !!(i % 3));
+                        break;
+                case 3:
+                        c_dvar_write(var, "{s<o>}", key, c_dvar_type_o, "/org/freedesktop/Example");
+                        break;
+                }
+        }
+
+        c_dvar_write(var, "]");
+        r = c_dvar_end_write(var, &bench->data, &bench->n_data);
+        c_assert(!r);
+}
+
+static void bench_init_fixed(Bench *bench, const char *signature, const char *element, size_t n) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i;
+        int r;
+
+        /*
+         * A large array of fixed-size elements. Elements are written as
+         * zero-valued, so any element type can be written via the same
+         * format string.
+         */
+
+        *bench = (Bench){
+                .name = signature,
+        };
+
+        r = c_dvar_type_new_from_string(&bench->type, signature);
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, false, bench->type, 1);
+        c_dvar_write(var, "[");
+        for (i = 0; i < n; ++i)
+                c_dvar_write(var, element, 0, 0);
+        c_dvar_write(var, "]");
+        r = c_dvar_end_write(var, &bench->data, &bench->n_data);
+        c_assert(!r);
+}
+
+static void bench_init_strings(Bench *bench, bool big_endian) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i;
+        int r;
+
+        /* a list of bus names, as returned by org.freedesktop.DBus.ListNames */
+
+        *bench = (Bench){
+                .name = big_endian ? "as (big-endian)" : "as (little-endian)",
+                .big_endian = big_endian,
+                .n_elements = 4096,
+        };
+
+        r = c_dvar_type_new_from_string(&bench->type, "as");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, bench->type, 1);
+        c_dvar_write(var, "[");
+        for (i = 0; i < bench->n_elements; ++i)
+                c_dvar_write(var, "s", "org.freedesktop.Example");
+        c_dvar_write(var, "]");
+        r = c_dvar_end_write(var, &bench->data, &bench->n_data);
+        c_assert(!r);
+}
+
+static void bench_init_integers(Bench *bench, bool big_endian) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i;
+        int r;
+
+        *bench = (Bench){
+                .name = big_endian ? "a(qut) (big-endian)" : "a(qut) (little-endian)",
+                .big_endian = big_endian,
+                .n_elements = 4096,
+        };
+
+        r = c_dvar_type_new_from_string(&bench->type, "a(qut)");
+        c_assert(!r);
+
+        r = c_dvar_program_new(&bench->program, bench->type + 1, "(qut)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, bench->type, 1);
+        c_dvar_write(var, "[");
+        for (i = 0; i < bench->n_elements; ++i)
+                c_dvar_write(var, "(qut)", (uint16_t)i, (uint32_t)i, (uint64_t)i);
+        c_dvar_write(var, "]");
+        r = c_dvar_end_write(var, &bench->data, &bench->n_data);
+        c_assert(!r);
+}
+
+int main(int argc, char **argv) {
+        Bench bench;
+
+        bench_init_properties(&bench, false);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "skip-lazy", bench_skip_lazy);
+        bench_run(&bench, "validate", bench_validate);
+        bench_run(&bench, "lookup", bench_lookup);
+        bench_run(&bench, "lookup-fmt", bench_lookup_fmt);
+        bench_run(&bench, "table", bench_table);
+        bench_deinit(&bench);
+
+        bench_init_properties(&bench, true);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "skip-lazy", bench_skip_lazy);
+        bench_run(&bench, "validate", bench_validate);
+        bench_run(&bench, "lookup", bench_lookup);
+        bench_run(&bench, "lookup-fmt", bench_lookup_fmt);
+        bench_run(&bench, "table", bench_table);
+        bench_deinit(&bench);
+
+        bench_init_fixed(&bench, "au", "u", 16384);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "validate", bench_validate);
+        bench_deinit(&bench);
+
+        bench_init_fixed(&bench, "a(ii)", "(ii)", 16384);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "validate", bench_validate);
+        bench_deinit(&bench);
+
+        bench_init_fixed(&bench, "a(yb)", "(yb)", 16384);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "validate", bench_validate);
+        bench_deinit(&bench);
+
+        bench_init_strings(&bench, false);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "skip-lazy", bench_skip_lazy);
+        bench_run(&bench, "read", bench_read_strings);
+        bench_run(&bench, "read-token", bench_read_strings_token);
+        bench_run(&bench, "read-array", bench_read_string_array);
+        bench_run(&bench, "write", bench_write_strings);
+        bench_deinit(&bench);
+
+        bench_init_strings(&bench, true);
+        bench_run(&bench, "skip", bench_skip);
+        bench_run(&bench, "skip-lazy", bench_skip_lazy);
+        bench_run(&bench, "read", bench_read_strings);
+        bench_run(&bench, "read-token", bench_read_strings_token);
+        bench_run(&bench, "read-array", bench_read_string_array);
+        bench_run(&bench, "write", bench_write_strings);
+        bench_deinit(&bench);
+
+        bench_init_integers(&bench, false);
+        bench_run(&bench, "read", bench_read_integers);
+        bench_run(&bench, "read-prog", bench_read_integers_program);
+        bench_run(&bench, "write", bench_write_integers);
+        bench_run(&bench, "write-prog", bench_write_integers_program);
+        bench_deinit(&bench);
+
+        bench_init_integers(&bench, true);
+        bench_run(&bench, "read", bench_read_integers);
+        bench_run(&bench, "read-prog", bench_read_integers_program);
+        bench_run(&bench, "write", bench_write_integers);
+        bench_run(&bench, "write-prog", bench_write_integers_program);
+        bench_deinit(&bench);
+
+        return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Type Cache
+ *
+ * Variants carry their type signature inline with the data. Whenever a
+ * variant is entered without a type provided by the caller, its signature
+ * must be validated and parsed into a type array. This file implements a
+ * cache that maps signatures to parsed type arrays, so repeated signatures
+ * need neither validation nor allocation.
+ *
+ * The cache is bounded. Once full, entries are evicted via the CLOCK
+ * algorithm: every lookup marks its slot as used, and a clock hand sweeps
+ * over the slots, sparing and clearing used slots, and evicting the first
+ * slot not used since the hand last passed. Signatures are hashed with a
+ * random seed, so a peer cannot craft signatures that collide in the table.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+/**
+ * c_dvar_cache_new() - allocate new type cache
+ * @cachep:             output argument for newly allocated object
+ *
+ * This allocates a new, empty type cache. It can be attached to any number of
+ * variants via c_dvar_set_cache(), as long as they are used from the same
+ * thread. The cache is bounded to C_DVAR_CACHE_MAX entries. Once full, the
+ * least recently used entries are evicted to make room for new signatures.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int c_dvar_cache_new(CDVarCache **cachep) {
+        CDVarCache *cache;
+
+        cache = calloc(1, sizeof(*cache));
+        if (!cache)
+                return -ENOMEM;
+
+        *cachep = cache;
+        return 0;
+}
+
+/**
+ * c_dvar_cache_free() - free type cache
+ * @cache:              cache to free, or NULL
+ *
+ * This releases all cached types and the cache itself. The caller must make
+ * sure no variant still refers to the cache. That is, all variants it was
+ * attached to must be reset or detached before.
+ *
+ * If @cache is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CDVarCache *c_dvar_cache_free(CDVarCache *cache) {
+        size_t i;
+
+        if (!cache)
+                return NULL;
+
+        for (i = 0; i < C_DVAR_CACHE_SLOTS; ++i)
+                if (cache->slots[i].type)
+                        c_dvar_cache_unref(cache->slots[i].type);
+
+        free(cache);
+        return NULL;
+}
+
+static CDVarCacheEntry *c_dvar_cache_entry(CDVarType *type) {
+        return (CDVarCacheEntry *)((char *)type - offsetof(CDVarCacheEntry, types));
+}
+
+/*
+ * Release a reference to the cached type @type, as returned by
+ * c_dvar_cache_find() or c_dvar_cache_add(). Once the last reference is
+ * released, the type is freed.
+ */
+void c_dvar_cache_unref(CDVarType *type) {
+        CDVarCacheEntry *entry = c_dvar_cache_entry(type);
+
+        if (!--entry->n_refs)
+                free(entry);
+}
+
+/*
+ * Remove the entry in slot @i. Since the table uses linear probing, all
+ * following entries of the probe sequence are shifted back, so no probe
+ * sequence is cut short by the new hole.
+ */
+static void c_dvar_cache_remove(CDVarCache *cache, size_t i) {
+        size_t j, home;
+
+        c_dvar_cache_unref(cache->slots[i].type);
+        --cache->n_types;
+
+        for (j = (i + 1) % C_DVAR_CACHE_SLOTS;
+             cache->slots[j].type;
+             j = (j + 1) % C_DVAR_CACHE_SLOTS) {
+                home = cache->slots[j].hash % C_DVAR_CACHE_SLOTS;
+
+                /* keep entries whose home slot lies between the hole and them */
+                if ((j + C_DVAR_CACHE_SLOTS - home) % C_DVAR_CACHE_SLOTS <
+                    (j + C_DVAR_CACHE_SLOTS - i) % C_DVAR_CACHE_SLOTS)
+                        continue;
+
+                cache->slots[i] = cache->slots[j];
+                i = j;
+        }
+
+        cache->slots[i] = (CDVarCacheSlot){};
+}
+
+/*
+ * Evict a single entry, following the CLOCK algorithm. The hand passes over
+ * every entry at most twice, so this terminates.
+ */
+static void c_dvar_cache_evict(CDVarCache *cache) {
+        CDVarCacheSlot *slot;
+
+        for (;;) {
+                slot = cache->slots + cache->clock;
+
+                if (slot->type && !slot->used) {
+                        c_dvar_cache_remove(cache, cache->clock);
+                        return;
+                }
+
+                slot->used = false;
+                cache->clock = (cache->clock + 1) % C_DVAR_CACHE_SLOTS;
+        }
+}
+
+/*
+ * Look up the type array of @signature in @cache. If the signature was
+ * cached before, a new reference to the type array is returned. It must be
+ * released via c_dvar_cache_unref(), and stays valid until then, even if it
+ * is evicted from the cache meanwhile. Only validated types are ever cached,
+ * so the signature does not need any further verification.
+ *
+ * If the signature is not cached, NULL is returned.
+ */
+CDVarType *c_dvar_cache_find(CDVarCache *cache, const char *signature, size_t n_signature) {
+        CDVarCacheSlot *slot;
+        uint32_t hash;
+        size_t i;
+
+        hash = c_dvar_signature_hash(signature, n_signature);
+
+        for (i = hash; cache->slots[i % C_DVAR_CACHE_SLOTS].type; ++i) {
+                slot = cache->slots + i % C_DVAR_CACHE_SLOTS;
+                if (slot->hash == hash &&
+                    !c_dvar_type_compare_string(slot->type, signature, n_signature)) {
+                        slot->used = true;
+                        ++c_dvar_cache_entry(slot->type)->n_refs;
+                        return slot->type;
+                }
+        }
+
+        return NULL;
+}
+
+/*
+ * Add a copy of the type array @type to @cache, evicting another entry if the
+ * cache is full. The type must be valid and must not be cached, yet. On
+ * success, a new reference to the cached copy is returned, just like
+ * c_dvar_cache_find() does. If the copy cannot be allocated, NULL is returned.
+ */
+CDVarType *c_dvar_cache_add(CDVarCache *cache, const CDVarType *type) {
+        char signature[C_DVAR_TYPE_LENGTH_MAX];
+        CDVarCacheEntry *entry;
+        uint32_t hash;
+        size_t i;
+
+        entry = malloc(sizeof(*entry) + type->length * sizeof(*type));
+        if (!entry)
+                return NULL;
+
+        /* one reference for the cache, and one for the caller */
+        entry->n_refs = 2;
+        memcpy(entry->types, type, type->length * sizeof(*type));
+
+        for (i = 0; i < type->length; ++i)
+                signature[i] = type[i].element;
+
+        hash = c_dvar_signature_hash(signature, type->length);
+
+        if (cache->n_types >= C_DVAR_CACHE_MAX)
+                c_dvar_cache_evict(cache);
+
+        for (i = hash; cache->slots[i % C_DVAR_CACHE_SLOTS].type; ++i)
+                c_assert(cache->slots[i % C_DVAR_CACHE_SLOTS].hash != hash ||
+                         c_dvar_type_compare_string(cache->slots[i % C_DVAR_CACHE_SLOTS].type,
+                                                    signature,
+                                                    type->length));
+
+        cache->slots[i % C_DVAR_CACHE_SLOTS] = (CDVarCacheSlot){
+                .hash = hash,
+                .type = entry->types,
+        };
+        ++cache->n_types;
+        return entry->types;
+}
@@ -6,24 +6,332 @@
 
 #include <assert.h>
 #include <byteswap.h>
+#include <c-siphash.h>
 #include <c-stdaux.h>
 #include <endian.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
 #include "c-dvar.h"
 #include "c-dvar-private.h"
 
-uint16_t c_dvar_bswap16(CDVar *var, uint16_t v) {
-        return _c_likely_(!!var->big_endian == !!(__BYTE_ORDER == __BIG_ENDIAN)) ? v : bswap_16(v);
+/*
+ * Reset @var and position it at the start of the root types @types, as
+ * shared by readers and writers. Any state is released, except for the
+ * settings that stay in effect across c_dvar_begin_read() and
+ * c_dvar_begin_write(): the attached cache, and the lazy setting including
+ * its array of deferred strings. The caller sets up the data.
+ */
+void c_dvar_reset(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types) {
+        CDVarDeferred *deferred;
+        CDVarCache *cache;
+        size_t i;
+        bool lazy;
+
+        cache = var->cache;
+        deferred = var->deferred;
+        lazy = var->lazy;
+        var->deferred = NULL;
+        c_dvar_deinit(var);
+        var->cache = cache;
+        var->deferred = deferred;
+        var->lazy = lazy;
+
+        if (deferred)
+                deferred->n_strings = 0;
+
+        var->big_endian = big_endian;
+
+        var->current = var->levels;
+        var->current->parent_types = (CDVarType *)types;
+        var->current->n_parent_types = n_types;
+        var->current->i_type = (CDVarType *)types;
+        var->current->n_type = 0;
+        var->current->container = 0;
+        var->current->allocated_parent_types = false;
+        var->current->parsed_parent_types = false;
+        var->current->cached_parent_types = false;
+        var->current->i_buffer = 0;
+        var->current->index = 0;
+
+        for (i = 0; i < n_types; ++i) {
+                c_assert(var->n_root_type + (uint8_t)types->length >= (uint8_t)types->length);
+                var->n_root_type += types->length;
+                types += types->length;
+        }
+
+        var->current->n_type = var->n_root_type;
+}
+
+static pthread_once_t c_dvar_hash_once = PTHREAD_ONCE_INIT;
+static uint8_t c_dvar_hash_seed_bytes[16];
+
+static void c_dvar_hash_init_seed(void) {
+        struct timespec ts;
+        uint64_t u64[2];
+
+        if (getrandom(c_dvar_hash_seed_bytes, sizeof(c_dvar_hash_seed_bytes), GRND_NONBLOCK) == sizeof(c_dvar_hash_seed_bytes))
+                return;
+
+        /*
+         * The entropy pool is not initialized, yet. Fall back to the clock
+         * and the randomized address space, which is still unknown to the
+         * peer, if weaker.
+         */
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        u64[0] = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        u64[1] = (uintptr_t)&ts ^ (uintptr_t)c_dvar_hash_init_seed;
+        memcpy(c_dvar_hash_seed_bytes, u64, sizeof(c_dvar_hash_seed_bytes));
+}
+
+/*
+ * Random per-process seed of all hash tables that are keyed by data chosen by
+ * a peer. It is generated on first use.
+ */
+const uint8_t *c_dvar_hash_seed(void) {
+        pthread_once(&c_dvar_hash_once, c_dvar_hash_init_seed);
+        return c_dvar_hash_seed_bytes;
 }
 
-uint32_t c_dvar_bswap32(CDVar *var, uint32_t v) {
-        return _c_likely_(!!var->big_endian == !!(__BYTE_ORDER == __BIG_ENDIAN)) ? v : bswap_32(v);
+/*
+ * Hash of a type signature. Signatures of variants are chosen by the peer, so
+ * they are hashed with the seeded SipHash, and a peer cannot craft signatures
+ * that collide in the type cache or the type registry.
+ */
+uint32_t c_dvar_signature_hash(const char *signature, size_t n_signature) {
+        return c_siphash_hash(c_dvar_hash_seed(), (const uint8_t *)signature, n_signature);
 }
 
-uint64_t c_dvar_bswap64(CDVar *var, uint64_t v) {
-        return _c_likely_(!!var->big_endian == !!(__BYTE_ORDER == __BIG_ENDIAN)) ? v : bswap_64(v);
+/**
+ * c_dvar_layout_init() - compute layout of a fixed-size type
+ * @layout:             layout object to initialize
+ * @type:               fixed-size type to operate on
+ * @big_endian:         whether the data is big-endian
+ *
+ * This computes the serialized layout of the fixed-size type @type and stores
+ * it in @layout. This includes the element size and array stride, as well as
+ * a bitmask of all bits that are required to be zero in valid data. The mask
+ * depends on the byte-order, since only the least significant bit of a
+ * boolean can be set. Furthermore, the position of all multi-byte members is
+ * recorded, so the data can be converted to native byte-order.
+ */
+void c_dvar_layout_init(CDVarLayout *layout, const CDVarType *type, bool big_endian) {
+        size_t i, offset, align;
+        bool uniform = true;
+        uint8_t mask = 0;
+
+        c_assert(type->size);
+
+        layout->size = type->size;
+        layout->stride = c_align_to(layout->size, 1 << type->alignment);
+        layout->period = layout->stride * ((64 + layout->stride - 1) / layout->stride);
+        layout->width = 0;
+        layout->multibyte = false;
+        layout->n_members = 0;
+
+        c_memzero(layout->mask, layout->stride);
+
+        for (i = 0, offset = 0; i < type->length; ++i) {
+                switch (type[i].element) {
+                case ')':
+                case '}':
+                        /* trailing padding is not part of the type */
+                        continue;
+                case '(':
+                case '{':
+                        /* structures are always 8-byte aligned */
+                        align = c_align_to(offset, 8);
+                        break;
+                default:
+                        align = c_align_to(offset, 1 << type[i].alignment);
+                        break;
+                }
+
+                uniform &= offset == align;
+                for ( ; offset < align; ++offset)
+                        layout->mask[offset] = 0xff;
+
+                if (type[i].element == 'b') {
+                        layout->mask[offset + 0] = big_endian ? 0xff : 0xfe;
+                        layout->mask[offset + 1] = 0xff;
+                        layout->mask[offset + 2] = 0xff;
+                        layout->mask[offset + 3] = big_endian ? 0xfe : 0xff;
+                }
+
+                if (type[i].basic) {
+                        if (!layout->width)
+                                layout->width = type[i].size;
+                        else
+                                uniform &= layout->width == type[i].size;
+
+                        if (type[i].size > 1) {
+                                layout->multibyte = true;
+                                layout->members[layout->n_members].offset = offset;
+                                layout->members[layout->n_members].size = type[i].size;
+                                ++layout->n_members;
+                        }
+
+                        offset += type[i].size;
+                }
+        }
+
+        c_assert(offset == layout->size);
+
+        if (!uniform || layout->stride != layout->size)
+                layout->width = 0;
+
+        /* padding between array elements */
+        for ( ; offset < layout->stride; ++offset)
+                layout->mask[offset] = 0xff;
+
+        /* repeat the mask to cover a multiple of 64 bytes */
+        for ( ; offset < layout->period; ++offset)
+                layout->mask[offset] = layout->mask[offset - layout->stride];
+
+        for (i = 0; i < layout->stride; ++i)
+                mask |= layout->mask[i];
+
+        layout->checked = !!mask;
+}
+
+/**
+ * c_dvar_layout_verify() - verify array of fixed-size elements
+ * @layout:             layout of the array elements
+ * @data:               array data to verify
+ * @n_data:             length of @data in bytes
+ * @n_elementsp:        output argument for the number of elements, or NULL
+ *
+ * This verifies that @data is a valid serialization of an array of elements
+ * with the layout given as @layout. @data must start at the first element.
+ * Note that the last element of an array is not followed by padding.
+ *
+ * The verification runs word-wise over the entire array and is free of any
+ * data-dependent branches. If the layout has no bits to verify, this runs in
+ * constant time.
+ *
+ * Return: 0 on success, C_DVAR_E_CORRUPT_DATA if the data is invalid.
+ */
+int c_dvar_layout_verify(const CDVarLayout *layout, const void *data, size_t n_data, size_t *n_elementsp) {
+        const uint8_t *p = data;
+        uint64_t v, m, acc = 0;
+        size_t i, j;
+
+        if (_c_unlikely_(n_data && (n_data < layout->size ||
+                                    (n_data - layout->size) % layout->stride)))
+                return C_DVAR_E_CORRUPT_DATA;
+
+        if (layout->checked) {
+                for (i = 0; i + layout->period <= n_data; i += layout->period) {
+                        for (j = 0; j < layout->period; j += sizeof(v)) {
+                                memcpy(&v, p + i + j, sizeof(v));
+                                memcpy(&m, layout->mask + j, sizeof(m));
+                                acc |= v & m;
+                        }
+                }
+
+                for (j = 0; i + j < n_data; ++j)
+                        acc |= p[i + j] & layout->mask[j];
+
+                if (_c_unlikely_(acc))
+                        return C_DVAR_E_CORRUPT_DATA;
+        }
+
+        if (n_elementsp)
+                *n_elementsp = n_data ? (n_data - layout->size) / layout->stride + 1 : 0;
+
+        return 0;
+}
+
+/**
+ * c_dvar_layout_copy() - copy array of fixed-size elements
+ * @layout:             layout of the array elements
+ * @dst:                destination buffer
+ * @src:                source buffer
+ * @n_data:             length of the array in bytes
+ * @swap:               whether to convert the byte-order
+ *
+ * This copies the array of @n_data bytes from @src to @dst. If @swap is true,
+ * all multi-byte members of each element are converted to the opposite
+ * byte-order. The data is expected to be verified via c_dvar_layout_verify()
+ * already, so @n_data must describe an integer number of elements.
+ *
+ * Arrays of uniform, unpadded elements (e.g., 'at' or 'a(ii)') are converted
+ * in a single tight loop without any per-element dispatch, which allows
+ * compilers to vectorize it. Other arrays are copied as a whole and then
+ * converted member by member.
+ */
+void c_dvar_layout_copy(const CDVarLayout *layout, void *dst, const void *src, size_t n_data, bool swap) {
+        const uint8_t *s = src;
+        uint8_t *p, *d = dst;
+        uint64_t u64;
+        uint32_t u32;
+        uint16_t u16;
+        size_t i, j;
+
+        if (!n_data)
+                return;
+
+        if (!swap || !layout->multibyte) {
+                memcpy(d, s, n_data);
+                return;
+        }
+
+        switch (layout->width) {
+        case 2:
+                for (i = 0; i < n_data; i += sizeof(u16)) {
+                        memcpy(&u16, s + i, sizeof(u16));
+                        u16 = bswap_16(u16);
+                        memcpy(d + i, &u16, sizeof(u16));
+                }
+                return;
+        case 4:
+                for (i = 0; i < n_data; i += sizeof(u32)) {
+                        memcpy(&u32, s + i, sizeof(u32));
+                        u32 = bswap_32(u32);
+                        memcpy(d + i, &u32, sizeof(u32));
+                }
+                return;
+        case 8:
+                for (i = 0; i < n_data; i += sizeof(u64)) {
+                        memcpy(&u64, s + i, sizeof(u64));
+                        u64 = bswap_64(u64);
+                        memcpy(d + i, &u64, sizeof(u64));
+                }
+                return;
+        }
+
+        memcpy(d, s, n_data);
+
+        for (i = 0; i < n_data; i += layout->stride) {
+                for (j = 0; j < layout->n_members; ++j) {
+                        p = d + i + layout->members[j].offset;
+
+                        switch (layout->members[j].size) {
+                        case 2:
+                                memcpy(&u16, p, sizeof(u16));
+                                u16 = bswap_16(u16);
+                                memcpy(p, &u16, sizeof(u16));
+                                break;
+                        case 4:
+                                memcpy(&u32, p, sizeof(u32));
+                                u32 = bswap_32(u32);
+                                memcpy(p, &u32, sizeof(u32));
+                                break;
+                        case 8:
+                                memcpy(&u64, p, sizeof(u64));
+                                u64 = bswap_64(u64);
+                                memcpy(p, &u64, sizeof(u64));
+                                break;
+                        default:
+                                c_assert(0);
+                                break;
+                        }
+                }
+        }
 }
@@ -0,0 +1,197 @@
+/*
+ * Array Index
+ *
+ * The D-Bus serialization does not support random access into arrays of
+ * dynamically sized elements. To access the n-th element, all preceding
+ * elements must be skipped. This file implements array indices, which record
+ * the position of every element during a single validating pass over an
+ * array. Any element can then be read in place, in constant time. Arrays of
+ * fixed-size elements need no such pass, since their elements are placed at a
+ * constant stride.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+static int c_dvar_try_read_index(CDVar *var, CDVarIndex **indexp) {
+        _c_cleanup_(c_dvar_index_freep) CDVarIndex *index = NULL;
+        const CDVarType *type;
+        size_t start, n_ends = 0;
+        uint32_t *ends;
+        int r;
+
+        /*
+         * Elements are read in place later on, so this requires a single
+         * contiguous buffer, rather than segments.
+         */
+        if (_c_unlikely_(!var->current->n_type ||
+                         var->current->i_type->element != 'a' ||
+                         var->vecs))
+                return -ENOTRECOVERABLE;
+
+        type = var->current->i_type + 1;
+
+        index = calloc(1, sizeof(*index) + type->length * sizeof(*type));
+        if (!index)
+                return -ENOMEM;
+
+        index->big_endian = var->big_endian;
+        memcpy(index->type, type, type->length * sizeof(*type));
+
+        r = c_dvar_read(var, "[");
+        if (r)
+                return r;
+
+        start = var->current->i_buffer;
+        index->data = var->data + start;
+        index->shift = (var->shift + start) % 8;
+
+        if (type->size) {
+                /*
+                 * Elements of fixed size are placed at a constant stride, so
+                 * only their number needs to be recorded. They are jumped
+                 * over in one go, and a trailing remainder is rejected by the
+                 * closing bracket.
+                 */
+                index->stride = c_align_to(type->size, 1 << type->alignment);
+                if (var->current->n_buffer >= type->size)
+                        index->n_elements = (var->current->n_buffer - type->size) / index->stride + 1;
+
+                r = c_dvar_jump_elements(var, index->n_elements);
+                if (r)
+                        return r;
+        }
+
+        /*
+         * Jump over each element, which fully validates it, and record where
+         * it ends. Arrays are limited to 64MiB by the specification, so
+         * 32-bit offsets are sufficient.
+         */
+        while (!index->stride && c_dvar_more(var)) {
+                if (index->n_elements >= n_ends) {
+                        n_ends = n_ends ? n_ends * 2 : 16;
+                        ends = realloc(index->ends, n_ends * sizeof(*ends));
+                        if (!ends)
+                                return -ENOMEM;
+
+                        index->ends = ends;
+                }
+
+                r = c_dvar_jump(var, NULL);
+                if (r)
+                        return r;
+
+                index->ends[index->n_elements++] = var->current->i_buffer - start;
+        }
+
+        r = c_dvar_read(var, "]");
+        if (r)
+                return r;
+
+        *indexp = index;
+        index = NULL;
+        return 0;
+}
+
+/**
+ * c_dvar_read_index() - read array into index
+ * @var:                variant to operate on
+ * @indexp:             output argument for newly allocated index
+ *
+ * This reads the next array from @var, validating all its elements, and
+ * records the position of every element in a newly allocated index. Any
+ * element can then be read in place via c_dvar_begin_read_index(), without
+ * skipping any other element.
+ *
+ * The index refers to the data of @var, rather than copying it. The caller
+ * must keep the data valid as long as the index is used. Readers on multiple
+ * segments are not supported.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_index(CDVar *var, CDVarIndex **indexp) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_index(var, indexp);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_index_free() - free array index
+ * @index:              index to free, or NULL
+ *
+ * This deallocates @index. If @index is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CDVarIndex *c_dvar_index_free(CDVarIndex *index) {
+        if (!index)
+                return NULL;
+
+        free(index->ends);
+        free(index);
+        return NULL;
+}
+
+/**
+ * c_dvar_index_get_n_elements() - query number of indexed elements
+ * @index:              index to query
+ *
+ * Return: The number of elements of the indexed array.
+ */
+_c_public_ size_t c_dvar_index_get_n_elements(const CDVarIndex *index) {
+        return index->n_elements;
+}
+
+/**
+ * c_dvar_begin_read_index() - begin reading an indexed element
+ * @var:                variant to operate on
+ * @index:              index to use
+ * @i:                  element to read
+ *
+ * This begins reading the @i-th element of the array indexed by @index,
+ * similar to c_dvar_begin_read(). The reader is positioned on the element in
+ * place, in constant time. The root type of the reader is the element type of
+ * the array, and it is owned by @index.
+ *
+ * The element was validated when the index was created. It is validated
+ * again when read, though, since the index does not keep track of its data.
+ */
+_c_public_ void c_dvar_begin_read_index(CDVar *var, const CDVarIndex *index, size_t i) {
+        size_t start = 0, end;
+
+        assert(i < index->n_elements);
+
+        if (index->stride) {
+                start = i * index->stride;
+                end = start + index->type->size;
+        } else {
+                if (i > 0)
+                        start = c_align_to(index->shift + index->ends[i - 1], 1 << index->type->alignment) - index->shift;
+                end = index->ends[i];
+        }
+
+        c_dvar_begin_read_shifted(var,
+                                  index->big_endian,
+                                  index->type,
+                                  1,
+                                  index->data + start,
+                                  end - start,
+                                  index->shift + start);
+}
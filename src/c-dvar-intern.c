@@ -0,0 +1,446 @@
+/*
+ * Type Registry
+ *
+ * This implements a process-wide registry of interned types. Every distinct
+ * type signature is parsed once and shared by all users, so interned types
+ * can be compared by pointer.
+ *
+ * Lookups are lock-free. The registry is an open-addressing hash table of
+ * entry pointers, which is only ever modified with the registry lock held.
+ * Readers take a reference on a matching entry only if its reference count is
+ * non-zero, and then verify the entry still describes the requested
+ * signature. For this to be safe, entries are type-stable: once allocated,
+ * they are never returned to the system, but recycled for signatures of the
+ * same length.
+ *
+ * Tables replaced when the registry grows might still be scanned by lock-free
+ * readers. Like entries, tables are type-stable: replaced tables are retained
+ * for the lifetime of the process, so readers neither register nor share any
+ * state besides the reference count of the entry they look up. Tombstones are
+ * purged in place, without replacing the table, so the registry only ever
+ * replaces its table when the number of live entries grows. Since each table
+ * is at least twice the size of the one it replaces, all retained tables
+ * together are smaller than the current one.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+typedef struct CDVarInternEntry CDVarInternEntry;
+typedef struct CDVarInternTable CDVarInternTable;
+
+#define C_DVAR_INTERN_SLOTS_MIN (64)
+
+/**
+ * struct CDVarInternEntry - Interned type
+ * @n_refs:             reference count, or 0 if unused
+ * @hash:               hash of the signature of @types
+ * @next:               next unused entry of the same length
+ * @types:              type array
+ */
+struct CDVarInternEntry {
+        atomic_ulong n_refs;
+        _Atomic(uint32_t) hash;
+        CDVarInternEntry *next;
+        CDVarType types[];
+};
+
+/**
+ * struct CDVarInternTable - Hash table of interned types
+ * @retired:            next replaced table, which is yet to be freed
+ * @n_slots:            number of slots, a power of 2
+ * @n_used:             number of non-empty slots, including tombstones
+ * @slots:              entries, or NULL if empty
+ */
+struct CDVarInternTable {
+        CDVarInternTable *retired;
+        size_t n_slots;
+        size_t n_used;
+        _Atomic(CDVarInternEntry *) slots[];
+};
+
+/*
+ * Removed entries leave a tombstone in their slot, so probe sequences of
+ * other entries are not cut short. The tombstone is an entry with a reference
+ * count of 0, so readers skip it like any other unused entry.
+ */
+static CDVarInternEntry c_dvar_intern_tombstone;
+
+static struct {
+        pthread_mutex_t lock;
+        _Atomic(CDVarInternTable *) table;
+        CDVarInternTable *retired;
+        CDVarInternEntry *unused[C_DVAR_TYPE_LENGTH_MAX + 1];
+} c_dvar_intern_registry = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static CDVarInternEntry *c_dvar_intern_entry(const CDVarType *type) {
+        return (CDVarInternEntry *)((char *)type - offsetof(CDVarInternEntry, types));
+}
+
+static bool c_dvar_intern_try_ref(CDVarInternEntry *entry) {
+        unsigned long n;
+
+        n = atomic_load_explicit(&entry->n_refs, memory_order_relaxed);
+        do {
+                if (!n)
+                        return false;
+        } while (!atomic_compare_exchange_weak_explicit(&entry->n_refs,
+                                                        &n,
+                                                        n + 1,
+                                                        memory_order_acquire,
+                                                        memory_order_relaxed));
+
+        return true;
+}
+
+static CDVarInternEntry *c_dvar_intern_find(CDVarInternTable *table,
+                                            uint32_t hash,
+                                            const char *signature,
+                                            size_t n_signature,
+                                            bool locked) {
+        CDVarInternEntry *entry;
+        size_t i;
+
+        if (!table)
+                return NULL;
+
+        /*
+         * Tombstones are purged in place, so a concurrent purge might move an
+         * entry behind a lock-free reader. Such a reader merely misses the
+         * entry and falls back to the locked path. The probe is bounded by the
+         * table size, so it terminates even if slots change under its feet.
+         */
+        for (i = hash; i < hash + table->n_slots; ++i) {
+                entry = atomic_load_explicit(&table->slots[i & (table->n_slots - 1)],
+                                             memory_order_acquire);
+                if (!entry)
+                        return NULL;
+
+                if (atomic_load_explicit(&entry->hash, memory_order_relaxed) != hash)
+                        continue;
+
+                if (locked) {
+                        /*
+                         * With the lock held, entries cannot be recycled, so
+                         * they can be verified before taking a reference.
+                         * This avoids dropping a reference with the lock
+                         * held.
+                         */
+                        if (c_dvar_type_compare_string(entry->types, signature, n_signature))
+                                continue;
+                        if (!c_dvar_intern_try_ref(entry))
+                                continue;
+
+                        return entry;
+                }
+
+                if (!c_dvar_intern_try_ref(entry))
+                        continue;
+
+                /*
+                 * The entry might have been recycled since we loaded it. Only
+                 * now that we hold a reference, its content is stable and can
+                 * be verified.
+                 */
+                if (!c_dvar_type_compare_string(entry->types, signature, n_signature))
+                        return entry;
+
+                c_dvar_type_unref(entry->types);
+        }
+
+        return NULL;
+}
+
+static void c_dvar_intern_insert(CDVarInternTable *table, CDVarInternEntry *entry) {
+        size_t i;
+
+        for (i = atomic_load_explicit(&entry->hash, memory_order_relaxed);
+             atomic_load_explicit(&table->slots[i & (table->n_slots - 1)], memory_order_relaxed);
+             ++i)
+                ;
+
+        atomic_store_explicit(&table->slots[i & (table->n_slots - 1)], entry, memory_order_release);
+        ++table->n_used;
+}
+
+static int c_dvar_intern_purge(CDVarInternTable *table, size_t n_live) {
+        CDVarInternEntry *entry, **entries;
+        size_t i, j;
+
+        entries = malloc((n_live ?: 1) * sizeof(*entries));
+        if (!entries)
+                return -ENOMEM;
+
+        for (i = 0, j = 0; i < table->n_slots; ++i) {
+                entry = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+                if (entry && entry != &c_dvar_intern_tombstone)
+                        entries[j++] = entry;
+
+                atomic_store_explicit(&table->slots[i], NULL, memory_order_relaxed);
+        }
+
+        table->n_used = 0;
+        for (i = 0; i < j; ++i)
+                c_dvar_intern_insert(table, entries[i]);
+
+        free(entries);
+        return 0;
+}
+
+static int c_dvar_intern_grow(void) {
+        CDVarInternTable *table, *old;
+        CDVarInternEntry *entry;
+        size_t i, j, n_slots;
+
+        old = atomic_load_explicit(&c_dvar_intern_registry.table, memory_order_relaxed);
+
+        /*
+         * Size the table based on the live entries only. If the current table
+         * is large enough, it is merely cleared of tombstones, rather than
+         * replaced.
+         */
+        for (i = 0, j = 0; old && i < old->n_slots; ++i) {
+                entry = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+                if (entry && entry != &c_dvar_intern_tombstone)
+                        ++j;
+        }
+
+        for (n_slots = C_DVAR_INTERN_SLOTS_MIN; n_slots < 4 * j; n_slots *= 2)
+                ;
+
+        if (old && n_slots <= old->n_slots)
+                return c_dvar_intern_purge(old, j);
+
+        table = calloc(1, sizeof(*table) + n_slots * sizeof(*table->slots));
+        if (!table)
+                return -ENOMEM;
+
+        table->n_slots = n_slots;
+
+        for (i = 0; old && i < old->n_slots; ++i) {
+                entry = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+                if (entry && entry != &c_dvar_intern_tombstone)
+                        c_dvar_intern_insert(table, entry);
+        }
+
+        atomic_store_explicit(&c_dvar_intern_registry.table, table, memory_order_release);
+
+        if (old) {
+                old->retired = c_dvar_intern_registry.retired;
+                c_dvar_intern_registry.retired = old;
+        }
+
+        return 0;
+}
+
+static int c_dvar_intern_add(CDVarInternEntry **entryp, uint32_t hash, const CDVarType *type) {
+        CDVarInternEntry *entry, *slot;
+        CDVarInternTable *table;
+        size_t i;
+        int r;
+
+        table = atomic_load_explicit(&c_dvar_intern_registry.table, memory_order_relaxed);
+        if (!table || (table->n_used + 1) * 2 > table->n_slots) {
+                r = c_dvar_intern_grow();
+                if (r)
+                        return r;
+
+                table = atomic_load_explicit(&c_dvar_intern_registry.table, memory_order_relaxed);
+        }
+
+        entry = c_dvar_intern_registry.unused[type->length];
+        if (entry) {
+                c_dvar_intern_registry.unused[type->length] = entry->next;
+        } else {
+                entry = malloc(sizeof(*entry) + type->length * sizeof(*type));
+                if (!entry)
+                        return -ENOMEM;
+
+                atomic_init(&entry->n_refs, 0);
+                atomic_init(&entry->hash, 0);
+        }
+
+        /*
+         * Readers might still inspect recycled entries, but never look at the
+         * type array unless they acquired a reference. Hence, the reference
+         * count is set last, so it publishes the new content.
+         */
+        entry->next = NULL;
+        memcpy(entry->types, type, type->length * sizeof(*type));
+        atomic_store_explicit(&entry->hash, hash, memory_order_relaxed);
+        atomic_store_explicit(&entry->n_refs, 1, memory_order_release);
+
+        for (i = hash; ; ++i) {
+                slot = atomic_load_explicit(&table->slots[i & (table->n_slots - 1)], memory_order_relaxed);
+                if (!slot) {
+                        ++table->n_used;
+                        break;
+                } else if (slot == &c_dvar_intern_tombstone) {
+                        break;
+                }
+        }
+
+        atomic_store_explicit(&table->slots[i & (table->n_slots - 1)], entry, memory_order_release);
+
+        *entryp = entry;
+        return 0;
+}
+
+static void c_dvar_intern_remove(CDVarInternEntry *entry) {
+        CDVarInternTable *table;
+        CDVarInternEntry *slot;
+        size_t i, length;
+
+        table = atomic_load_explicit(&c_dvar_intern_registry.table, memory_order_relaxed);
+
+        for (i = atomic_load_explicit(&entry->hash, memory_order_relaxed); ; ++i) {
+                slot = atomic_load_explicit(&table->slots[i & (table->n_slots - 1)], memory_order_relaxed);
+                c_assert(slot);
+
+                if (slot == entry) {
+                        atomic_store_explicit(&table->slots[i & (table->n_slots - 1)],
+                                              &c_dvar_intern_tombstone,
+                                              memory_order_release);
+                        break;
+                }
+        }
+
+        length = entry->types->length;
+        entry->next = c_dvar_intern_registry.unused[length];
+        c_dvar_intern_registry.unused[length] = entry;
+}
+
+/**
+ * c_dvar_type_intern() - look up interned type
+ * @typep:              output argument for the interned type
+ * @signature:          type signature
+ * @n_signature:        length of type signature
+ *
+ * This looks up the type described by @signature in the process-wide type
+ * registry. If it is not registered, yet, the signature is parsed and the
+ * resulting type is registered. In either case, a new reference to the
+ * interned type is returned in @typep. It must be released via
+ * c_dvar_type_unref(), rather than c_dvar_type_free().
+ *
+ * Interned types are immutable and shared by all callers. Hence, two interned
+ * types are equal if, and only if, they are the same pointer.
+ *
+ * Unlike c_dvar_type_new_from_signature(), this requires @signature to be a
+ * single complete type. If it contains more than a single complete type,
+ * C_DVAR_E_INVALID_TYPE is returned.
+ *
+ * The registry is thread-safe. Looking up a registered type does not take any
+ * locks, and writes to no shared memory other than the reference count of the
+ * type.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on parser errors.
+ */
+_c_public_ int c_dvar_type_intern(const CDVarType **typep, const char *signature, size_t n_signature) {
+        CDVarType *type, types[C_DVAR_TYPE_LENGTH_MAX];
+        CDVarInternEntry *entry;
+        uint32_t hash;
+        int r;
+
+        hash = c_dvar_signature_hash(signature, n_signature);
+
+        entry = c_dvar_intern_find(atomic_load_explicit(&c_dvar_intern_registry.table,
+                                                        memory_order_acquire),
+                                   hash,
+                                   signature,
+                                   n_signature,
+                                   false);
+        if (entry) {
+                *typep = entry->types;
+                return 0;
+        }
+
+        type = types;
+        r = c_dvar_type_new_from_signature(&type, signature, n_signature);
+        if (r)
+                return r;
+        if (type->length != n_signature)
+                return C_DVAR_E_INVALID_TYPE;
+
+        pthread_mutex_lock(&c_dvar_intern_registry.lock);
+
+        /* re-check with the lock held, someone might have raced us */
+        entry = c_dvar_intern_find(atomic_load_explicit(&c_dvar_intern_registry.table,
+                                                        memory_order_relaxed),
+                                   hash,
+                                   signature,
+                                   n_signature,
+                                   true);
+        if (!entry) {
+                r = c_dvar_intern_add(&entry, hash, type);
+                if (r) {
+                        pthread_mutex_unlock(&c_dvar_intern_registry.lock);
+                        return r;
+                }
+        }
+
+        pthread_mutex_unlock(&c_dvar_intern_registry.lock);
+
+        *typep = entry->types;
+        return 0;
+}
+
+/**
+ * c_dvar_type_ref() - acquire reference to interned type
+ * @type:               interned type to acquire reference to, or NULL
+ *
+ * This acquires a new reference to the interned type @type. The caller must
+ * already own a reference. @type must have been returned by
+ * c_dvar_type_intern(), any other type must not be passed.
+ *
+ * If @type is NULL, this is a no-op.
+ *
+ * Return: @type is returned.
+ */
+_c_public_ const CDVarType *c_dvar_type_ref(const CDVarType *type) {
+        if (type)
+                atomic_fetch_add_explicit(&c_dvar_intern_entry(type)->n_refs, 1, memory_order_relaxed);
+
+        return type;
+}
+
+/**
+ * c_dvar_type_unref() - release reference to interned type
+ * @type:               interned type to release reference to, or NULL
+ *
+ * This releases a reference to the interned type @type. Once the last
+ * reference is released, the type is removed from the registry.
+ *
+ * If @type is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ const CDVarType *c_dvar_type_unref(const CDVarType *type) {
+        CDVarInternEntry *entry;
+
+        if (!type)
+                return NULL;
+
+        entry = c_dvar_intern_entry(type);
+
+        if (atomic_fetch_sub_explicit(&entry->n_refs, 1, memory_order_release) == 1) {
+                atomic_thread_fence(memory_order_acquire);
+
+                pthread_mutex_lock(&c_dvar_intern_registry.lock);
+                c_dvar_intern_remove(entry);
+                pthread_mutex_unlock(&c_dvar_intern_registry.lock);
+        }
+
+        return NULL;
+}
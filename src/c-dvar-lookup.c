@@ -0,0 +1,496 @@
+/*
+ * Dictionary Lookup
+ *
+ * Dictionaries are serialized as arrays of dict-entries, so finding a key
+ * requires a linear scan of all preceding entries. This file implements such
+ * scans on a single contiguous buffer via c_dvar_read_entry(), which neither
+ * enters the entries, nor parses any format strings. Keys are read straight
+ * from the data and compared in place. Values are jumped over as a whole:
+ * values of fixed size are verified via their layout, all others via the
+ * single-pass validator. Only the matching entry of c_dvar_read_lookup() is
+ * entered, since the caller reads its value.
+ *
+ * Readers on segments or partial data cannot access the data directly. They
+ * read every entry via c_dvar_read() instead.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+static int c_dvar_lookup_enter(CDVar *var, CDVarLayout *layout) {
+        const CDVarType *type = var->current->i_type;
+
+        if (_c_unlikely_(!var->current->n_type ||
+                         type[0].element != 'a' ||
+                         type[1].element != '{'))
+                return -ENOTRECOVERABLE;
+
+        /* type[2] is the key, type[3] the value */
+        if (type[3].size)
+                c_dvar_layout_init(layout, type + 3, var->big_endian);
+
+        return c_dvar_read(var, "[");
+}
+
+static int c_dvar_lookup_read_key(CDVar *var, char c, CDVarKey *key) {
+        int16_t i16;
+        int32_t i32;
+        uint8_t u8;
+        double d;
+        bool b;
+        int r;
+
+        *key = (CDVarKey){};
+
+        switch (c) {
+        case 'y':
+                r = c_dvar_read(var, "{y", &u8);
+                key->u64 = u8;
+                break;
+        case 'b':
+                r = c_dvar_read(var, "{b", &b);
+                key->u64 = b;
+                break;
+        case 'n':
+        case 'q':
+                r = c_dvar_read(var, (char [3]){ '{', c, 0 }, &i16);
+                key->u64 = (c == 'n') ? (uint64_t)(int64_t)i16 : (uint16_t)i16;
+                break;
+        case 'i':
+        case 'h':
+        case 'u':
+                r = c_dvar_read(var, (char [3]){ '{', c, 0 }, &i32);
+                key->u64 = (c == 'i') ? (uint64_t)(int64_t)i32 : (uint32_t)i32;
+                break;
+        case 'x':
+        case 't':
+                r = c_dvar_read(var, (char [3]){ '{', c, 0 }, &key->u64);
+                break;
+        case 'd':
+                r = c_dvar_read(var, "{d", &d);
+                memcpy(&key->u64, &d, sizeof(d));
+                break;
+        case 's':
+        case 'o':
+        case 'g':
+                r = c_dvar_read(var, (char [3]){ '{', c, 0 }, &key->str);
+                break;
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        return r;
+}
+
+/*
+ * Read the key of the next entry of the current dictionary, without entering
+ * the entry. The key is never deferred, since it is compared right away. The
+ * entry counts towards the maximum depth, just like entering it would.
+ */
+static int c_dvar_read_entry_key(CDVar *var, CDVarKey *key) {
+        const CDVarType *type = var->current->i_type + 2;
+        const char *data;
+        uint32_t u32;
+        uint64_t u64;
+        int r;
+
+        assert(!var->vecs && !var->partial);
+        assert(var->current->container == 'a' && var->current->i_type->element == '{');
+
+        if (_c_unlikely_(var->current >= var->levels + C_DVAR_TYPE_DEPTH_MAX - 1))
+                return C_DVAR_E_DEPTH_OVERFLOW;
+
+        /* entries are 8-byte aligned */
+        r = c_dvar_read_data(var, 3, NULL, 0);
+        if (r)
+                return r;
+
+        *key = (CDVarKey){};
+
+        switch (type[-1].element) {
+        case 'y':
+                r = c_dvar_read_data(var, 0, &data, 1);
+                if (r)
+                        return r;
+
+                key->u64 = c_load_8(data, 0);
+                break;
+        case 'n':
+        case 'q':
+                r = c_dvar_read_data(var, 1, &data, 2);
+                if (r)
+                        return r;
+
+                key->u64 = var->big_endian ? c_load_16be_aligned(data, 0) : c_load_16le_aligned(data, 0);
+                if (type[-1].element == 'n')
+                        key->u64 = (uint64_t)(int64_t)(int16_t)key->u64;
+                break;
+        case 'b':
+        case 'i':
+        case 'h':
+        case 'u':
+                r = c_dvar_read_data(var, 2, &data, 4);
+                if (r)
+                        return r;
+
+                u32 = var->big_endian ? c_load_32be_aligned(data, 0) : c_load_32le_aligned(data, 0);
+                if (type[-1].element == 'b' && _c_unlikely_(!var->trusted && u32 > 1))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+                key->u64 = (type[-1].element == 'i') ? (uint64_t)(int64_t)(int32_t)u32 : u32;
+                break;
+        case 'x':
+        case 't':
+        case 'd':
+                r = c_dvar_read_data(var, 3, &data, 8);
+                if (r)
+                        return r;
+
+                u64 = var->big_endian ? c_load_64be_aligned(data, 0) : c_load_64le_aligned(data, 0);
+                key->u64 = u64;
+                break;
+        case 's':
+        case 'o':
+        case 'g':
+                if (type[-1].element == 'g') {
+                        r = c_dvar_read_data(var, 0, &data, 1);
+                        if (r)
+                                return r;
+
+                        u32 = c_load_8(data, 0);
+                } else {
+                        r = c_dvar_read_data(var, 2, &data, 4);
+                        if (r)
+                                return r;
+
+                        u32 = var->big_endian ? c_load_32be_aligned(data, 0) : c_load_32le_aligned(data, 0);
+                }
+
+                r = c_dvar_read_data(var, 0, &data, (size_t)u32 + 1);
+                if (r)
+                        return r;
+
+                if (!var->trusted &&
+                    (data[u32] ||
+                     (type[-1].element == 's' && !c_dvar_is_string(data, u32)) ||
+                     (type[-1].element == 'o' && !c_dvar_is_path(data, u32)) ||
+                     (type[-1].element == 'g' && !c_dvar_is_signature(data, u32))))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+                key->str = data;
+                break;
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        return 0;
+}
+
+/*
+ * Jump over the value of the entry whose key was just read by
+ * c_dvar_read_entry_key(). If @value is non-NULL, it is set to the value.
+ * Lazy readers defer the strings of values that are jumped over, but not of
+ * spans, since those are handed to the caller.
+ */
+static int c_dvar_read_entry_value(CDVar *var, const CDVarLayout *layout, CDVarSpan *value) {
+        const CDVarType *type = var->current->i_type + 2;
+        size_t start, pos;
+        const char *data;
+        int r;
+
+        if (type->size) {
+                r = c_dvar_read_data(var, type->alignment, &data, type->size);
+                if (r)
+                        return r;
+
+                if (!var->trusted) {
+                        r = c_dvar_layout_verify(layout, data, type->size, NULL);
+                        if (r)
+                                return r;
+                }
+
+                start = var->current->i_buffer - type->size;
+        } else {
+                start = c_align_to(var->current->i_buffer + var->shift, 1 << type->alignment) - var->shift;
+                pos = var->current->i_buffer;
+
+                /* the value is nested in the entry, one level below */
+                r = c_dvar_validate_value(var->big_endian,
+                                          var->trusted,
+                                          type,
+                                          var->data,
+                                          var->shift,
+                                          &pos,
+                                          var->current->i_buffer + var->current->n_buffer,
+                                          var->current - var->levels + 1,
+                                          (!value && var->lazy) ? &var->deferred : NULL);
+                if (r)
+                        return r;
+
+                var->current->n_buffer -= pos - var->current->i_buffer;
+                var->current->i_buffer = pos;
+        }
+
+        if (value) {
+                *value = (CDVarSpan){
+                        .type = type,
+                        .data = var->data + start,
+                        .n_data = var->current->i_buffer - start,
+                        .offset = var->shift + start,
+                        .big_endian = var->big_endian,
+                };
+        }
+
+        return 0;
+}
+
+/*
+ * Read the next entry of the current dictionary as a whole, without entering
+ * it. The key is returned in @key, the value in @value. The entry is validated
+ * just like reading it would. This requires a single contiguous buffer with
+ * all data available, and @layout must be the layout of the value type, if it
+ * is of fixed size.
+ */
+int c_dvar_read_entry(CDVar *var, const CDVarLayout *layout, CDVarKey *key, CDVarSpan *value) {
+        int r;
+
+        r = c_dvar_read_entry_key(var, key);
+        if (r)
+                return r;
+
+        return c_dvar_read_entry_value(var, layout, value);
+}
+
+static bool c_dvar_lookup_match(char c, const CDVarKey *key, const CDVarKey *entry) {
+        switch (c) {
+        case 's':
+        case 'o':
+        case 'g':
+                return key->str && !strcmp(key->str, entry->str);
+        default:
+                return key->u64 == entry->u64;
+        }
+}
+
+static int c_dvar_lookup_skip(CDVar *var, const CDVarLayout *layout) {
+        if (var->current->i_type->size)
+                return c_dvar_read_fixed(var, layout, NULL);
+
+        return c_dvar_jump(var, NULL);
+}
+
+static int c_dvar_try_read_lookup(CDVar *var, const CDVarKey *key, bool *foundp) {
+        size_t i_buffer, n_buffer;
+        CDVarLayout layout;
+        CDVarKey entry;
+        bool direct;
+        char c;
+        int r;
+
+        r = c_dvar_lookup_enter(var, &layout);
+        if (r)
+                return r;
+
+        c = var->current->i_type[1].element;
+        direct = !var->vecs && !var->partial;
+
+        while (c_dvar_more(var)) {
+                if (direct) {
+                        i_buffer = var->current->i_buffer;
+                        n_buffer = var->current->n_buffer;
+
+                        r = c_dvar_read_entry_key(var, &entry);
+                        if (r)
+                                return r;
+
+                        if (!c_dvar_lookup_match(c, key, &entry)) {
+                                r = c_dvar_read_entry_value(var, &layout, NULL);
+                                if (r)
+                                        return r;
+
+                                continue;
+                        }
+
+                        /* enter the matching entry again, so the caller reads its value */
+                        var->current->i_buffer = i_buffer;
+                        var->current->n_buffer = n_buffer;
+                }
+
+                r = c_dvar_lookup_read_key(var, c, &entry);
+                if (r)
+                        return r;
+
+                if (c_dvar_lookup_match(c, key, &entry)) {
+                        *foundp = true;
+                        return 0;
+                }
+
+                r = c_dvar_lookup_skip(var, &layout);
+                if (r)
+                        return r;
+
+                r = c_dvar_read(var, "}");
+                if (r)
+                        return r;
+        }
+
+        r = c_dvar_read(var, "]");
+        if (r)
+                return r;
+
+        *foundp = false;
+        return 0;
+}
+
+static int c_dvar_try_read_lookup_many(CDVar *var, const CDVarKey *keys, size_t n_keys, CDVarSpan *values) {
+        CDVarLayout layout;
+        CDVarKey entry;
+        size_t i;
+        char c;
+        int r;
+
+        r = c_dvar_lookup_enter(var, &layout);
+        if (r)
+                return r;
+
+        c = var->current->i_type[1].element;
+
+        for (i = 0; i < n_keys; ++i)
+                values[i] = (CDVarSpan){};
+
+        while (c_dvar_more(var)) {
+                if (!var->vecs && !var->partial) {
+                        r = c_dvar_read_entry_key(var, &entry);
+                        if (r)
+                                return r;
+
+                        /* the first entry of a key wins, just like for lookups */
+                        for (i = 0; i < n_keys; ++i)
+                                if (!values[i].type && c_dvar_lookup_match(c, keys + i, &entry))
+                                        break;
+
+                        r = c_dvar_read_entry_value(var, &layout, (i < n_keys) ? values + i : NULL);
+                        if (r)
+                                return r;
+
+                        continue;
+                }
+
+                r = c_dvar_lookup_read_key(var, c, &entry);
+                if (r)
+                        return r;
+
+                /* the first entry of a key wins, just like for lookups */
+                for (i = 0; i < n_keys; ++i)
+                        if (!values[i].type && c_dvar_lookup_match(c, keys + i, &entry))
+                                break;
+
+                if (i < n_keys)
+                        r = c_dvar_jump(var, values + i);
+                else
+                        r = c_dvar_lookup_skip(var, &layout);
+                if (r)
+                        return r;
+
+                r = c_dvar_read(var, "}");
+                if (r)
+                        return r;
+        }
+
+        return c_dvar_read(var, "]");
+}
+
+/**
+ * c_dvar_read_lookup() - look up key in dictionary
+ * @var:                variant to operate on
+ * @key:                key to look up
+ * @foundp:             output argument for whether @key was found
+ *
+ * This enters the next dictionary of @var and scans it for the first entry
+ * with the key @key. If found, the reader is positioned at the value of that
+ * entry, inside the entry. The caller reads the value, and then leaves the
+ * entry and the dictionary as usual (i.e., via "}", skipping any remaining
+ * entries, and "]"). If not found, the entire dictionary was read.
+ *
+ * All entries preceding the found entry are validated. Their values are not
+ * entered, but jumped over as a whole.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_lookup(CDVar *var, const CDVarKey *key, bool *foundp) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_lookup(var, key, foundp);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_read_lookup_many() - look up multiple keys in dictionary
+ * @var:                variant to operate on
+ * @keys:               keys to look up
+ * @n_keys:             number of keys in @keys
+ * @values:             output array of @n_keys spans
+ *
+ * This reads the next dictionary of @var entirely, and looks up all keys in
+ * @keys in a single pass. For every key, the corresponding span in @values is
+ * set to the value of the first entry with that key. Keys that are not found
+ * get a span without type.
+ *
+ * Spans are returned just like c_dvar_read_span() does, and can be read via
+ * c_dvar_begin_read_span(). Their types are owned by @var, and are only valid
+ * as long as the dictionary type is.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_lookup_many(CDVar *var, const CDVarKey *keys, size_t n_keys, CDVarSpan *values) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_lookup_many(var, keys, n_keys, values);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_begin_read_span() - begin reading a span
+ * @var:                variant to operate on
+ * @span:               span to read
+ *
+ * This begins reading the value referred to by @span, similar to
+ * c_dvar_begin_read(). The root type of the reader is the type of @span,
+ * which must not be NULL.
+ */
+_c_public_ void c_dvar_begin_read_span(CDVar *var, const CDVarSpan *span) {
+        assert(span->type);
+
+        c_dvar_begin_read_shifted(var,
+                                  span->big_endian,
+                                  span->type,
+                                  1,
+                                  span->data,
+                                  span->n_data,
+                                  span->offset);
+}
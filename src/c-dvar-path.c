@@ -0,0 +1,339 @@
+/*
+ * Path Expressions
+ *
+ * A path expression selects a single value nested somewhere in a serialized
+ * value, without reading anything else. Paths are compiled against a type
+ * once, and then run on any number of readers positioned at that type. Only
+ * the values a path traverses are validated. Everything else is jumped over
+ * as a whole, or not looked at at all.
+ *
+ * A path is a sequence of steps:
+ *
+ *     .N       the N-th member of a tuple or dict entry
+ *     [N]      the N-th element of an array
+ *     {KEY}    the value of the first entry with key KEY of a dictionary
+ *
+ * Indices are zero-based. Keys are given verbatim for string, object path and
+ * signature keys, and in decimal for integer keys (0 and 1 for booleans).
+ * Keys cannot contain '}', and dictionaries with double keys are not
+ * supported. For instance, ".1[2].0" selects the first member of the third
+ * element of the array in the second member of a tuple, and "{Foo}" the
+ * value of the key "Foo" in a dictionary. The empty path selects the entire
+ * value.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+static const char *c_dvar_path_parse_u64(const char *p, uint64_t max, uint64_t *u64p) {
+        uint64_t u64 = 0, digit;
+
+        if (*p < '0' || *p > '9')
+                return NULL;
+
+        do {
+                /* the digit alone might exceed @max, e.g., for booleans */
+                digit = *p++ - '0';
+                if (digit > max || u64 > (max - digit) / 10)
+                        return NULL;
+
+                u64 = u64 * 10 + digit;
+        } while (*p >= '0' && *p <= '9');
+
+        *u64p = u64;
+        return p;
+}
+
+static int c_dvar_path_parse_key(CDVarKey *key, char c, const char *str) {
+        uint64_t max, u64;
+        bool negative;
+
+        switch (c) {
+        case 's':
+        case 'o':
+        case 'g':
+                key->str = str;
+                return 0;
+        case 'b':
+                max = 1;
+                break;
+        case 'y':
+                max = UINT8_MAX;
+                break;
+        case 'q':
+                max = UINT16_MAX;
+                break;
+        case 'h':
+        case 'u':
+                max = UINT32_MAX;
+                break;
+        case 't':
+                max = UINT64_MAX;
+                break;
+        case 'n':
+                max = INT16_MAX;
+                break;
+        case 'i':
+                max = INT32_MAX;
+                break;
+        case 'x':
+                max = INT64_MAX;
+                break;
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        /* signed keys are sign-extended, so allow one more negative value */
+        negative = (*str == '-' && (c == 'n' || c == 'i' || c == 'x'));
+        str = c_dvar_path_parse_u64(str + negative, max + negative, &u64);
+        if (!str || *str)
+                return -ENOTRECOVERABLE;
+
+        key->u64 = negative ? -u64 : u64;
+        return 0;
+}
+
+/**
+ * c_dvar_path_new() - compile path expression
+ * @pathp:              output argument for newly allocated path
+ * @type:               type to compile against
+ * @expression:         path expression to compile
+ *
+ * This compiles the path expression @expression against the single complete
+ * type @type. The resulting path can be passed to c_dvar_read_path(), whenever
+ * the reader is positioned at @type. See the description at the top of this
+ * file for the syntax of path expressions.
+ *
+ * The path keeps a reference to @type, rather than a copy. The caller must
+ * make sure @type outlives the path, and must use the very same type array
+ * for the reader.
+ *
+ * Return: 0 on success, -ENOTRECOVERABLE if @expression is invalid or does
+ *         not match @type, other negative error code on fatal failure.
+ */
+_c_public_ int c_dvar_path_new(CDVarPath **pathp, const CDVarType *type, const char *expression) {
+        _c_cleanup_(c_dvar_path_freep) CDVarPath *path = NULL;
+        const CDVarType *member;
+        const char *p, *end;
+        CDVarPathStep *step;
+        uint64_t u64;
+        char *keys;
+        size_t n;
+        int r;
+
+        n = strlen(expression);
+
+        path = calloc(1, sizeof(*path) + n * sizeof(*path->steps) + n + 1);
+        if (!path)
+                return -ENOMEM;
+
+        path->type = type;
+        keys = (char *)(path->steps + n);
+
+        for (p = expression; *p; ) {
+                step = path->steps + path->n_steps++;
+                step->op = *p++;
+
+                switch (step->op) {
+                case '.':
+                        if (type->element != '(' && type->element != '{')
+                                return -ENOTRECOVERABLE;
+
+                        p = c_dvar_path_parse_u64(p, UINT32_MAX, &u64);
+                        if (!p)
+                                return -ENOTRECOVERABLE;
+
+                        member = type + 1;
+                        for (step->index = 0; step->index < u64; ++step->index) {
+                                if (member->element == ')' || member->element == '}')
+                                        return -ENOTRECOVERABLE;
+
+                                member += member->length;
+                        }
+
+                        if (member->element == ')' || member->element == '}')
+                                return -ENOTRECOVERABLE;
+
+                        type = member;
+                        path->depth += 1;
+                        break;
+
+                case '[':
+                        if (type->element != 'a')
+                                return -ENOTRECOVERABLE;
+
+                        p = c_dvar_path_parse_u64(p, UINT32_MAX, &u64);
+                        if (!p || *p++ != ']')
+                                return -ENOTRECOVERABLE;
+
+                        step->index = u64;
+                        type += 1;
+                        path->depth += 1;
+                        break;
+
+                case '{':
+                        if (type->element != 'a' || type[1].element != '{')
+                                return -ENOTRECOVERABLE;
+
+                        end = strchr(p, '}');
+                        if (!end)
+                                return -ENOTRECOVERABLE;
+
+                        memcpy(keys, p, end - p);
+                        keys[end - p] = 0;
+
+                        r = c_dvar_path_parse_key(&step->key, type[2].element, keys);
+                        if (r)
+                                return r;
+
+                        keys += end - p + 1;
+                        p = end + 1;
+                        type += 3;
+                        path->depth += 2;
+                        break;
+
+                default:
+                        return -ENOTRECOVERABLE;
+                }
+        }
+
+        *pathp = path;
+        path = NULL;
+        return 0;
+}
+
+/**
+ * c_dvar_path_free() - free path expression
+ * @path:               path to free, or NULL
+ *
+ * This deallocates @path. If @path is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CDVarPath *c_dvar_path_free(CDVarPath *path) {
+        free(path);
+        return NULL;
+}
+
+static int c_dvar_try_read_path(CDVar *var, const CDVarPath *path, CDVarSpan *span) {
+        const CDVarPathStep *step;
+        const CDVarType *type;
+        size_t i, n, stride;
+        bool found;
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type || var->current->i_type != path->type))
+                return -ENOTRECOVERABLE;
+        if (_c_unlikely_(var->current - var->levels + path->depth >= C_DVAR_TYPE_DEPTH_MAX))
+                return C_DVAR_E_DEPTH_OVERFLOW;
+
+        *span = (CDVarSpan){};
+
+        for (step = path->steps; step < path->steps + path->n_steps; ++step) {
+                switch (step->op) {
+                case '.':
+                        r = c_dvar_read(var, (char [2]){ var->current->i_type->element, 0 });
+                        if (r)
+                                return r;
+
+                        for (i = 0; i < step->index; ++i) {
+                                r = c_dvar_jump(var, NULL);
+                                if (r)
+                                        return r;
+                        }
+
+                        break;
+
+                case '[':
+                        r = c_dvar_read(var, "[");
+                        if (r)
+                                return r;
+
+                        type = var->current->i_type;
+
+                        /*
+                         * Elements of fixed size are counted, rather than
+                         * skipped. Unless they need validation, they are
+                         * not even looked at.
+                         */
+                        if (type->size) {
+                                stride = c_align_to(type->size, 1 << type->alignment);
+                                n = var->current->n_buffer;
+                                n = (n < type->size) ? 0 : (n - type->size) / stride + 1;
+                                if (step->index >= n)
+                                        return 0;
+
+                                r = c_dvar_jump_elements(var, step->index);
+                                if (r)
+                                        return r;
+                        } else {
+                                for (i = 0; i < step->index; ++i) {
+                                        if (!c_dvar_more(var))
+                                                return 0;
+
+                                        r = c_dvar_jump(var, NULL);
+                                        if (r)
+                                                return r;
+                                }
+
+                                if (!c_dvar_more(var))
+                                        return 0;
+                        }
+
+                        break;
+
+                case '{':
+                        r = c_dvar_read_lookup(var, &step->key, &found);
+                        if (r || !found)
+                                return r;
+
+                        break;
+
+                default:
+                        return -ENOTRECOVERABLE;
+                }
+        }
+
+        return c_dvar_jump(var, span);
+}
+
+/**
+ * c_dvar_read_path() - read value selected by path expression
+ * @var:                variant to operate on
+ * @path:               compiled path expression
+ * @span:               output argument for the selected value
+ *
+ * This runs the path @path on the next value of @var, which must be of the
+ * type @path was compiled against. On success, @span refers to the selected
+ * value, just like c_dvar_read_span() returns it. If the value does not exist
+ * (i.e., an array is too short, or a dictionary lacks the key), @span is set
+ * to a span without type.
+ *
+ * Only the values traversed by the path are validated. Hence, @var is left
+ * positioned right behind the selected value, inside of all the containers
+ * the path entered. Usually, the reader is discarded afterwards.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_path(CDVar *var, const CDVarPath *path, CDVarSpan *span) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_path(var, path, span);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
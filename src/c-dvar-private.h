@@ -10,22 +10,327 @@
 #include <c-stdaux.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdalign.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include "c-dvar.h"
 
+typedef struct CDVarCacheEntry CDVarCacheEntry;
+typedef struct CDVarCacheSlot CDVarCacheSlot;
+typedef struct CDVarLayout CDVarLayout;
 typedef struct CDVarLevel CDVarLevel;
+typedef struct CDVarOp CDVarOp;
+typedef struct CDVarPathStep CDVarPathStep;
+typedef struct CDVarTableSlot CDVarTableSlot;
+
+/*
+ * The size of a fixed-size type is stored in an 11-bit field of CDVarType.
+ * The type parser can never exceed it, since a single type signature is
+ * limited to 255 characters.
+ */
+#define C_DVAR_TYPE_SIZE_MAX (1 << 11)
+
+/**
+ * struct CDVarLayout - Layout of a fixed-size type
+ * @size:               size of a single element
+ * @stride:             distance between two consecutive array elements
+ * @period:             length of @mask
+ * @width:              size of all members, if uniform and unpadded, or 0
+ * @multibyte:          whether any member is subject to byte-order
+ * @checked:            whether @mask has any bit set
+ * @n_members:          number of entries in @members
+ * @members:            offset and size of all multi-byte members
+ * @mask:               bits that must be zero in valid data
+ *
+ * This describes the serialization of a fixed-size type as a bitmask of all
+ * bits that are required to be zero. This covers alignment padding, as well
+ * as the upper 31 bits of booleans. The mask is repeated to cover a multiple
+ * of @stride that is suitable for word-wise verification of arrays.
+ *
+ * Additionally, all members that are subject to byte-order are listed in
+ * @members. If all members have the same size and there is no padding, this
+ * size is cached in @width, and an array of such elements can be treated as
+ * an array of plain integers.
+ */
+struct CDVarLayout {
+        size_t size;
+        size_t stride;
+        size_t period;
+        uint8_t width;
+        bool multibyte : 1;
+        bool checked : 1;
+        size_t n_members;
+        struct {
+                uint16_t offset;
+                uint16_t size;
+        } members[C_DVAR_TYPE_LENGTH_MAX];
+        alignas(8) uint8_t mask[C_DVAR_TYPE_SIZE_MAX + 64];
+};
+
+/*
+ * The type cache is an open-addressing hash table with a fixed number of
+ * slots. It is never filled beyond half its slots, so probe sequences stay
+ * short and lookups of missing entries terminate quickly.
+ */
+#define C_DVAR_CACHE_SLOTS (C_DVAR_CACHE_MAX * 2)
+
+/**
+ * struct CDVarCacheEntry - Cached type
+ * @n_refs:             number of references, including the one of the cache
+ * @types:              type array
+ *
+ * Readers take a reference on every cached type they enter, so an entry
+ * evicted from the cache stays valid until the last reader left it.
+ */
+struct CDVarCacheEntry {
+        size_t n_refs;
+        CDVarType types[];
+};
+
+/**
+ * struct CDVarCacheSlot - Slot of a type cache
+ * @hash:               hash of the signature of @type
+ * @used:               whether @type was used since the clock hand passed
+ * @type:               cached type array, or NULL if unused
+ */
+struct CDVarCacheSlot {
+        uint32_t hash;
+        bool used;
+        CDVarType *type;
+};
+
+/**
+ * struct CDVarCache - Type cache
+ * @n_types:            number of used slots
+ * @clock:              position of the clock hand
+ * @slots:              hash table of cached types
+ */
+struct CDVarCache {
+        size_t n_types;
+        size_t clock;
+        CDVarCacheSlot slots[C_DVAR_CACHE_SLOTS];
+};
+
+/**
+ * struct CDVarBounce - Linearized value
+ * @next:               next linearized value of the same reader, or NULL
+ * @data:               copy of the value
+ *
+ * If a reader operates on multiple segments, any value that spans segments is
+ * copied into a bounce buffer, so it can be returned as a contiguous range.
+ * Bounce buffers are owned by the reader and released when it is reset.
+ */
+struct CDVarBounce {
+        CDVarBounce *next;
+        alignas(8) char data[];
+};
+
+/**
+ * struct CDVarDeferred - Strings pending verification
+ * @n_strings:          number of pending strings
+ * @n_allocated:        number of allocated entries in @strings
+ * @strings:            pending strings
+ *
+ * Lazy readers do not verify the content of strings the caller skips, but
+ * record their offset into the data buffer here. They are verified in a single
+ * sweep by c_dvar_end_read(). Offsets rather than pointers are recorded, since
+ * c_dvar_feed() might move the data. The array is kept across
+ * c_dvar_begin_read(), so it is allocated only once per reader.
+ */
+struct CDVarDeferred {
+        size_t n_strings;
+        size_t n_allocated;
+        struct {
+                size_t offset;
+                uint32_t n;
+                char element;
+        } strings[];
+};
+
+/**
+ * struct CDVarIndex - Array index
+ * @data:               start of the array data
+ * @shift:              offset of @data relative to 8-byte alignment
+ * @n_elements:         number of array elements
+ * @big_endian:         whether the data is big-endian
+ * @stride:             distance between elements of fixed size, or 0
+ * @ends:               end offset of each element, relative to @data, or
+ *                      NULL if the elements are of fixed size
+ * @type:               copy of the element type
+ */
+struct CDVarIndex {
+        const uint8_t *data;
+        size_t shift;
+        size_t n_elements;
+        bool big_endian;
+        size_t stride;
+        uint32_t *ends;
+        CDVarType type[];
+};
+
+/**
+ * struct CDVarTableSlot - Slot of a dictionary table
+ * @hash:               hash of the key
+ * @key:                offset of the key, relative to the table data
+ * @value:              offset of the value, relative to the table data, or 0
+ *                      if the slot is empty
+ * @n_value:            length of the value in bytes
+ */
+struct CDVarTableSlot {
+        uint32_t hash;
+        uint32_t key;
+        uint32_t value;
+        uint32_t n_value;
+};
+
+/**
+ * struct CDVarTable - Dictionary table
+ * @data:               start of the dictionary data
+ * @shift:              offset of @data in the data of the reader
+ * @n_entries:          number of distinct keys
+ * @mask:               number of slots minus 1
+ * @big_endian:         whether the data is big-endian
+ * @type:               copy of the value type, stored behind @slots
+ * @slots:              hash table slots, a power of two
+ */
+struct CDVarTable {
+        const uint8_t *data;
+        size_t shift;
+        size_t n_entries;
+        size_t mask;
+        bool big_endian;
+        CDVarType *type;
+        CDVarTableSlot slots[];
+};
+
+/**
+ * struct CDVarPathStep - Step of a path expression
+ * @op:                 step operator, either '.', '[' or '{'
+ * @index:              member or element index, unless a dictionary lookup
+ * @key:                dictionary key, dictionary lookups only
+ */
+struct CDVarPathStep {
+        char op;
+        uint32_t index;
+        CDVarKey key;
+};
+
+/**
+ * struct CDVarPath - Compiled path expression
+ * @type:               type the path was compiled against
+ * @depth:              number of levels the path enters
+ * @n_steps:            number of steps in @steps
+ * @steps:              steps of the path
+ */
+struct CDVarPath {
+        const CDVarType *type;
+        size_t depth;
+        size_t n_steps;
+        CDVarPathStep steps[];
+};
+
+enum {
+        C_DVAR_OP_FIXED,
+        C_DVAR_OP_MEMBER,
+        C_DVAR_OP_STRING,
+        C_DVAR_OP_ENTER_ARRAY,
+        C_DVAR_OP_LEAVE_ARRAY,
+        C_DVAR_OP_ENTER_STRUCT,
+        C_DVAR_OP_LEAVE_STRUCT,
+        C_DVAR_OP_VARIANT,
+};
+
+/**
+ * struct CDVarOp - Operation of a format program
+ * @code:               operation, C_DVAR_OP_*
+ * @alignment:          alignment to apply first, as power of 2
+ * @element:            element of the value, values only
+ * @n_pad:              number of padding bytes in front of a member
+ * @n_type:             number of type entries to advance by afterwards
+ * @n_ops:              number of member operations following a fixed run
+ * @offset:             size of a fixed run, offset of a member within its run,
+ *                      or offset of the format string of a variant
+ * @i_format:           position of the operation in the format string
+ *
+ * Programs consist of a flat array of operations. Consecutive fixed-size
+ * basic values are combined into a single C_DVAR_OP_FIXED run, followed by one
+ * C_DVAR_OP_MEMBER for each value. The offsets of all members within the run
+ * are resolved at compile-time, so a run is read or written with a single
+ * bounds check. Alignment is resolved at compile-time wherever the position
+ * relative to 8-byte alignment is known, in which case @alignment is 0.
+ * The content of variants is only known at runtime, so C_DVAR_OP_VARIANT runs
+ * its format string via the regular reader or writer.
+ */
+struct CDVarOp {
+        uint8_t code;
+        uint8_t alignment;
+        char element;
+        uint8_t n_pad;
+        uint16_t n_type;
+        uint16_t n_ops;
+        uint32_t offset;
+        uint32_t i_format;
+};
+
+/**
+ * struct CDVarProgram - Compiled format program
+ * @type:               type the program was compiled against
+ * @depth:              number of levels the program enters at most
+ * @format:             format string, followed by the format strings of all
+ *                      variants
+ * @n_ops:              number of operations in @ops
+ * @ops:                operations
+ */
+struct CDVarProgram {
+        const CDVarType *type;
+        size_t depth;
+        char *format;
+        size_t n_ops;
+        CDVarOp ops[];
+};
+
+extern const CDVarType *const c_dvar_type_builtins[256];
 
 bool c_dvar_is_string(const char *string, size_t n_string);
 bool c_dvar_is_signature(const char *string, size_t n_string);
 bool c_dvar_is_type(const char *string, size_t n_string);
 
 void c_dvar_rewind(CDVar *var);
+void c_dvar_reset(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types);
+void c_dvar_release_types(const CDVarLevel *level);
+
+CDVarLevel *c_dvar_partial_save(CDVar *var, CDVarLevel *saved);
+int c_dvar_partial_finish(CDVar *var, const CDVarLevel *saved, CDVarLevel *current, int r);
 int c_dvar_next_varg(CDVar *var, char c);
+int c_dvar_read_data(CDVar *var, int alignment, const char **const datap, size_t n_data);
+bool c_dvar_defer(CDVarDeferred **deferredp, char element, size_t offset, uint32_t n);
+int c_dvar_read_fixed(CDVar *var, const CDVarLayout *layout, const char **datap);
+int c_dvar_jump(CDVar *var, CDVarSpan *span);
+int c_dvar_read_entry(CDVar *var, const CDVarLayout *layout, CDVarKey *key, CDVarSpan *value);
+int c_dvar_jump_elements(CDVar *var, size_t n);
 void c_dvar_push(CDVar *var);
 void c_dvar_pop(CDVar *var);
 
-uint16_t c_dvar_bswap16(CDVar *var, uint16_t v);
-uint32_t c_dvar_bswap32(CDVar *var, uint32_t v);
-uint64_t c_dvar_bswap64(CDVar *var, uint64_t v);
+CDVarType *c_dvar_cache_find(CDVarCache *cache, const char *signature, size_t n_signature);
+CDVarType *c_dvar_cache_add(CDVarCache *cache, const CDVarType *type);
+void c_dvar_cache_unref(CDVarType *type);
+
+int c_dvar_program_verify(CDVar *var, const CDVarProgram *program);
+
+void c_dvar_layout_init(CDVarLayout *layout, const CDVarType *type, bool big_endian);
+int c_dvar_layout_verify(const CDVarLayout *layout, const void *data, size_t n_data, size_t *n_elementsp);
+void c_dvar_layout_copy(const CDVarLayout *layout, void *dst, const void *src, size_t n_data, bool swap);
+
+int c_dvar_validate_value(bool big_endian,
+                          bool trusted,
+                          const CDVarType *type,
+                          const uint8_t *data,
+                          size_t shift,
+                          size_t *posp,
+                          size_t end,
+                          size_t depth,
+                          CDVarDeferred **deferredp);
+
+const uint8_t *c_dvar_hash_seed(void);
+uint32_t c_dvar_signature_hash(const char *signature, size_t n_signature);
@@ -0,0 +1,302 @@
+/*
+ * Format Programs
+ *
+ * The format-string based readers and writers verify every format character
+ * against the type they operate on. If the same format string is used on the
+ * same type over and over, all this verification is repeated each time. This
+ * file implements format programs, which are format strings compiled against
+ * a type. All verification that only depends on the type is done once, at
+ * compile-time, and the format string is translated into a flat array of
+ * operations (see CDVarOp). Running a program interprets no format string and
+ * computes no alignment that is known upfront.
+ *
+ * Only the content of variants is not known at compile time. Variants are run
+ * via the regular reader and writer, so any format characters inside of them
+ * are still verified when the program runs.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+/*
+ * Compile-time position of the program relative to 8-byte alignment. Only the
+ * low @known bits of @phase are known, since strings, arrays and variants
+ * have a size only known at runtime.
+ */
+typedef struct CDVarPhase {
+        unsigned int known;
+        size_t phase;
+} CDVarPhase;
+
+/*
+ * Align @phase to @alignment. Returns true if the padding is known at
+ * compile-time, in which case it is returned in @n_padp.
+ */
+static bool c_dvar_phase_align(CDVarPhase *phase, unsigned int alignment, size_t *n_padp) {
+        size_t n_pad;
+
+        if (alignment > phase->known) {
+                phase->known = alignment;
+                phase->phase = 0;
+                return false;
+        }
+
+        n_pad = c_align_to(phase->phase, 1 << alignment) - phase->phase;
+        phase->phase = (phase->phase + n_pad) & 7;
+        if (n_padp)
+                *n_padp = n_pad;
+        return true;
+}
+
+static void c_dvar_phase_advance(CDVarPhase *phase, size_t n) {
+        phase->phase = (phase->phase + n) & 7;
+}
+
+/**
+ * c_dvar_program_new() - compile format program
+ * @programp:           output argument for newly allocated program
+ * @type:               type to compile against
+ * @format:             format string to compile
+ *
+ * This compiles the format string @format against the single complete type
+ * @type. The resulting program can be passed to c_dvar_program_vread() or
+ * c_dvar_program_vwrite() in place of @format, whenever the reader or writer
+ * is positioned at @type.
+ *
+ * Compiling verifies @format against @type, and resolves all alignment and
+ * container transitions that do not depend on the data. Consecutive
+ * fixed-size values are combined, so they are read and written with a single
+ * bounds check. Only the content of variants is handled at runtime.
+ *
+ * The program keeps a reference to @type, rather than a copy. The caller must
+ * make sure @type outlives the program, and must use the very same type array
+ * for the reader and writer.
+ *
+ * Return: 0 on success, -ENOTRECOVERABLE if @format does not match @type,
+ *         other negative error code on fatal failure.
+ */
+_c_public_ int c_dvar_program_new(CDVarProgram **programp, const CDVarType *type, const char *format) {
+        _c_cleanup_(c_dvar_program_freep) CDVarProgram *program = NULL;
+        CDVarPhase phase = {};
+        CDVar var = C_DVAR_INIT;
+        size_t i, n, n_pad, depth, i_variant = 0, n_variant = 0, n_strings;
+        CDVarOp *op, *run = NULL;
+        bool known;
+        char c;
+        int r;
+
+        n = strlen(format);
+
+        /*
+         * Every format character yields at most one operation, plus one run
+         * for each fixed-size value. Format strings of variants are copied
+         * behind @format, so they are at most as long as @format.
+         */
+        program = malloc(sizeof(*program) + 2 * (n + 1) * sizeof(*program->ops) + 2 * (n + 1));
+        if (!program)
+                return -ENOMEM;
+
+        program->type = type;
+        program->depth = 0;
+        program->n_ops = 0;
+        program->format = (char *)(program->ops + 2 * (n + 1));
+        memcpy(program->format, format, n + 1);
+        n_strings = n + 1;
+
+        /*
+         * Simulate a writer on @type, without producing any data. This runs
+         * the same verification as the format-string based writer does, and
+         * emits the operations to run instead.
+         */
+
+        var.current = var.levels;
+        var.current->parent_types = (CDVarType *)type;
+        var.current->n_parent_types = 1;
+        var.current->i_type = (CDVarType *)type;
+        var.current->n_type = type->length;
+
+        for (i = 0; i < n; ++i) {
+                c = format[i];
+
+                if (n_variant) {
+                        /*
+                         * The content of a variant is only known at runtime,
+                         * so everything up to the matching '>' is run via the
+                         * regular reader and writer, including the '>'
+                         * itself.
+                         */
+                        if (c == '<') {
+                                ++n_variant;
+                        } else if (c == '>' && !--n_variant) {
+                                op = program->ops + program->n_ops++;
+                                *op = (CDVarOp){
+                                        .code = C_DVAR_OP_VARIANT,
+                                        .offset = n_strings,
+                                        .i_format = i_variant,
+                                };
+
+                                memcpy(program->format + n_strings, format + i_variant, i - i_variant + 1);
+                                n_strings += i - i_variant + 1;
+                                program->format[n_strings++] = 0;
+                                phase = (CDVarPhase){};
+
+                                if (var.current->container != 'a') {
+                                        var.current->n_type -= var.current->i_type->length;
+                                        var.current->i_type += var.current->i_type->length;
+                                }
+                        }
+
+                        continue;
+                }
+
+                r = c_dvar_next_varg(&var, c);
+                if (r)
+                        return -ENOTRECOVERABLE;
+
+                if (c != '<' && var.current->i_type->size && var.current->i_type->basic) {
+                        /* extend the current run, if the padding is known */
+                        n_pad = 0;
+                        if (run && run->n_ops < UINT16_MAX &&
+                            var.current->i_type->alignment <= phase.known) {
+                                c_dvar_phase_align(&phase, var.current->i_type->alignment, &n_pad);
+                        } else {
+                                c_dvar_phase_align(&phase, var.current->i_type->alignment, NULL);
+                                run = program->ops + program->n_ops++;
+                                *run = (CDVarOp){
+                                        .code = C_DVAR_OP_FIXED,
+                                        .alignment = var.current->i_type->alignment,
+                                        .i_format = i,
+                                };
+                        }
+
+                        op = program->ops + program->n_ops++;
+                        *op = (CDVarOp){
+                                .code = C_DVAR_OP_MEMBER,
+                                .element = c,
+                                .n_pad = n_pad,
+                                .offset = run->offset + n_pad,
+                                .i_format = i,
+                        };
+
+                        c_dvar_phase_advance(&phase, var.current->i_type->size);
+                        run->offset += n_pad + var.current->i_type->size;
+                        ++run->n_ops;
+
+                        if (var.current->container != 'a') {
+                                ++run->n_type;
+                                var.current->n_type -= var.current->i_type->length;
+                                var.current->i_type += var.current->i_type->length;
+                        }
+
+                        continue;
+                }
+
+                run = NULL;
+                op = program->ops + program->n_ops++;
+                *op = (CDVarOp){ .element = c, .i_format = i };
+
+                switch (c) {
+                case '[':
+                case '(':
+                case '{':
+                case '<':
+                        depth = var.current - var.levels + 1;
+                        program->depth = c_max(program->depth, depth);
+
+                        if (c == '<') {
+                                --program->n_ops;
+                                i_variant = i;
+                                n_variant = 1;
+                                continue;
+                        }
+
+                        if (c == '[') {
+                                op->code = C_DVAR_OP_ENTER_ARRAY;
+
+                                /* the size of the array is aligned to 4 bytes */
+                                c_dvar_phase_align(&phase, 2, NULL);
+                                c_dvar_phase_advance(&phase, 4);
+
+                                known = c_dvar_phase_align(&phase, var.current->i_type[1].alignment, &n_pad);
+                                if (!known || n_pad)
+                                        op->alignment = var.current->i_type[1].alignment;
+                        } else {
+                                op->code = C_DVAR_OP_ENTER_STRUCT;
+
+                                known = c_dvar_phase_align(&phase, 3, &n_pad);
+                                if (!known || n_pad)
+                                        op->alignment = 3;
+                        }
+
+                        c_dvar_push(&var);
+                        if (c != '[')
+                                --var.current->n_type; /* truncate trailing bracket */
+                        continue; /* do not advance type iterator */
+
+                case ']':
+                case ')':
+                case '}':
+                        op->code = (c == ']') ? C_DVAR_OP_LEAVE_ARRAY : C_DVAR_OP_LEAVE_STRUCT;
+                        c_dvar_pop(&var);
+                        break;
+
+                case 's':
+                case 'o':
+                case 'g':
+                        op->code = C_DVAR_OP_STRING;
+                        phase = (CDVarPhase){};
+                        break;
+
+                default:
+                        return -ENOTRECOVERABLE;
+                }
+
+                if (var.current->container != 'a') {
+                        op->n_type = var.current->i_type->length;
+                        var.current->n_type -= var.current->i_type->length;
+                        var.current->i_type += var.current->i_type->length;
+                }
+        }
+
+        /* variants must be closed by the program that opened them */
+        if (n_variant)
+                return -ENOTRECOVERABLE;
+
+        *programp = program;
+        program = NULL;
+        return 0;
+}
+
+/**
+ * c_dvar_program_free() - free format program
+ * @program:            program to free, or NULL
+ *
+ * This deallocates @program. If @program is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CDVarProgram *c_dvar_program_free(CDVarProgram *program) {
+        free(program);
+        return NULL;
+}
+
+/*
+ * Verify that @program can be run on @var at its current position. The type
+ * iterator must point at the type the program was compiled against, and the
+ * containers opened by the program must not exceed the maximum depth.
+ */
+int c_dvar_program_verify(CDVar *var, const CDVarProgram *program) {
+        if (_c_unlikely_(!var->current->n_type || var->current->i_type != program->type))
+                return -ENOTRECOVERABLE;
+        if (_c_unlikely_(var->current - var->levels + program->depth >= C_DVAR_TYPE_DEPTH_MAX))
+                return C_DVAR_E_DEPTH_OVERFLOW;
+
+        return 0;
+}
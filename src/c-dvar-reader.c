@@ -13,11 +13,95 @@
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include "c-dvar.h"
 #include "c-dvar-private.h"
 
+/*
+ * Return a pointer to the byte at @offset of a segmented buffer, and the
+ * number of bytes following it in the same segment. The segment of the last
+ * access is cached, so sequential access is amortized constant-time.
+ */
+static const char *c_dvar_vecs_at(CDVar *var, size_t offset, size_t *n_contiguousp) {
+        if (offset < var->o_vec) {
+                var->i_vec = 0;
+                var->o_vec = 0;
+        }
+
+        while (var->i_vec + 1 < var->n_vecs &&
+               offset >= var->o_vec + var->vecs[var->i_vec].iov_len) {
+                var->o_vec += var->vecs[var->i_vec].iov_len;
+                ++var->i_vec;
+        }
+
+        *n_contiguousp = var->o_vec + var->vecs[var->i_vec].iov_len - offset;
+        return (const char *)var->vecs[var->i_vec].iov_base + offset - var->o_vec;
+}
+
+/*
+ * Return a pointer to @n_data contiguous bytes at @offset of a segmented
+ * buffer. If the data spans segments, it is copied into a bounce buffer, which
+ * stays valid until the reader is reset. Bounce buffers retain the offset of
+ * the data relative to 8-byte alignment.
+ */
+static int c_dvar_vecs_get(CDVar *var, size_t offset, size_t n_data, const char **datap) {
+        CDVarBounce *bounce;
+        const char *p;
+        size_t i, n;
+
+        p = c_dvar_vecs_at(var, offset, &n);
+
+        if (_c_unlikely_(n < n_data)) {
+                bounce = malloc(sizeof(*bounce) + offset % 8 + n_data);
+                if (!bounce)
+                        return -ENOMEM;
+
+                for (i = 0; i < n_data; i += n) {
+                        p = c_dvar_vecs_at(var, offset + i, &n);
+                        n = c_min(n, n_data - i);
+                        memcpy(bounce->data + offset % 8 + i, p, n);
+                }
+
+                bounce->next = var->bounces;
+                var->bounces = bounce;
+                p = bounce->data + offset % 8;
+        }
+
+        *datap = p;
+        return 0;
+}
+
+/*
+ * This is the slow-path of c_dvar_read_data() for segmented buffers. Bounds
+ * must have been checked by the caller. Segments are 8-byte aligned, hence
+ * alignment bytes never span segments. If the data itself spans segments, it
+ * is copied into a bounce buffer.
+ */
+static int c_dvar_read_vecs(CDVar *var, size_t align, const char **const datap, size_t n_data) {
+        const char *p;
+        size_t i, n;
+        int r;
+
+        p = c_dvar_vecs_at(var, var->current->i_buffer, &n);
+
+        for (i = 0; i < align; ++i)
+                if (_c_unlikely_(p[i]))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+        if (datap) {
+                r = c_dvar_vecs_get(var, var->current->i_buffer + align, n_data, datap);
+                if (r)
+                        return r;
+        }
+
+        var->current->i_buffer += align + n_data;
+        var->current->n_buffer -= align + n_data;
+        return 0;
+}
+
 /*
  * c_dvar_read_data() - Acquire aligned pointer into the buffer
  * @var:                object to operate on
@@ -34,24 +118,31 @@
  *       not an issue. But any further type-casts must be aliasing-safe.
  *
  * Return: 0 on success, C_DVAR_E_OUT_OF_BOUNDS if the buffer is too short,
+ *         C_DVAR_E_INCOMPLETE_DATA if the data is not available yet,
  *         C_DVAR_E_CORRUPT_DATA if alignment bytes are not zeroed, negative
  *         error code on failure.
  */
-static int c_dvar_read_data(CDVar *var, int alignment, const char **const datap, size_t n_data) {
+int c_dvar_read_data(CDVar *var, int alignment, const char **const datap, size_t n_data) {
         size_t i, align;
 
-        align = c_align_to(var->current->i_buffer, 1 << alignment) - var->current->i_buffer;
+        align = c_align_to(var->current->i_buffer + var->shift, 1 << alignment) - var->current->i_buffer - var->shift;
 
         if (_c_unlikely_(var->current->n_buffer < align + n_data))
                 return C_DVAR_E_OUT_OF_BOUNDS;
+        if (_c_unlikely_(var->partial && var->n_available - var->current->i_buffer < align + n_data))
+                return C_DVAR_E_INCOMPLETE_DATA;
+
+        if (_c_unlikely_(var->vecs))
+                return c_dvar_read_vecs(var, align, datap, n_data);
 
         /*
          * Verify alignment bytes are 0. Needed for compatibility with
-         * dbus-daemon.
+         * dbus-daemon. Trusted data was verified upfront.
          */
-        for (i = 0; i < align; ++i)
-                if (_c_unlikely_(var->data[var->current->i_buffer + i]))
-                        return C_DVAR_E_CORRUPT_DATA;
+        if (!var->trusted)
+                for (i = 0; i < align; ++i)
+                        if (_c_unlikely_(var->data[var->current->i_buffer + i]))
+                                return C_DVAR_E_CORRUPT_DATA;
 
         if (datap)
                 *datap = (const char *)(var->data + var->current->i_buffer + align);
@@ -61,24 +152,122 @@ static int c_dvar_read_data(CDVar *var, int alignment, const char **const datap,
         return 0;
 }
 
-static int c_dvar_read_u8(CDVar *var, uint8_t *datap) {
+/*
+ * The bounds of fixed-size tuples are checked as a whole when the tuple is
+ * entered, see c_dvar_enter_fixed(). Their members are then read via
+ * c_dvar_read_bounded(), which only verifies the padding in front of each
+ * member, and skips the bounds checks and segment handling of
+ * c_dvar_read_data(). Readers on segments never take this path, since a tuple
+ * might span segments.
+ */
+static bool c_dvar_is_bounded(CDVar *var) {
+        return var->current > var->levels &&
+               (var->current->container == '(' || var->current->container == '{') &&
+               (var->current - 1)->i_type->size &&
+               !var->vecs;
+}
+
+static int c_dvar_enter_fixed(CDVar *var, const CDVarType *type) {
+        if (_c_unlikely_(var->current->n_buffer < type->size))
+                return C_DVAR_E_OUT_OF_BOUNDS;
+        if (_c_unlikely_(var->partial && var->n_available - var->current->i_buffer < type->size))
+                return C_DVAR_E_INCOMPLETE_DATA;
+
+        return 0;
+}
+
+static inline _c_always_inline_ int c_dvar_read_bounded(CDVar *var, int alignment, const char **datap, size_t n_data) {
+        size_t i, align;
+
+        align = c_align_to(var->current->i_buffer + var->shift, 1 << alignment) - var->current->i_buffer - var->shift;
+
+        if (!var->trusted)
+                for (i = 0; i < align; ++i)
+                        if (_c_unlikely_(var->data[var->current->i_buffer + i]))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+        *datap = (const char *)(var->data + var->current->i_buffer + align);
+
+        var->current->i_buffer += align + n_data;
+        var->current->n_buffer -= align + n_data;
+        return 0;
+}
+
+/*
+ * Record a string at @offset into the data buffer for verification by
+ * c_dvar_end_read(). Returns false if the string cannot be recorded, in which
+ * case the caller has to verify it right away.
+ */
+bool c_dvar_defer(CDVarDeferred **deferredp, char element, size_t offset, uint32_t n) {
+        CDVarDeferred *deferred = *deferredp;
+        size_t n_allocated;
+
+        if (_c_unlikely_(!deferred || deferred->n_strings >= deferred->n_allocated)) {
+                n_allocated = deferred ? deferred->n_allocated * 2 : 64;
+                deferred = realloc(deferred, sizeof(*deferred) + n_allocated * sizeof(*deferred->strings));
+                if (!deferred)
+                        return false;
+
+                if (!*deferredp)
+                        deferred->n_strings = 0;
+                deferred->n_allocated = n_allocated;
+                *deferredp = deferred;
+        }
+
+        deferred->strings[deferred->n_strings].offset = offset;
+        deferred->strings[deferred->n_strings].n = n;
+        deferred->strings[deferred->n_strings].element = element;
+        ++deferred->n_strings;
+        return true;
+}
+
+/*
+ * Verify the content of a string, object path, or signature. Lazy readers
+ * defer the verification of strings the caller skips. Strings in bounce
+ * buffers of segmented readers do not outlive the reader position, so they
+ * are always verified right away.
+ */
+static inline _c_always_inline_ bool c_dvar_verify_string(CDVar *var, char element, const char *str, uint32_t n, bool skipped) {
+        if (skipped && var->lazy && !var->vecs &&
+            c_dvar_defer(&var->deferred, element, str - (const char *)var->data, n))
+                return true;
+
+        switch (element) {
+        case 's':
+                return c_dvar_is_string(str, n);
+        case 'o':
+                return c_dvar_is_path(str, n);
+        case 'g':
+                return c_dvar_is_signature(str, n);
+        default:
+                return false;
+        }
+}
+
+static inline _c_always_inline_ int c_dvar_read_u8(CDVar *var, bool bounded, uint8_t *datap) {
         const char *p;
         int r;
 
-        r = c_dvar_read_data(var, 0, &p, sizeof(*datap));
+        if (bounded)
+                r = c_dvar_read_bounded(var, 0, &p, sizeof(*datap));
+        else
+                r = c_dvar_read_data(var, 0, &p, sizeof(*datap));
         if (_c_likely_(!r))
                 *datap = c_load_8(p, 0);
 
         return r;
 }
 
-static int c_dvar_read_u16(CDVar *var, uint16_t *datap) {
+static inline _c_always_inline_ int c_dvar_read_u16(CDVar *var, bool big_endian, bool bounded, uint16_t *datap) {
         const char *p;
         int r;
 
-        r = c_dvar_read_data(var, 1, &p, sizeof(*datap));
+        if (bounded)
+                r = c_dvar_read_bounded(var, 1, &p, sizeof(*datap));
+        else
+                r = c_dvar_read_data(var, 1, &p, sizeof(*datap));
         if (_c_likely_(!r)) {
-                if (var->big_endian)
+                if (big_endian)
                         *datap = c_load_16be_aligned(p, 0);
                 else
                         *datap = c_load_16le_aligned(p, 0);
@@ -87,13 +276,16 @@ static int c_dvar_read_u16(CDVar *var, uint16_t *datap) {
         return r;
 }
 
-static int c_dvar_read_u32(CDVar *var, uint32_t *datap) {
+static inline _c_always_inline_ int c_dvar_read_u32(CDVar *var, bool big_endian, bool bounded, uint32_t *datap) {
         const char *p;
         int r;
 
-        r = c_dvar_read_data(var, 2, &p, sizeof(*datap));
+        if (bounded)
+                r = c_dvar_read_bounded(var, 2, &p, sizeof(*datap));
+        else
+                r = c_dvar_read_data(var, 2, &p, sizeof(*datap));
         if (_c_likely_(!r)) {
-                if (var->big_endian)
+                if (big_endian)
                         *datap = c_load_32be_aligned(p, 0);
                 else
                         *datap = c_load_32le_aligned(p, 0);
@@ -102,13 +294,16 @@ static int c_dvar_read_u32(CDVar *var, uint32_t *datap) {
         return r;
 }
 
-static int c_dvar_read_u64(CDVar *var, uint64_t *datap) {
+static inline _c_always_inline_ int c_dvar_read_u64(CDVar *var, bool big_endian, bool bounded, uint64_t *datap) {
         const char *p;
         int r;
 
-        r = c_dvar_read_data(var, 3, &p, sizeof(*datap));
+        if (bounded)
+                r = c_dvar_read_bounded(var, 3, &p, sizeof(*datap));
+        else
+                r = c_dvar_read_data(var, 3, &p, sizeof(*datap));
         if (_c_likely_(!r)) {
-                if (var->big_endian)
+                if (big_endian)
                         *datap = c_load_64be_aligned(p, 0);
                 else
                         *datap = c_load_64le_aligned(p, 0);
@@ -117,7 +312,7 @@ static int c_dvar_read_u64(CDVar *var, uint64_t *datap) {
         return r;
 }
 
-static int c_dvar_dummy_vread(CDVar *var, const char *format, va_list args) {
+static int c_dvar_dummy_vread(CDVar *var, const char *format, va_list *args) {
         void *p;
         char c;
 
@@ -134,25 +329,25 @@ static int c_dvar_dummy_vread(CDVar *var, const char *format, va_list args) {
                         break;
 
                 case '<':
-                        p = va_arg(args, const char **);
+                        p = va_arg(*args, const char **);
                         /* unused *input* argument */
                         break;
 
                 case 'y':
-                        p = va_arg(args, uint8_t *);
+                        p = va_arg(*args, uint8_t *);
                         if (p)
                                 *(uint8_t *)p = 0;
                         break;
 
                 case 'b':
-                        p = va_arg(args, bool *);
+                        p = va_arg(*args, bool *);
                         if (p)
                                 *(bool *)p = false;
                         break;
 
                 case 'n':
                 case 'q':
-                        p = va_arg(args, uint16_t *);
+                        p = va_arg(*args, uint16_t *);
                         if (p)
                                 *(uint16_t *)p = 0;
                         break;
@@ -160,33 +355,33 @@ static int c_dvar_dummy_vread(CDVar *var, const char *format, va_list args) {
                 case 'i':
                 case 'h':
                 case 'u':
-                        p = va_arg(args, uint32_t *);
+                        p = va_arg(*args, uint32_t *);
                         if (p)
                                 *(uint32_t *)p = 0;
                         break;
 
                 case 'x':
                 case 't':
-                        p = va_arg(args, uint64_t *);
+                        p = va_arg(*args, uint64_t *);
                         if (p)
                                 *(uint64_t *)p = 0;
                         break;
 
                 case 'd':
-                        p = va_arg(args, double *);
+                        p = va_arg(*args, double *);
                         if (p)
                                 *(double *)p = 0;
                         break;
 
                 case 's':
                 case 'g':
-                        p = va_arg(args, const char **);
+                        p = va_arg(*args, const char **);
                         if (p)
                                 *(const char **)p = "";
                         break;
 
                 case 'o':
-                        p = va_arg(args, const char **);
+                        p = va_arg(*args, const char **);
                         if (p)
                                 *(const char **)p = "/";
                         break;
@@ -206,8 +401,17 @@ static int c_dvar_dummy_vread(CDVar *var, const char *format, va_list args) {
         return -ENOTRECOVERABLE;
 }
 
-static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
-        CDVarType *type;
+/*
+ * The reader is instantiated once for each byte order. @big_endian is a
+ * constant in each instance, so scalar loads compile to plain loads or byte
+ * swaps, without testing the byte order of every single value.
+ */
+static inline _c_always_inline_ int c_dvar_try_vread_endian(CDVar *var,
+                                                            bool big_endian,
+                                                            const char *format,
+                                                            va_list *args) {
+        bool bounded = c_dvar_is_bounded(var);
+        CDVarType *type, *cached;
         const char *str;
         uint64_t u64;
         uint32_t u32;
@@ -226,7 +430,7 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                 switch (c) {
                 case '[':
                         /* read array size */
-                        r = c_dvar_read_u32(var, &u32);
+                        r = c_dvar_read_u32(var, big_endian, false, &u32);
                         if (r)
                                 goto error;
 
@@ -243,32 +447,40 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
 
                         c_dvar_push(var);
                         var->current->n_buffer = u32;
+                        bounded = false;
                         continue; /* do not advance type iterator */
 
                 case '<':
-                        r = c_dvar_read_u8(var, &u8);
+                        r = c_dvar_read_u8(var, false, &u8);
                         if (r)
                                 goto error;
 
                         n = u8;
-                        r = c_dvar_read_data(var, 0, &str, n);
+                        r = c_dvar_read_data(var, 0, &str, n + 1);
                         if (r)
                                 goto error;
 
-                        r = c_dvar_read_u8(var, &u8);
-                        if (r)
-                                goto error;
-
-                        if (u8 || !c_dvar_is_type(str, n)) {
+                        if (!var->trusted && str[n]) {
                                 r = C_DVAR_E_CORRUPT_DATA;
                                 goto error;
                         }
 
-                        type = p = (CDVarType *)va_arg(args, const CDVarType *);
-                        if (!type) {
+                        cached = NULL;
+                        type = p = (CDVarType *)va_arg(*args, const CDVarType *);
+                        if (!type && var->cache && (cached = c_dvar_cache_find(var->cache, str, n))) {
+                                /* cached types are valid, the reader holds a reference */
+                                type = cached;
+                                r = 0;
+                        } else if (!var->trusted && !c_dvar_is_type(str, n)) {
+                                r = C_DVAR_E_CORRUPT_DATA;
+                        } else if (!type) {
                                 r = c_dvar_type_new_from_signature(&type, str, n);
-                                if (r > 0 || (!r && type->length != n))
+                                if (r > 0 || (!r && type->length != n)) {
                                         r = C_DVAR_E_CORRUPT_DATA;
+                                } else if (!r && var->cache && (cached = c_dvar_cache_add(var->cache, type))) {
+                                        c_dvar_type_free(type);
+                                        type = cached;
+                                }
                         } else if (type->length != n) {
                                 r = C_DVAR_E_TYPE_MISMATCH;
                         } else {
@@ -301,6 +513,9 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                         var->current->i_type = type;
                         var->current->n_type = type->length;
                         var->current->allocated_parent_types = (type != p);
+                        var->current->parsed_parent_types = (type != p);
+                        var->current->cached_parent_types = (type == cached);
+                        bounded = false;
                         continue; /* do not advance type iterator */
 
                 case '(':
@@ -310,6 +525,15 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                         if (r)
                                 goto error;
 
+                        /* check bounds of fixed-size tuples as a whole */
+                        if (!bounded && var->current->i_type->size && !var->vecs) {
+                                r = c_dvar_enter_fixed(var, var->current->i_type);
+                                if (r)
+                                        goto error;
+
+                                bounded = true;
+                        }
+
                         c_dvar_push(var);
                         --var->current->n_type; /* truncate trailing bracket */
                         continue; /* do not advance type iterator */
@@ -322,35 +546,37 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                         }
 
                         c_dvar_pop(var);
+                        bounded = c_dvar_is_bounded(var);
                         break;
 
                 case '>':
                 case ')':
                 case '}':
                         c_dvar_pop(var);
+                        bounded = c_dvar_is_bounded(var);
                         break;
 
                 case 'y':
-                        r = c_dvar_read_u8(var, &u8);
+                        r = c_dvar_read_u8(var, bounded, &u8);
                         if (r)
                                 goto error;
 
-                        p = va_arg(args, uint8_t *);
+                        p = va_arg(*args, uint8_t *);
                         if (p)
                                 *(uint8_t *)p = u8;
 
                         break;
 
                 case 'b':
-                        r = c_dvar_read_u32(var, &u32);
+                        r = c_dvar_read_u32(var, big_endian, bounded, &u32);
                         if (r)
                                 goto error;
-                        if (u32 != 0 && u32 != 1) {
+                        if (!var->trusted && u32 != 0 && u32 != 1) {
                                 r = C_DVAR_E_CORRUPT_DATA;
                                 goto error;
                         }
 
-                        p = va_arg(args, bool *);
+                        p = va_arg(*args, bool *);
                         if (p)
                                 *(bool *)p = u32;
 
@@ -358,11 +584,11 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
 
                 case 'n':
                 case 'q':
-                        r = c_dvar_read_u16(var, &u16);
+                        r = c_dvar_read_u16(var, big_endian, bounded, &u16);
                         if (r)
                                 goto error;
 
-                        p = va_arg(args, uint16_t *);
+                        p = va_arg(*args, uint16_t *);
                         if (p)
                                 *(uint16_t *)p = u16;
 
@@ -371,11 +597,11 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                 case 'i':
                 case 'h':
                 case 'u':
-                        r = c_dvar_read_u32(var, &u32);
+                        r = c_dvar_read_u32(var, big_endian, bounded, &u32);
                         if (r)
                                 goto error;
 
-                        p = va_arg(args, uint32_t *);
+                        p = va_arg(*args, uint32_t *);
                         if (p)
                                 *(uint32_t *)p = u32;
 
@@ -384,11 +610,11 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                 case 'x':
                 case 't':
                 case 'd':
-                        r = c_dvar_read_u64(var, &u64);
+                        r = c_dvar_read_u64(var, big_endian, bounded, &u64);
                         if (r)
                                 goto error;
 
-                        p = va_arg(args, uint64_t *);
+                        p = va_arg(*args, uint64_t *);
                         if (p)
                                 *(uint64_t *)p = u64;
 
@@ -398,34 +624,30 @@ static int c_dvar_try_vread(CDVar *var, const char *format, va_list args) {
                 case 'o':
                 case 'g':
                         if (c == 'g') {
-                                r = c_dvar_read_u8(var, &u8);
+                                r = c_dvar_read_u8(var, false, &u8);
                                 if (r)
                                         goto error;
 
                                 u32 = u8;
                         } else {
-                                r = c_dvar_read_u32(var, &u32);
+                                r = c_dvar_read_u32(var, big_endian, false, &u32);
                                 if (r)
                                         goto error;
                         }
 
-                        r = c_dvar_read_data(var, 0, &str, u32);
+                        r = c_dvar_read_data(var, 0, &str, (size_t)u32 + 1);
                         if (r)
                                 goto error;
 
-                        r = c_dvar_read_u8(var, &u8);
-                        if (r)
-                                goto error;
+                        p = va_arg(*args, const char **);
 
-                        if (u8 ||
-                            (c == 's' && !c_dvar_is_string(str, u32)) ||
-                            (c == 'o' && !c_dvar_is_path(str, u32)) ||
-                            (c == 'g' && !c_dvar_is_signature(str, u32))) {
+                        if (!var->trusted &&
+                            (str[u32] || !c_dvar_verify_string(var, c, str, u32, !p))) {
+                                ++format;
                                 r = C_DVAR_E_CORRUPT_DATA;
                                 goto error;
                         }
 
-                        p = va_arg(args, const char **);
                         if (p)
                                 *(const char **)p = str;
 
@@ -456,8 +678,264 @@ error:
         return r;
 }
 
-static int c_dvar_ff(CDVar *var) {
-        size_t t, depth = 0;
+static int c_dvar_try_vread_le(CDVar *var, const char *format, va_list *args) {
+        return c_dvar_try_vread_endian(var, false, format, args);
+}
+
+static int c_dvar_try_vread_be(CDVar *var, const char *format, va_list *args) {
+        return c_dvar_try_vread_endian(var, true, format, args);
+}
+
+static int c_dvar_try_vread(CDVar *var, const char *format, va_list *args) {
+        if (var->big_endian)
+                return c_dvar_try_vread_be(var, format, args);
+        else
+                return c_dvar_try_vread_le(var, format, args);
+}
+
+static inline _c_always_inline_ void c_dvar_run_advance(CDVar *var, size_t n_type) {
+        if (var->current->container != 'a') {
+                var->current->n_type -= n_type;
+                var->current->i_type += n_type;
+        }
+}
+
+/*
+ * Runs the operations of a compiled format program. All type verification was
+ * done at compile-time, so this only verifies the data. Like the interpreter
+ * above, it is instantiated once for each byte order.
+ */
+static inline _c_always_inline_ int c_dvar_try_run_endian(CDVar *var,
+                                                          bool big_endian,
+                                                          const CDVarProgram *program,
+                                                          va_list *args) {
+        const CDVarOp *op, *member, *end;
+        const char *data, *str;
+        size_t i, n;
+        uint32_t u32;
+        uint8_t u8;
+        void *p;
+        int r;
+
+        end = program->ops + program->n_ops;
+        for (op = program->ops; op < end; ++op) {
+                switch (op->code) {
+                case C_DVAR_OP_FIXED:
+                        /* a single bounds check covers the entire run */
+                        r = c_dvar_read_data(var, op->alignment, &data, op->offset);
+                        if (r)
+                                goto error;
+
+                        /* verify the data before any output is stored */
+                        if (!var->trusted) {
+                                for (member = op + 1; member <= op + op->n_ops; ++member) {
+                                        for (i = member->offset - member->n_pad; i < member->offset; ++i) {
+                                                if (data[i]) {
+                                                        r = C_DVAR_E_CORRUPT_DATA;
+                                                        goto error;
+                                                }
+                                        }
+
+                                        if (member->element == 'b') {
+                                                u32 = big_endian ? c_load_32be_aligned(data, member->offset)
+                                                                 : c_load_32le_aligned(data, member->offset);
+                                                if (u32 != 0 && u32 != 1) {
+                                                        r = C_DVAR_E_CORRUPT_DATA;
+                                                        goto error;
+                                                }
+                                        }
+                                }
+                        }
+
+                        for (member = op + 1; member <= op + op->n_ops; ++member) {
+                                switch (member->element) {
+                                case 'y':
+                                        p = va_arg(*args, uint8_t *);
+                                        if (p)
+                                                *(uint8_t *)p = c_load_8(data, member->offset);
+                                        break;
+                                case 'b':
+                                        p = va_arg(*args, bool *);
+                                        if (p)
+                                                *(bool *)p = big_endian ? c_load_32be_aligned(data, member->offset)
+                                                                        : c_load_32le_aligned(data, member->offset);
+                                        break;
+                                case 'n':
+                                case 'q':
+                                        p = va_arg(*args, uint16_t *);
+                                        if (p)
+                                                *(uint16_t *)p = big_endian ? c_load_16be_aligned(data, member->offset)
+                                                                            : c_load_16le_aligned(data, member->offset);
+                                        break;
+                                case 'i':
+                                case 'h':
+                                case 'u':
+                                        p = va_arg(*args, uint32_t *);
+                                        if (p)
+                                                *(uint32_t *)p = big_endian ? c_load_32be_aligned(data, member->offset)
+                                                                            : c_load_32le_aligned(data, member->offset);
+                                        break;
+                                default:
+                                        p = va_arg(*args, uint64_t *);
+                                        if (p)
+                                                *(uint64_t *)p = big_endian ? c_load_64be_aligned(data, member->offset)
+                                                                            : c_load_64le_aligned(data, member->offset);
+                                        break;
+                                }
+                        }
+
+                        c_dvar_run_advance(var, op->n_type);
+                        op += op->n_ops;
+                        break;
+
+                case C_DVAR_OP_STRING:
+                        if (op->element == 'g') {
+                                r = c_dvar_read_u8(var, false, &u8);
+                                if (r)
+                                        goto error;
+
+                                u32 = u8;
+                        } else {
+                                r = c_dvar_read_u32(var, big_endian, false, &u32);
+                                if (r)
+                                        goto error;
+                        }
+
+                        r = c_dvar_read_data(var, 0, &str, (size_t)u32 + 1);
+                        if (r)
+                                goto error;
+
+                        p = va_arg(*args, const char **);
+
+                        if (!var->trusted &&
+                            (str[u32] || !c_dvar_verify_string(var, op->element, str, u32, !p))) {
+                                c_dvar_dummy_vread(var, program->format + op->i_format + 1, args);
+                                return C_DVAR_E_CORRUPT_DATA;
+                        }
+
+                        if (p)
+                                *(const char **)p = str;
+
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_ENTER_ARRAY:
+                        r = c_dvar_read_u32(var, big_endian, false, &u32);
+                        if (r)
+                                goto error;
+
+                        if (op->alignment) {
+                                r = c_dvar_read_data(var, op->alignment, NULL, 0);
+                                if (r)
+                                        goto error;
+                        }
+
+                        /* check space (alignment and size are not counted) */
+                        if (u32 > var->current->n_buffer) {
+                                r = C_DVAR_E_OUT_OF_BOUNDS;
+                                goto error;
+                        }
+
+                        c_dvar_push(var);
+                        var->current->n_buffer = u32;
+                        break;
+
+                case C_DVAR_OP_LEAVE_ARRAY:
+                        /* trailing padding is not allowed */
+                        if (var->current->n_buffer) {
+                                r = C_DVAR_E_CORRUPT_DATA;
+                                goto error;
+                        }
+
+                        c_dvar_pop(var);
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_ENTER_STRUCT:
+                        if (op->alignment) {
+                                r = c_dvar_read_data(var, op->alignment, NULL, 0);
+                                if (r)
+                                        goto error;
+                        }
+
+                        c_dvar_push(var);
+                        --var->current->n_type; /* truncate trailing bracket */
+                        break;
+
+                case C_DVAR_OP_LEAVE_STRUCT:
+                        c_dvar_pop(var);
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_VARIANT:
+                        str = program->format + op->offset;
+                        r = c_dvar_try_vread(var, str, args);
+                        if (r) {
+                                /* the interpreter consumed all arguments of the variant */
+                                n = strlen(str);
+                                c_dvar_dummy_vread(var, program->format + op->i_format + n, args);
+                                return r;
+                        }
+
+                        break;
+
+                default:
+                        r = -ENOTRECOVERABLE;
+                        goto error;
+                }
+        }
+
+        return 0;
+
+error:
+        c_dvar_dummy_vread(var, program->format + op->i_format, args);
+        return r;
+}
+
+static int c_dvar_try_run_le(CDVar *var, const CDVarProgram *program, va_list *args) {
+        return c_dvar_try_run_endian(var, false, program, args);
+}
+
+static int c_dvar_try_run_be(CDVar *var, const CDVarProgram *program, va_list *args) {
+        return c_dvar_try_run_endian(var, true, program, args);
+}
+
+static int c_dvar_try_run(CDVar *var, const CDVarProgram *program, va_list *args) {
+        if (var->big_endian)
+                return c_dvar_try_run_be(var, program, args);
+        else
+                return c_dvar_try_run_le(var, program, args);
+}
+
+/*
+ * Jump over all remaining elements of the current array, which must have
+ * elements of fixed size. This runs in constant time, unless the elements
+ * need validation. If the remaining size is not a multiple of the element
+ * size, the remainder is left for the closing bracket to reject.
+ */
+static int c_dvar_jump_rest(CDVar *var) {
+        const CDVarType *type = var->current->i_type;
+        size_t n = 0, align, stride;
+
+        align = c_align_to(var->current->i_buffer + var->shift, 1 << type->alignment) -
+                var->current->i_buffer - var->shift;
+        stride = c_align_to(type->size, 1 << type->alignment);
+
+        if (var->current->n_buffer >= align + type->size)
+                n = (var->current->n_buffer - align - type->size) / stride + 1;
+
+        return c_dvar_jump_elements(var, n);
+}
+
+/*
+ * Walk over the next complete value, reading it piece by piece. Arrays of
+ * fixed-size elements are not entered, but jumped over as a whole via
+ * c_dvar_jump_elements(). Everything else is read via c_dvar_read(), so it is
+ * validated exactly like reading it would, including deferring strings on lazy
+ * readers.
+ */
+static int c_dvar_walk(CDVar *var) {
+        size_t depth = 0;
         char c;
         int r;
 
@@ -490,6 +968,20 @@ static int c_dvar_ff(CDVar *var) {
                         return -ENOTRECOVERABLE;
                 }
 
+                /*
+                 * If we are skipping an entire array with fixed-size
+                 * elements, we can jump over all elements in one go. Elements
+                 * that need validation (i.e., with padding or booleans) are
+                 * verified via their layout, rather than one by one.
+                 */
+                if (depth > 0 && var->current->container == 'a' && c != ']' && var->current->i_type->size) {
+                        r = c_dvar_jump_rest(var);
+                        if (r)
+                                return r;
+
+                        c = ']';
+                }
+
                 switch (c) {
                 case 'a':
                         ++depth;
@@ -515,32 +1007,6 @@ static int c_dvar_ff(CDVar *var) {
                         assert(depth > 0);
                         --depth;
                         break;
-                case 'y':
-                case 'n':
-                case 'q':
-                case 'i':
-                case 'h':
-                case 'u':
-                case 'x':
-                case 't':
-                case 'd':
-                        /*
-                         * If we are skipping an entire array with a fixed size
-                         * member, we can jump over all members in one go. Note
-                         * that this only works if the member does not need any
-                         * validation (this excludes 'b' and any non-basic
-                         * type), because callers rely on this function to
-                         * check for content validity.
-                         */
-                        if (depth > 0 && var->current->container == 'a') {
-                                t = var->current->n_buffer % var->current->i_type->size;
-                                var->current->i_buffer += var->current->n_buffer - t;
-                                var->current->n_buffer = t;
-
-                                c = ']';
-                                --depth;
-                        }
-                        break;
                 }
 
                 r = c_dvar_read(var, (char [2]){ c, 0 }, NULL);
@@ -551,137 +1017,1833 @@ static int c_dvar_ff(CDVar *var) {
         return 0;
 }
 
-static int c_dvar_try_vskip(CDVar *var, const char *format, va_list args) {
-        void *p;
-        char c;
-        int r;
+/*
+ * Skip the next complete value. On a single contiguous buffer, the value is
+ * jumped over via c_dvar_jump(), which validates it in a single pass without
+ * entering it, and defers skipped strings on lazy readers. Readers on segments
+ * or partial data walk the value instead.
+ */
+static int c_dvar_ff(CDVar *var) {
+        if (_c_likely_(!var->vecs && !var->partial))
+                return c_dvar_jump(var, NULL);
 
-        /*
-         * This simply iterates over the format-string @format, but passes NULL
-         * to the reader so its value is skipped (but still validated).
+        return c_dvar_walk(var);
+}
+
+/*
+ * Jump over the next complete value. This validates the value exactly like
+ * c_dvar_ff() does, but never enters it. Values of fixed size are verified
+ * via their layout, all others are handed to the validator as a whole. Only
+ * readers on segments or partial data fall back to c_dvar_walk() for values of
+ * dynamic size. If @span is non-NULL, it is set to the value. Lazy readers
+ * defer the strings of values jumped over, but not of spans, since those are
+ * handed to the caller.
+ */
+int c_dvar_jump(CDVar *var, CDVarSpan *span) {
+        const CDVarType *type = var->current->i_type;
+        CDVarLayout layout;
+        size_t start, pos;
+        const char *data;
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type ||
+                         (var->current->container == 'a' && !var->current->n_buffer)))
+                return -ENOTRECOVERABLE;
+
+        if (type->size) {
+                if (type->basic && type->element != 'b') {
+                        r = c_dvar_read_data(var, type->alignment, &data, type->size);
+                        if (r)
+                                return r;
+
+                        if (var->current->container != 'a') {
+                                var->current->n_type -= type->length;
+                                var->current->i_type += type->length;
+                        }
+                } else {
+                        c_dvar_layout_init(&layout, type, var->big_endian);
+                        r = c_dvar_read_fixed(var, &layout, &data);
+                        if (r)
+                                return r;
+                }
+
+                start = var->current->i_buffer - type->size;
+        } else {
+                start = c_align_to(var->current->i_buffer + var->shift, 1 << type->alignment) - var->shift;
+
+                if (var->vecs || var->partial) {
+                        r = c_dvar_walk(var);
+                        if (r)
+                                return r;
+                } else {
+                        pos = var->current->i_buffer;
+                        r = c_dvar_validate_value(var->big_endian,
+                                                  var->trusted,
+                                                  type,
+                                                  var->data,
+                                                  var->shift,
+                                                  &pos,
+                                                  var->current->i_buffer + var->current->n_buffer,
+                                                  var->current - var->levels,
+                                                  (!span && var->lazy) ? &var->deferred : NULL);
+                        if (r)
+                                return r;
+
+                        var->current->n_buffer -= pos - var->current->i_buffer;
+                        var->current->i_buffer = pos;
+
+                        if (var->current->container != 'a') {
+                                var->current->n_type -= type->length;
+                                var->current->i_type += type->length;
+                        }
+                }
+
+                if (!span)
+                        return 0;
+
+                if (var->vecs) {
+                        r = c_dvar_vecs_get(var, start, var->current->i_buffer - start, &data);
+                        if (r)
+                                return r;
+                } else {
+                        data = (const char *)var->data + start;
+                }
+        }
+
+        if (span) {
+                *span = (CDVarSpan){
+                        .type = type,
+                        .data = data,
+                        .n_data = var->current->i_buffer - start,
+                        .offset = var->shift + start,
+                        .big_endian = var->big_endian,
+                };
+        }
+
+        return 0;
+}
+
+/*
+ * Verify @n fixed-size elements of a segmented buffer via @layout, starting at
+ * @offset. Elements are verified in place, as many at once as fit into a
+ * segment. Only an element spanning segments is copied, into a stack buffer,
+ * so no bounce buffers are allocated. The padding between elements is
+ * verified separately, since it might span segments as well.
+ */
+static int c_dvar_verify_vecs(CDVar *var, const CDVarLayout *layout, size_t offset, size_t n) {
+        const CDVarType *type = var->current->i_type;
+        char buffer[C_DVAR_TYPE_SIZE_MAX];
+        size_t i, j, k, n_contiguous;
+        const char *p;
+        int r;
+
+        for (i = 0; i < n; i += k) {
+                p = c_dvar_vecs_at(var, offset + i * layout->stride, &n_contiguous);
+
+                if (n_contiguous >= type->size) {
+                        k = c_min(n - i, (n_contiguous - type->size) / layout->stride + 1);
+                        r = c_dvar_layout_verify(layout, p, (k - 1) * layout->stride + type->size, NULL);
+                } else {
+                        k = 1;
+                        for (j = 0; j < type->size; j += n_contiguous) {
+                                p = c_dvar_vecs_at(var, offset + i * layout->stride + j, &n_contiguous);
+                                n_contiguous = c_min(n_contiguous, type->size - j);
+                                memcpy(buffer + j, p, n_contiguous);
+                        }
+
+                        r = c_dvar_layout_verify(layout, buffer, type->size, NULL);
+                }
+                if (r)
+                        return r;
+
+                /* trailing padding of the last element is verified by the next read */
+                if (i + k < n) {
+                        for (j = type->size; j < layout->stride; ++j) {
+                                p = c_dvar_vecs_at(var, offset + (i + k - 1) * layout->stride + j, &n_contiguous);
+                                if (_c_unlikely_(*p))
+                                        return C_DVAR_E_CORRUPT_DATA;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Jump over the next @n elements of the current array, which must have
+ * elements of fixed size. Just like the bulk-skip in c_dvar_walk(), elements
+ * that need no validation are not looked at. All others are verified via their
+ * layout, rather than entering them. Neither ever copies the elements, even
+ * if they span segments.
+ */
+int c_dvar_jump_elements(CDVar *var, size_t n) {
+        const CDVarType *type = var->current->i_type;
+        CDVarLayout layout;
+        size_t start, n_data;
+        int r;
+
+        assert(var->current->container == 'a' && type->size);
+
+        if (!n)
+                return 0;
+
+        /* trailing padding of the last element is verified by the next read */
+        n_data = (n - 1) * c_align_to(type->size, 1 << type->alignment) + type->size;
+        start = c_align_to(var->current->i_buffer + var->shift, 1 << type->alignment) - var->shift;
+
+        r = c_dvar_read_data(var, type->alignment, NULL, n_data);
+        if (r)
+                return r;
+
+        if (var->trusted || (type->basic && type->element != 'b'))
+                return 0;
+
+        c_dvar_layout_init(&layout, type, var->big_endian);
+
+        if (var->vecs)
+                return c_dvar_verify_vecs(var, &layout, start, n);
+
+        return c_dvar_layout_verify(&layout, var->data + start, n_data, NULL);
+}
+
+static int c_dvar_try_vskip(CDVar *var, const char *format, va_list args) {
+        void *p;
+        char c;
+        int r;
+
+        /*
+         * This simply iterates over the format-string @format, but passes NULL
+         * to the reader so its value is skipped (but still validated).
          * Additionally, it supports '*' in the format-string, in which case it
          * skips an entire type. This is done by simply skipping whatever is
-         * found in the variant (and, again, validating it). This is done
-         * recursively, since the D-Bus serialization does not support random
-         * access.
+         * found in the variant (and, again, validating it). See c_dvar_ff()
+         * for how the value is jumped over without entering it.
+         */
+
+        while ((c = *format++)) {
+                p = NULL;
+
+                switch (c) {
+                case '*':
+                        r = c_dvar_ff(var);
+                        if (r)
+                                return r;
+
+                        break;
+
+                case '<':
+                        p = (void *)va_arg(args, const CDVarType *);
+                        /* fallthrough */
+                default:
+                        r = c_dvar_read(var, (char [2]){ c, 0 }, p);
+                        if (r)
+                                return r;
+
+                        break;
+                }
+        }
+
+        return 0;
+}
+
+static int c_dvar_read_fixed_array(CDVar *var,
+                                   CDVarLayout *layout,
+                                   bool convert,
+                                   const char **datap,
+                                   size_t *n_datap,
+                                   size_t *n_elementsp) {
+        const CDVarType *type;
+        const char *data;
+        uint32_t u32;
+        int r;
+
+        /*
+         * This reads an entire array in one go, but only if its elements are
+         * of fixed size. Hence, we never enter the array, but treat it as a
+         * terminal type, just like the bulk-skip in c_dvar_ff() does.
+         */
+        if (_c_unlikely_(!var->current->n_type ||
+                         var->current->i_type->element != 'a' ||
+                         !var->current->i_type[1].size))
+                return -ENOTRECOVERABLE;
+
+        type = var->current->i_type + 1;
+        c_dvar_layout_init(layout, type, var->big_endian);
+
+        /* trusted readers only verify the size of the array */
+        layout->checked = layout->checked && !var->trusted;
+
+        /*
+         * Unless the caller converts the data, it will see the raw data in the
+         * buffer. This is only supported for native-endian data, or if there
+         * are no multi-byte members.
+         */
+        if (_c_unlikely_(!convert && layout->multibyte &&
+                         !!var->big_endian != !!(__BYTE_ORDER == __BIG_ENDIAN)))
+                return -ENOTRECOVERABLE;
+
+        r = c_dvar_read_u32(var, var->big_endian, false, &u32);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, type->alignment, NULL, 0);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, 0, &data, u32);
+        if (r)
+                return r;
+
+        r = c_dvar_layout_verify(layout, data, u32, n_elementsp);
+        if (r)
+                return r;
+
+        if (var->current->container != 'a') {
+                var->current->n_type -= var->current->i_type->length;
+                var->current->i_type += var->current->i_type->length;
+        }
+
+        *datap = data;
+        *n_datap = u32;
+        return 0;
+}
+
+/*
+ * Read the next value as a whole, rather than entering it. Its type must be of
+ * fixed size, and @layout must be the layout of that type. The value is
+ * verified via @layout, so this validates it just like reading it would.
+ * Trusted readers only check its bounds.
+ */
+int c_dvar_read_fixed(CDVar *var, const CDVarLayout *layout, const char **datap) {
+        const CDVarType *type = var->current->i_type;
+        const char *data;
+        int r;
+
+        assert(var->current->n_type && type->size);
+
+        r = c_dvar_read_data(var, type->alignment, &data, type->size);
+        if (r)
+                return r;
+
+        if (!var->trusted) {
+                r = c_dvar_layout_verify(layout, data, type->size, NULL);
+                if (r)
+                        return r;
+        }
+
+        if (var->current->container != 'a') {
+                var->current->n_type -= type->length;
+                var->current->i_type += type->length;
+        }
+
+        if (datap)
+                *datap = data;
+        return 0;
+}
+
+static int c_dvar_try_skip_rest(CDVar *var) {
+        int r;
+
+        if (var->current->container == 'a' && var->current->n_buffer && var->current->i_type->size) {
+                r = c_dvar_jump_rest(var);
+                if (r)
+                        return r;
+
+                /* a truncated element is rejected just like "]" would */
+                if (_c_unlikely_(var->current->n_buffer))
+                        return C_DVAR_E_CORRUPT_DATA;
+        }
+
+        /*
+         * Arrays are exhausted once their data is, all other containers once
+         * their types are.
+         */
+        while (var->current->container == 'a' ? c_dvar_more(var) : var->current->n_type > 0) {
+                r = c_dvar_ff(var);
+                if (r)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int c_dvar_try_read_array_view(CDVar *var, const void **elementsp, size_t *n_elementsp, size_t *stridep) {
+        CDVarLayout layout;
+        const char *data;
+        size_t n_data;
+        int r;
+
+        r = c_dvar_read_fixed_array(var, &layout, false, &data, &n_data, n_elementsp);
+        if (r)
+                return r;
+
+        *elementsp = data;
+        *stridep = layout.stride;
+        return 0;
+}
+
+static int c_dvar_try_read_array_copy(CDVar *var, void *elements, size_t n_elements, size_t *n_elementsp) {
+        CDVarLayout layout;
+        const char *data;
+        size_t n_data;
+        int r;
+
+        r = c_dvar_read_fixed_array(var, &layout, true, &data, &n_data, n_elementsp);
+        if (r)
+                return r;
+
+        if (_c_unlikely_(*n_elementsp > n_elements))
+                return -ENOBUFS;
+
+        c_dvar_layout_copy(&layout,
+                           elements,
+                           data,
+                           n_data,
+                           !!var->big_endian != !!(__BYTE_ORDER == __BIG_ENDIAN));
+
+        /* the trailing padding of the last element is not part of the data */
+        if (n_data)
+                c_memzero((uint8_t *)elements + n_data, layout.stride - layout.size);
+
+        return 0;
+}
+
+/*
+ * Word-wise helper to check 8 bytes at a time. c_dvar_word_is_ascii() returns
+ * true if none of the bytes in @w has the high-bit set, and none of them is
+ * zero. A borrow can only propagate from a zero-byte, so this is exact.
+ */
+#define C_DVAR_WORD_ONES (UINT64_C(0x0101010101010101))
+#define C_DVAR_WORD_HIGH (UINT64_C(0x8080808080808080))
+
+static bool c_dvar_word_is_ascii(uint64_t w) {
+        return !(((w - C_DVAR_WORD_ONES) | w) & C_DVAR_WORD_HIGH);
+}
+
+/*
+ * Scan @n bytes of @str for plain ASCII without zero-bytes, without any
+ * branches on the content. The tail of @str is scanned via its last word,
+ * overlapping the previous one, or padded with non-zero ASCII if @str is
+ * shorter than a word. This returns 0 if the scan passes, non-zero otherwise,
+ * so the results of multiple strings can be accumulated.
+ */
+static uint64_t c_dvar_scan_ascii(const char *str, size_t n) {
+        uint64_t w, invalid = 0;
+        size_t j;
+
+        for (j = 0; j + sizeof(w) <= n; j += sizeof(w)) {
+                memcpy(&w, str + j, sizeof(w));
+                invalid |= ((w - C_DVAR_WORD_ONES) | w) & C_DVAR_WORD_HIGH;
+        }
+
+        if (n >= sizeof(w)) {
+                memcpy(&w, str + n - sizeof(w), sizeof(w));
+        } else {
+                w = C_DVAR_WORD_ONES;
+                for (j = 0; j < n; ++j)
+                        w = (w << 8) | (uint8_t)str[j];
+        }
+
+        return invalid | (((w - C_DVAR_WORD_ONES) | w) & C_DVAR_WORD_HIGH);
+}
+
+static uint16_t c_dvar_load_16(CDVar *var, const char *p, size_t offset) {
+        return var->big_endian ? c_load_16be_aligned(p, offset) : c_load_16le_aligned(p, offset);
+}
+
+static uint32_t c_dvar_load_32(CDVar *var, const char *p, size_t offset) {
+        return var->big_endian ? c_load_32be_aligned(p, offset) : c_load_32le_aligned(p, offset);
+}
+
+static uint64_t c_dvar_load_64(CDVar *var, const char *p, size_t offset) {
+        return var->big_endian ? c_load_64be_aligned(p, offset) : c_load_64le_aligned(p, offset);
+}
+
+static int c_dvar_try_read_string_array(CDVar *var,
+                                        const char **strings,
+                                        size_t *lengths,
+                                        size_t n_strings,
+                                        size_t *n_stringsp) {
+        const CDVarType *type;
+        size_t i, j, n, len;
+        uint64_t invalid;
+        const char *data;
+        bool checked;
+        uint32_t u32;
+        int r;
+
+        /*
+         * Like c_dvar_read_fixed_array(), this never enters the array, but
+         * reads it as a whole and treats it as a terminal type.
+         */
+        if (_c_unlikely_(!var->current->n_type ||
+                         var->current->i_type->element != 'a'))
+                return -ENOTRECOVERABLE;
+
+        type = var->current->i_type + 1;
+        if (_c_unlikely_(type->element != 's' && type->element != 'o' && type->element != 'g'))
+                return -ENOTRECOVERABLE;
+
+        r = c_dvar_read_u32(var, var->big_endian, false, &u32);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, type->alignment, NULL, 0);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, 0, &data, u32);
+        if (r)
+                return r;
+
+        /*
+         * The array data starts aligned to its elements, so offsets into
+         * @data have the same alignment as the serialized elements. If the
+         * array cannot hold more elements than the caller provided room for,
+         * the capacity is not checked per element. Otherwise, surplus
+         * elements are counted, but not stored.
+         */
+        checked = C_DVAR_STRING_ARRAY_MAX(type->element, u32) > n_strings;
+
+        /*
+         * The first pass verifies the framing of each element and records its
+         * position. The content of all strings is verified in a second pass,
+         * just like c_dvar_verify_deferred() does: all of them are scanned for
+         * plain ASCII in one go, and only verified one by one if that fails,
+         * or if they are object paths or signatures.
          */
+        for (i = 0, n = 0; i < u32; ++n) {
+                if (type->element == 'g') {
+                        len = (uint8_t)data[i++];
+                } else {
+                        for (j = i, i = c_align_to(i, 4); j < i; ++j)
+                                if (_c_unlikely_(j >= u32 || (!var->trusted && data[j])))
+                                        return C_DVAR_E_CORRUPT_DATA;
+
+                        if (_c_unlikely_(u32 - i < sizeof(uint32_t)))
+                                return C_DVAR_E_OUT_OF_BOUNDS;
+
+                        len = c_dvar_load_32(var, data, i);
+                        i += sizeof(uint32_t);
+                }
+
+                if (_c_unlikely_(len >= u32 - i))
+                        return C_DVAR_E_OUT_OF_BOUNDS;
+                if (_c_unlikely_(!var->trusted && data[i + len]))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+                if (_c_likely_(!checked || n < n_strings)) {
+                        strings[n] = data + i;
+                        lengths[n] = len;
+                }
+
+                i += len + 1;
+        }
+
+        if (_c_unlikely_(n > n_strings)) {
+                *n_stringsp = n;
+                return -ENOBUFS;
+        }
+
+        if (!var->trusted) {
+                invalid = 0;
+                for (j = 0; j < n; ++j)
+                        invalid |= c_dvar_scan_ascii(strings[j], lengths[j]);
+
+                if (invalid || type->element != 's') {
+                        for (j = 0; j < n; ++j)
+                                if (_c_unlikely_(!c_dvar_verify_string(var, type->element, strings[j], lengths[j], false)))
+                                        return C_DVAR_E_CORRUPT_DATA;
+                }
+        }
+
+        if (var->current->container != 'a') {
+                var->current->n_type -= var->current->i_type->length;
+                var->current->i_type += var->current->i_type->length;
+        }
+
+        *n_stringsp = n;
+        return 0;
+}
+
+/*
+ * Decode a fixed-size value of type @type at offset *@offsetp of @p into
+ * @object, as described by @fields. The caller must have verified that @p
+ * spans the entire value. Hence, no bounds checks are needed. Only alignment
+ * padding and booleans must be verified, unless the reader is trusted. If
+ * @object is NULL, the value is verified, but not stored.
+ */
+static int c_dvar_decode_fixed(CDVar *var,
+                               const CDVarType *type,
+                               const CDVarField *fields,
+                               uint8_t *object,
+                               const char *p,
+                               size_t *offsetp) {
+        size_t i, offset, align;
+        uint64_t u64;
+        uint32_t u32;
+        int r;
+
+        offset = *offsetp;
+        align = c_align_to(offset, 1 << type->alignment) - offset;
+
+        if (!var->trusted)
+                for (i = 0; i < align; ++i)
+                        if (_c_unlikely_(p[offset + i]))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+        offset += align;
+
+        switch (type->element) {
+        case 'y':
+                if (object)
+                        *(uint8_t *)(object + fields->offset) = c_load_8(p, offset);
+                break;
+
+        case 'b':
+                u32 = c_dvar_load_32(var, p, offset);
+                if (_c_unlikely_(!var->trusted && u32 != 0 && u32 != 1))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+                if (object)
+                        *(bool *)(object + fields->offset) = u32;
+                break;
+
+        case 'n':
+        case 'q':
+                if (object)
+                        *(uint16_t *)(object + fields->offset) = c_dvar_load_16(var, p, offset);
+                break;
+
+        case 'i':
+        case 'h':
+        case 'u':
+                if (object)
+                        *(uint32_t *)(object + fields->offset) = c_dvar_load_32(var, p, offset);
+                break;
+
+        case 'x':
+        case 't':
+        case 'd':
+                if (object) {
+                        u64 = c_dvar_load_64(var, p, offset);
+                        memcpy(object + fields->offset, &u64, sizeof(u64));
+                }
+                break;
+
+        case '(':
+        case '{':
+                for (i = 1; i < type->length - 1u; i += type[i].length) {
+                        r = c_dvar_decode_fixed(var, type + i, fields + i, object, p, &offset);
+                        if (r)
+                                return r;
+                }
+
+                *offsetp = offset;
+                return 0;
+
+        default:
+                return -ENOTRECOVERABLE;
+        }
+
+        *offsetp = offset + type->size;
+        return 0;
+}
+
+/*
+ * Read the value of type @type into @object, as described by @fields. If an
+ * array has more elements than its vector can hold, the surplus elements are
+ * verified, but not stored, and -ENOBUFS is returned once the entire value was
+ * read. If @object is NULL, nothing is stored at all.
+ */
+static int c_dvar_read_field(CDVar *var, const CDVarType *type, const CDVarField *fields, uint8_t *object) {
+        size_t i, n, offset, n_buffer;
+        uint8_t *vector, *element;
+        bool overflow = false;
+        const char *str;
+        uint32_t u32;
+        uint8_t u8;
+        int r;
+
+        if (type->size) {
+                /*
+                 * Fixed-size values are bounds-checked as a whole, and then
+                 * decoded without any further checks.
+                 */
+                r = c_dvar_read_data(var, type->alignment, &str, type->size);
+                if (r)
+                        return r;
+
+                offset = 0;
+                return c_dvar_decode_fixed(var, type, fields, object, str, &offset);
+        }
+
+        switch (type->element) {
+        case 'a':
+                r = c_dvar_read_u32(var, var->big_endian, false, &u32);
+                if (r)
+                        return r;
+
+                r = c_dvar_read_data(var, type[1].alignment, NULL, 0);
+                if (r)
+                        return r;
+
+                if (u32 > var->current->n_buffer)
+                        return C_DVAR_E_OUT_OF_BOUNDS;
+
+                vector = object ? *(uint8_t **)(object + fields->offset) : NULL;
+
+                if (type[1].size) {
+                        /*
+                         * Arrays of fixed-size elements are bounds-checked as
+                         * a whole, just like fixed-size structures.
+                         */
+                        r = c_dvar_read_data(var, 0, &str, u32);
+                        if (r)
+                                return r;
+
+                        for (n = 0, offset = 0; offset < u32; ++n) {
+                                if (_c_unlikely_(c_align_to(offset, 1 << type[1].alignment) + type[1].size > u32))
+                                        return C_DVAR_E_OUT_OF_BOUNDS;
+
+                                element = (vector && n < fields->capacity) ? vector + n * fields->stride : NULL;
+                                r = c_dvar_decode_fixed(var, type + 1, fields + 1, element, str, &offset);
+                                if (r)
+                                        return r;
+                        }
+                } else {
+                        n_buffer = var->current->n_buffer - u32;
+                        var->current->n_buffer = u32;
+
+                        for (n = 0; var->current->n_buffer; ++n) {
+                                element = (vector && n < fields->capacity) ? vector + n * fields->stride : NULL;
+                                r = c_dvar_read_field(var, type + 1, fields + 1, element);
+                                if (r == -ENOBUFS)
+                                        overflow = true;
+                                else if (r)
+                                        return r;
+                        }
+
+                        var->current->n_buffer = n_buffer;
+                }
+
+                if (n > fields->capacity)
+                        overflow = true;
+                if (object)
+                        *(size_t *)(object + fields->n_offset) = n;
+                break;
+
+        case '(':
+        case '{':
+                r = c_dvar_read_data(var, 3, NULL, 0);
+                if (r)
+                        return r;
+
+                for (i = 1; i < type->length - 1u; i += type[i].length) {
+                        r = c_dvar_read_field(var, type + i, fields + i, object);
+                        if (r == -ENOBUFS)
+                                overflow = true;
+                        else if (r)
+                                return r;
+                }
+
+                break;
+
+        case 's':
+        case 'o':
+        case 'g':
+                if (type->element == 'g') {
+                        r = c_dvar_read_u8(var, false, &u8);
+                        if (r)
+                                return r;
+
+                        u32 = u8;
+                } else {
+                        r = c_dvar_read_u32(var, var->big_endian, false, &u32);
+                        if (r)
+                                return r;
+                }
+
+                r = c_dvar_read_data(var, 0, &str, (size_t)u32 + 1);
+                if (r)
+                        return r;
+
+                /* strings that are not stored are deferred by lazy readers */
+                if (!var->trusted &&
+                    (str[u32] || !c_dvar_verify_string(var, type->element, str, u32, !object)))
+                        return C_DVAR_E_CORRUPT_DATA;
+
+                if (object)
+                        *(const char **)(object + fields->offset) = str;
+                break;
+
+        default:
+                /* variants cannot be described by fields */
+                return -ENOTRECOVERABLE;
+        }
+
+        return overflow ? -ENOBUFS : 0;
+}
+
+static int c_dvar_try_read_struct(CDVar *var, const CDVarField *fields, void *object) {
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type))
+                return -ENOTRECOVERABLE;
+
+        r = c_dvar_read_field(var, var->current->i_type, fields, object);
+        if (r)
+                return r;
+
+        if (var->current->container != 'a') {
+                var->current->n_type -= var->current->i_type->length;
+                var->current->i_type += var->current->i_type->length;
+        }
+
+        return 0;
+}
+
+/*
+ * Reads into caller-provided buffers fail with -ENOBUFS if the buffers are too
+ * small. This is no data error, so the reader is not poisoned. Instead, it is
+ * reset to @level, its state before the read, so the caller can retry with
+ * larger buffers. Such reads never leave the level they started on. Any other
+ * result is passed to c_dvar_partial_finish().
+ */
+static int c_dvar_capacity_finish(CDVar *var,
+                                  const CDVarLevel *level,
+                                  const CDVarLevel *saved,
+                                  CDVarLevel *current,
+                                  int r) {
+        if (r != -ENOBUFS)
+                return c_dvar_partial_finish(var, saved, current, r);
+
+        *var->current = *level;
+        if (current)
+                var->pinned = NULL;
+        if (var->deferred)
+                var->deferred->n_strings = var->n_pinned;
+
+        return r;
+}
+
+/*
+ * Reads on partial data are atomic. If a read runs out of available data, the
+ * reader is restored to its state before the read, so the caller can retry
+ * once more data was fed. This saves all active levels before a read, and
+ * pins them, so c_dvar_pop() defers releasing their types. The number of
+ * deferred strings is saved for all readers, so a retry, either with more data
+ * or with larger buffers, does not record them twice.
+ *
+ * Returns the current level to pass to c_dvar_partial_finish(), or NULL if
+ * the reader operates on complete data. Nested reads, as issued by
+ * c_dvar_ff(), rely on the outermost read to save the state.
+ */
+CDVarLevel *c_dvar_partial_save(CDVar *var, CDVarLevel *saved) {
+        if (var->pinned)
+                return NULL;
+
+        var->n_pinned = var->deferred ? var->deferred->n_strings : 0;
+        if (_c_likely_(!var->partial))
+                return NULL;
+
+        memcpy(saved, var->levels, (var->current - var->levels + 1) * sizeof(*saved));
+        var->pinned = var->current;
+        return var->current;
+}
+
+/*
+ * Finish a read with result @r, started via c_dvar_partial_save(). If the
+ * read ran out of data, all levels it entered are released and the saved
+ * levels are restored. Otherwise, the types of all saved levels it exited
+ * are released. Unless the read ran out of data, @r poisons the reader.
+ */
+int c_dvar_partial_finish(CDVar *var, const CDVarLevel *saved, CDVarLevel *current, int r) {
+        CDVarLevel *level;
+
+        if (current) {
+                if (r == C_DVAR_E_INCOMPLETE_DATA) {
+                        for (level = var->current; level > var->pinned; --level)
+                                if (level->allocated_parent_types)
+                                        c_dvar_release_types(level);
+
+                        memcpy(var->levels, saved, (current - var->levels + 1) * sizeof(*saved));
+                        var->current = current;
+                        var->pinned = NULL;
+                        if (var->deferred)
+                                var->deferred->n_strings = var->n_pinned;
+                        return r;
+                }
+
+                for (level = current; level > var->pinned; --level)
+                        if (saved[level - var->levels].allocated_parent_types)
+                                c_dvar_release_types(saved + (level - var->levels));
+
+                var->pinned = NULL;
+        }
+
+        if (r != C_DVAR_E_INCOMPLETE_DATA)
+                var->poison = r;
+
+        return r;
+}
+
+static void c_dvar_reset_read(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data) {
+        c_dvar_reset(var, big_endian, types, n_types);
+
+        var->data = (void *)data;
+        var->n_data = n_data;
+        var->ro = true;
+        var->current->n_buffer = var->n_data;
+}
+
+/**
+ * c_dvar_begin_read() - XXX
+ */
+_c_public_ void c_dvar_begin_read(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data) {
+        /*
+         * D-Bus types are generally composable, unlike its default
+         * serialization, which is position dependent. Its required padding
+         * changes depending on its initial alignment. Hence, you must pass in
+         * 64-bit aligned data, otherwise you will not get a canonical
+         * representation.
+         *
+         * There are exceptions, where you could successfully do composition.
+         * However, almost all those exceptions are statically sized types, so
+         * you're better off using a hard-coded structure type, anyway. You
+         * need deep understanding of the serialization to realize the
+         * composition would work, so there is no point in using a CDVar object
+         * at all.
+         *
+         * To parse sub-variants in place, use c_dvar_begin_read_shifted(),
+         * which computes padding relative to the surrounding data.
+         */
+        assert(data == (void *)c_align_to((unsigned long)data, 8));
+
+        c_dvar_reset_read(var, big_endian, types, n_types, data, n_data);
+}
+
+/**
+ * c_dvar_begin_read_shifted() - begin reading data embedded in other data
+ * @var:                variant to operate on
+ * @big_endian:         whether the data is big-endian
+ * @types:              types of the data
+ * @n_types:            number of single complete types in @types
+ * @data:               data to read
+ * @n_data:             length of @data in bytes
+ * @offset:             offset of @data in the surrounding data
+ *
+ * This is similar to c_dvar_begin_read(), but reads data that is embedded in
+ * a surrounding 8-byte aligned buffer, at offset @offset. Any padding is
+ * computed relative to the surrounding buffer, rather than relative to
+ * @data. This allows reading a value in place, wherever it is located in a
+ * message. Only the value of @offset modulo 8 is relevant, and it must match
+ * the alignment of @data.
+ */
+_c_public_ void c_dvar_begin_read_shifted(CDVar *var,
+                                          bool big_endian,
+                                          const CDVarType *types,
+                                          size_t n_types,
+                                          const void *data,
+                                          size_t n_data,
+                                          size_t offset) {
+        assert((unsigned long)data % 8 == offset % 8);
+
+        c_dvar_reset_read(var, big_endian, types, n_types, data, n_data);
+        var->shift = offset % 8;
+}
+
+/**
+ * c_dvar_begin_read_token() - begin reading validated data
+ * @var:                variant to operate on
+ * @token:              validation token of the data
+ *
+ * This is similar to c_dvar_begin_read(), but reads the data and types
+ * referred to by @token, which are known to be valid. Hence, the reader skips
+ * all checks of the content: padding bytes, booleans, and the validity of
+ * strings, object paths, signatures and variant types. This applies to values
+ * that are skipped, jumped over, or returned as spans just as well. Bounds and
+ * the structure of the data are still checked, and types are still verified
+ * against the format strings.
+ *
+ * If the data referred to by @token is not actually valid, the values read are
+ * undefined. The reader itself never accesses memory outside of the data, but
+ * strings returned to the caller might lack their terminating zero.
+ */
+_c_public_ void c_dvar_begin_read_token(CDVar *var, const CDVarToken *token) {
+        c_dvar_begin_read(var, token->big_endian, token->types, token->n_types, token->data, token->n_data);
+        var->trusted = true;
+}
+
+/**
+ * c_dvar_begin_read_vecs() - begin reading from multiple segments
+ * @var:                variant to operate on
+ * @big_endian:         whether the data is big-endian
+ * @types:              types of the data
+ * @n_types:            number of single complete types in @types
+ * @vecs:               segments of the data
+ * @n_vecs:             number of segments in @vecs
+ *
+ * This is similar to c_dvar_begin_read(), but reads the concatenation of all
+ * segments in @vecs, rather than a single contiguous buffer. Every segment
+ * must be 8-byte aligned, and all but the last segment must be a multiple of
+ * 8 bytes in length. The caller must keep @vecs and the segments valid until
+ * the reader is reset.
+ *
+ * Values are returned as pointers into the segments, as long as they do not
+ * span segments. Otherwise, they are copied into memory owned by @var, which
+ * stays valid until @var is reset via c_dvar_deinit() or by beginning a new
+ * read or write.
+ */
+_c_public_ void c_dvar_begin_read_vecs(CDVar *var,
+                                       bool big_endian,
+                                       const CDVarType *types,
+                                       size_t n_types,
+                                       const struct iovec *vecs,
+                                       size_t n_vecs) {
+        size_t i, n_data = 0;
+
+        for (i = 0; i < n_vecs; ++i) {
+                assert(vecs[i].iov_base == (void *)c_align_to((unsigned long)vecs[i].iov_base, 8));
+                assert(i + 1 == n_vecs || !(vecs[i].iov_len % 8));
+                n_data += vecs[i].iov_len;
+        }
+
+        /* a single segment is read directly, without any segment handling */
+        if (n_vecs < 2) {
+                c_dvar_begin_read(var, big_endian, types, n_types,
+                                  n_vecs ? vecs->iov_base : NULL,
+                                  n_vecs ? vecs->iov_len : 0);
+                return;
+        }
+
+        c_dvar_begin_read(var, big_endian, types, n_types, NULL, 0);
+
+        var->vecs = vecs;
+        var->n_vecs = n_vecs;
+        var->n_data = n_data;
+        var->current->n_buffer = n_data;
+}
+
+/**
+ * c_dvar_begin_read_partial() - begin reading partially available data
+ * @var:                variant to operate on
+ * @big_endian:         whether the data is big-endian
+ * @types:              types of the data
+ * @n_types:            number of single complete types in @types
+ * @data:               data available so far
+ * @n_data:             number of bytes available so far
+ * @n_total:            total length of the data in bytes
+ *
+ * This is similar to c_dvar_begin_read(), but only the first @n_data bytes
+ * of the @n_total bytes of data are available, yet. Any read that runs out of
+ * available data returns C_DVAR_E_INCOMPLETE_DATA. Unlike any other error,
+ * this does not poison the reader. Instead, the reader is left as it was
+ * before the read, and the read can be retried after feeding more data via
+ * c_dvar_feed().
+ *
+ * Note that values read so far point into the buffers passed so far. If the
+ * caller moves the data to feed more of it, those values are invalidated.
+ */
+_c_public_ void c_dvar_begin_read_partial(CDVar *var,
+                                          bool big_endian,
+                                          const CDVarType *types,
+                                          size_t n_types,
+                                          const void *data,
+                                          size_t n_data,
+                                          size_t n_total) {
+        assert(n_data <= n_total);
+
+        c_dvar_begin_read(var, big_endian, types, n_types, data, n_total);
+
+        var->n_available = n_data;
+        var->partial = n_data < n_total;
+}
+
+/**
+ * c_dvar_feed() - feed more data to a partial reader
+ * @var:                variant to operate on
+ * @data:               data available so far
+ * @n_data:             number of bytes available so far
+ *
+ * This makes more data available to a reader started via
+ * c_dvar_begin_read_partial(). @data must start with all data passed so far,
+ * but it can be moved to a new location. @n_data must not exceed the total
+ * length given to c_dvar_begin_read_partial(). Once all data is available,
+ * the reader behaves exactly like a reader started via c_dvar_begin_read().
+ */
+_c_public_ void c_dvar_feed(CDVar *var, const void *data, size_t n_data) {
+        assert(var->ro);
+        assert(var->current);
+        assert(data == (void *)c_align_to((unsigned long)data, 8));
+        assert(var->partial || n_data == var->n_data);
+        assert(n_data >= var->n_available && n_data <= var->n_data);
+
+        var->data = (void *)data;
+        var->n_available = n_data;
+        var->partial = n_data < var->n_data;
+}
+
+/**
+ * c_dvar_more() - XXX
+ */
+_c_public_ bool c_dvar_more(CDVar *var) {
+        return !var->poison && var->ro && var->current && var->current->n_buffer;
+}
+
+/**
+ * c_dvar_read_span() - read next value as span
+ * @var:                variant to operate on
+ * @span:               output argument for the value
+ *
+ * This reads the next complete value of @var without decoding it, and returns
+ * it as span. The span refers to the serialized value in place, and can later
+ * be read via c_dvar_begin_read_span(). The value is validated just like
+ * skipping it via c_dvar_skip() with "*" does. Values of fixed size are read
+ * in constant time, unless they contain padding or booleans. All other values
+ * are validated in a single pass, without entering them.
+ *
+ * On readers of multiple segments, values that span segments are copied into
+ * a buffer owned by the reader, which stays valid until the reader is reset.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_span(CDVar *var, CDVarSpan *span) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_jump(var, span);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_peek_type() - peek at type of next element
+ * @var:                variant to operate on
+ * @typep:              output argument for the type of the next element
+ *
+ * This returns the type of the next element of @var, without reading it. If
+ * the current container has no more elements, NULL is returned. Note that
+ * this is the static type, so variants are returned as 'v'. See
+ * c_dvar_peek_variant() to peek at their content.
+ *
+ * Return: 0 on success, poison error code if the reader is poisoned.
+ */
+_c_public_ int c_dvar_peek_type(CDVar *var, const CDVarType **typep) {
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        if (!var->current->n_type || (var->current->container == 'a' && !var->current->n_buffer))
+                *typep = NULL;
+        else
+                *typep = var->current->i_type;
+
+        return 0;
+}
+
+static int c_dvar_try_peek_array(CDVar *var, size_t *n_datap, size_t *n_elementsp) {
+        const CDVarType *type;
+        uint32_t u32;
+        size_t stride;
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type || var->current->i_type->element != 'a'))
+                return -ENOTRECOVERABLE;
+
+        type = var->current->i_type + 1;
+
+        /* this applies the same checks as entering the array via "[" */
+        r = c_dvar_read_u32(var, var->big_endian, false, &u32);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, type->alignment, NULL, 0);
+        if (r)
+                return r;
+
+        if (u32 > var->current->n_buffer)
+                return C_DVAR_E_OUT_OF_BOUNDS;
+
+        if (n_datap)
+                *n_datap = u32;
+
+        if (n_elementsp) {
+                if (!type->size) {
+                        *n_elementsp = SIZE_MAX;
+                } else if (!u32) {
+                        *n_elementsp = 0;
+                } else {
+                        stride = c_align_to(type->size, 1 << type->alignment);
+                        if (u32 < type->size || (u32 - type->size) % stride)
+                                return C_DVAR_E_CORRUPT_DATA;
+
+                        *n_elementsp = (u32 - type->size) / stride + 1;
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * c_dvar_peek_array() - peek at size of next array
+ * @var:                variant to operate on
+ * @n_datap:            output argument for the array size in bytes, or NULL
+ * @n_elementsp:        output argument for the number of elements, or NULL
+ *
+ * This returns the size of the next array of @var, without entering it. The
+ * size excludes the array header and the padding to its first element. If the
+ * array elements are of fixed size, the number of elements is returned as
+ * well. Otherwise, SIZE_MAX is returned as number of elements.
+ *
+ * The array header is verified just like entering the array does. Errors are
+ * reported, but, unlike with all other reader functions, they do not poison
+ * the reader. The reader is never advanced.
+ *
+ * Return: 0 on success, -ENOTRECOVERABLE if the next element is no array,
+ *         positive error code on data errors.
+ */
+_c_public_ int c_dvar_peek_array(CDVar *var, size_t *n_datap, size_t *n_elementsp) {
+        CDVarLevel level;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        level = *var->current;
+        r = c_dvar_try_peek_array(var, n_datap, n_elementsp);
+        *var->current = level;
+
+        return r;
+}
+
+static int c_dvar_try_peek_variant(CDVar *var, const char **signaturep, size_t *n_signaturep) {
+        const char *str;
+        uint8_t u8;
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type || var->current->i_type->element != 'v'))
+                return -ENOTRECOVERABLE;
+
+        r = c_dvar_read_u8(var, false, &u8);
+        if (r)
+                return r;
+
+        r = c_dvar_read_data(var, 0, &str, (size_t)u8 + 1);
+        if (r)
+                return r;
+
+        if (str[u8] || !c_dvar_is_type(str, u8))
+                return C_DVAR_E_CORRUPT_DATA;
+
+        *signaturep = str;
+        if (n_signaturep)
+                *n_signaturep = u8;
+
+        return 0;
+}
+
+/**
+ * c_dvar_peek_variant() - peek at signature of next variant
+ * @var:                variant to operate on
+ * @signaturep:         output argument for the signature
+ * @n_signaturep:       output argument for the signature length, or NULL
+ *
+ * This returns the signature of the next variant of @var, without entering
+ * it. The signature is verified to be a single complete type, and is returned
+ * as zero-terminated string pointing into the data of @var.
+ *
+ * Errors are reported, but, unlike with all other reader functions, they do
+ * not poison the reader. The reader is never advanced.
+ *
+ * Return: 0 on success, -ENOTRECOVERABLE if the next element is no variant,
+ *         positive error code on data errors.
+ */
+_c_public_ int c_dvar_peek_variant(CDVar *var, const char **signaturep, size_t *n_signaturep) {
+        CDVarLevel level;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        level = *var->current;
+        r = c_dvar_try_peek_variant(var, signaturep, n_signaturep);
+        *var->current = level;
+
+        return r;
+}
+
+/**
+ * c_dvar_vread() - XXX
+ */
+_c_public_ int c_dvar_vread(CDVar *var, const char *format, va_list args) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        va_list copy;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        /*
+         * A va_list parameter might decay to a pointer, so the helpers operate
+         * on a local copy, which can be passed on by reference.
+         */
+        va_copy(copy, args);
+
+        if (_c_unlikely_(var->poison)) {
+                c_dvar_dummy_vread(var, format, &copy);
+                va_end(copy);
+                return var->poison;
+        }
 
-        while ((c = *format++)) {
-                p = NULL;
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_vread(var, format, &copy);
+        va_end(copy);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
 
-                switch (c) {
-                case '*':
-                        r = c_dvar_ff(var);
-                        if (r)
-                                return r;
+/**
+ * c_dvar_program_vread() - read data from variant via compiled program
+ * @var:                variant to operate on
+ * @program:            compiled format program
+ * @args:               output arguments
+ *
+ * This is equivalent to c_dvar_vread() with the format string @program was
+ * compiled from. However, all type verification that was done when compiling
+ * @program is skipped. The reader must be positioned at the type @program was
+ * compiled against.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on parser failure.
+ */
+_c_public_ int c_dvar_program_vread(CDVar *var, const CDVarProgram *program, va_list args) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        va_list copy;
+        int r;
 
-                        break;
+        assert(var->ro);
+        assert(var->current);
 
-                case '<':
-                        p = (void *)va_arg(args, const CDVarType *);
-                        /* fallthrough */
-                default:
-                        r = c_dvar_read(var, (char [2]){ c, 0 }, p);
-                        if (r)
-                                return r;
+        va_copy(copy, args);
 
-                        break;
-                }
+        if (_c_unlikely_(var->poison)) {
+                c_dvar_dummy_vread(var, program->format, &copy);
+                va_end(copy);
+                return var->poison;
         }
 
-        return 0;
+        r = c_dvar_program_verify(var, program);
+        if (r) {
+                c_dvar_dummy_vread(var, program->format, &copy);
+                va_end(copy);
+                return var->poison = r;
+        }
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_run(var, program, &copy);
+        va_end(copy);
+        return c_dvar_partial_finish(var, saved, current, r);
 }
 
 /**
- * c_dvar_begin_read() - XXX
+ * c_dvar_vskip() - XXX
  */
-_c_public_ void c_dvar_begin_read(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data) {
-        size_t i;
+_c_public_ int c_dvar_vskip(CDVar *var, const char *format, va_list args) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
 
-        /*
-         * D-Bus types are generally composable, unlike its default
-         * serialization, which is position dependent. Its required padding
-         * changes depending on its initial alignment. Hence, you must pass in
-         * 64-bit aligned data, otherwise you will not get a canonical
-         * representation.
-         *
-         * There are exceptions, where you could successfully do composition.
-         * However, almost all those exceptions are statically sized types, so
-         * you're better off using a hard-coded structure type, anyway. You
-         * need deep understanding of the serialization to realize the
-         * composition would work, so there is no point in using a CDVar object
-         * at all.
-         *
-         * XXX: We could support a `shifted' reader, that supports parsing
-         *      sub-variants. So far we didn't see a need for it, though.
-         */
-        assert(data == (void *)c_align_to((unsigned long)data, 8));
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
 
-        c_dvar_deinit(var);
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_vskip(var, format, args);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
 
-        var->data = (void *)data;
-        var->n_data = n_data;
-        var->ro = true;
-        var->big_endian = big_endian;
-
-        var->current = var->levels;
-        var->current->parent_types = (CDVarType *)types;
-        var->current->n_parent_types = n_types;
-        var->current->i_type = (CDVarType *)types;
-        var->current->n_type = 0;
-        var->current->container = 0;
-        var->current->allocated_parent_types = false;
-        var->current->i_buffer = 0;
-        var->current->n_buffer = var->n_data;
+/**
+ * c_dvar_skip_rest() - skip remainder of current container
+ * @var:                variant to operate on
+ *
+ * This skips all remaining values of the container @var is currently in,
+ * validating them just like c_dvar_skip() with "*" does. This works at any
+ * level, including the root level. Afterwards, the reader is positioned at the
+ * end of the container, which must still be left as usual (e.g., via "]" or
+ * ")"). If nothing is left, this is a no-op.
+ *
+ * The remaining elements of arrays with fixed-size elements are jumped over
+ * in constant time, unless they contain padding or booleans, in which case
+ * they are verified via a single scan. All other values are validated in a
+ * single pass, without entering them, unless the reader operates on segments
+ * or partial data, or is lazy.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on parser failure.
+ */
+_c_public_ int c_dvar_skip_rest(CDVar *var) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_skip_rest(var);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_read_array_view() - read array of fixed-size elements in place
+ * @var:                variant to operate on
+ * @elementsp:          output argument for the first array element
+ * @n_elementsp:        output argument for the number of array elements
+ * @stridep:            output argument for the distance between elements
+ *
+ * This reads the next array of the variant in a single step, rather than
+ * entering it and reading each element individually. This is only supported
+ * for arrays with fixed-size elements, which includes arrays of structures
+ * with only fixed-size members.
+ *
+ * The entire array is validated, but no data is copied. Instead, a pointer to
+ * the first element in the data buffer is returned in @elementsp. It is
+ * suitably aligned for the element type. The number of elements is returned
+ * in @n_elementsp and the distance between two elements in bytes (including
+ * trailing padding) is returned in @stridep.
+ *
+ * Since no conversion is done, this is only supported if the data is in
+ * native byte-order, or if the element type has no multi-byte members. It is
+ * the responsibility of the caller to check for this.
+ *
+ * On failure, NULL is returned in @elementsp and both @n_elementsp and @stridep
+ * are cleared.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on parser failure.
+ */
+_c_public_ int c_dvar_read_array_view(CDVar *var, const void **elementsp, size_t *n_elementsp, size_t *stridep) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
 
-        for (i = 0; i < n_types; ++i) {
-                assert(var->n_root_type + (uint8_t)types->length >= (uint8_t)types->length);
-                var->n_root_type += types->length;
-                types += types->length;
+        if (_c_likely_(!var->poison)) {
+                current = c_dvar_partial_save(var, saved);
+                r = c_dvar_try_read_array_view(var, elementsp, n_elementsp, stridep);
+                r = c_dvar_partial_finish(var, saved, current, r);
+        } else {
+                r = var->poison;
         }
 
-        var->current->n_type = var->n_root_type;
+        if (_c_unlikely_(r)) {
+                *elementsp = NULL;
+                *n_elementsp = 0;
+                *stridep = 0;
+        }
+
+        return r;
 }
 
 /**
- * c_dvar_more() - XXX
+ * c_dvar_read_array_copy() - read array of fixed-size elements into buffer
+ * @var:                variant to operate on
+ * @elements:           buffer to store the array elements in
+ * @n_elements:         capacity of @elements as number of elements
+ * @n_elementsp:        output argument for the number of array elements
+ *
+ * This is similar to c_dvar_read_array_view(), but copies the array elements
+ * into the caller-provided buffer @elements, converting them to native
+ * byte-order on the way. Hence, this works regardless of the byte-order of
+ * the data.
+ *
+ * The elements are stored with the same layout as in the serialized data. For
+ * arrays of basic types this is equivalent to a plain C array of the
+ * respective type (with booleans stored as uint32_t). Structures are stored
+ * with their natural D-Bus alignment, padded to 8 bytes. @elements must be
+ * large enough to hold @n_elements elements of this layout. The trailing
+ * padding of the last element is cleared. If the array has more elements, this
+ * fails with -ENOBUFS and returns the number of array elements in
+ * @n_elementsp. This does not poison the reader, nor advance it, so the caller
+ * can retry with a larger buffer.
+ *
+ * The conversion is done in a single pass over the array. If the elements are
+ * of uniform size without any padding, the entire array is converted as a
+ * plain integer array, allowing the compiler to vectorize the operation.
+ *
+ * On any other failure, 0 is returned in @n_elementsp. On failure, the
+ * content of @elements is undefined.
+ *
+ * Return: 0 on success, -ENOBUFS if @elements is too small, other negative
+ *         error codes on fatal errors, positive error code on parser failure.
  */
-_c_public_ bool c_dvar_more(CDVar *var) {
-        return !var->poison && var->ro && var->current && var->current->n_buffer;
+_c_public_ int c_dvar_read_array_copy(CDVar *var, void *elements, size_t n_elements, size_t *n_elementsp) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current, level;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_likely_(!var->poison)) {
+                level = *var->current;
+                current = c_dvar_partial_save(var, saved);
+                r = c_dvar_try_read_array_copy(var, elements, n_elements, n_elementsp);
+                r = c_dvar_capacity_finish(var, &level, saved, current, r);
+        } else {
+                r = var->poison;
+        }
+
+        if (_c_unlikely_(r && r != -ENOBUFS))
+                *n_elementsp = 0;
+
+        return r;
 }
 
 /**
- * c_dvar_vread() - XXX
+ * c_dvar_read_string_array() - read array of strings into vectors
+ * @var:                variant to operate on
+ * @strings:            vector to store the string pointers in
+ * @lengths:            vector to store the string lengths in
+ * @n_strings:          capacity of @strings and @lengths
+ * @n_stringsp:         output argument for the number of strings
+ *
+ * This reads the next array of @var in one go, if its elements are strings,
+ * object paths, or signatures (e.g., 'as' or 'ao'). A pointer to each element
+ * is stored in @strings, and its length, excluding the terminating zero, in
+ * the same slot of @lengths. The pointers point into the data buffer of @var,
+ * just like reading the elements one by one would return. The array is never
+ * entered, but treated like a terminal type.
+ *
+ * An array of N bytes cannot hold more than
+ * C_DVAR_STRING_ARRAY_MAX(element, N) elements. Hence, callers can size
+ * their vectors via c_dvar_peek_array(). If the vectors are large enough for
+ * this bound, the capacity is not checked for every element. If the array has
+ * more elements than @n_strings, this fails with -ENOBUFS and returns the
+ * number of array elements in @n_stringsp. This does not poison the reader,
+ * nor advance it, so the caller can retry with larger vectors.
+ *
+ * The framing of all elements is verified first, before their content is
+ * validated in a single batch. The elements are validated just like reading
+ * them one by one would, with the exception that lazy readers never defer
+ * them, since they are returned to the caller.
+ *
+ * On any other failure, 0 is returned in @n_stringsp. On failure, the content
+ * of @strings and @lengths is undefined.
+ *
+ * Return: 0 on success, -ENOBUFS if the vectors are too small,
+ *         -ENOTRECOVERABLE if the next element is no array of strings, object
+ *         paths, or signatures, other negative error codes on fatal errors,
+ *         positive error code on parser failure.
  */
-_c_public_ int c_dvar_vread(CDVar *var, const char *format, va_list args) {
+_c_public_ int c_dvar_read_string_array(CDVar *var,
+                                        const char **strings,
+                                        size_t *lengths,
+                                        size_t n_strings,
+                                        size_t *n_stringsp) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current, level;
+        int r;
+
         assert(var->ro);
         assert(var->current);
 
-        if (_c_unlikely_(var->poison))
-                c_dvar_dummy_vread(var, format, args);
-        else
-                var->poison = c_dvar_try_vread(var, format, args);
+        if (_c_likely_(!var->poison)) {
+                level = *var->current;
+                current = c_dvar_partial_save(var, saved);
+                r = c_dvar_try_read_string_array(var, strings, lengths, n_strings, n_stringsp);
+                r = c_dvar_capacity_finish(var, &level, saved, current, r);
+        } else {
+                r = var->poison;
+        }
+
+        if (_c_unlikely_(r && r != -ENOBUFS))
+                *n_stringsp = 0;
 
-        return var->poison;
+        return r;
 }
 
 /**
- * c_dvar_vskip() - XXX
+ * c_dvar_read_struct() - read value into C structure
+ * @var:                variant to operate on
+ * @fields:             field descriptors
+ * @object:             C structure to read into
+ *
+ * This reads the next single complete type from @var and stores it in the
+ * caller-defined C structure @object. @fields must be an array parallel to
+ * the type array of the value. That is, @fields[i] describes the i-th entry
+ * of the type array. See CDVarField for details.
+ *
+ * Fixed-size values, including fixed-size structures and arrays of them, are
+ * bounds-checked as a whole, rather than member by member.
+ *
+ * Strings, object paths and signatures are returned as pointers into the data
+ * buffer. Values of variant type cannot be read by this function.
+ *
+ * If an array has more elements than the capacity of its vector, the entire
+ * value is still verified, but the surplus elements are not stored. The
+ * counter of the array is set to its actual number of elements, and this fails
+ * with -ENOBUFS. This does not poison the reader, nor advance it, so the
+ * caller can retry with larger vectors.
+ *
+ * On failure, the content of @object is undefined, except for the counters of
+ * arrays on -ENOBUFS.
+ *
+ * Return: 0 on success, -ENOBUFS if a vector is too small, other negative
+ *         error codes on fatal errors, positive error code on parser failure.
  */
-_c_public_ int c_dvar_vskip(CDVar *var, const char *format, va_list args) {
+_c_public_ int c_dvar_read_struct(CDVar *var, const CDVarField *fields, void *object) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current, level;
+        int r;
+
         assert(var->ro);
         assert(var->current);
 
         if (_c_unlikely_(var->poison))
                 return var->poison;
 
-        return var->poison = c_dvar_try_vskip(var, format, args);
+        level = *var->current;
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_struct(var, fields, object);
+        return c_dvar_capacity_finish(var, &level, saved, current, r);
+}
+
+/**
+ * c_dvar_checkpoint_save() - save reader position
+ * @var:                variant to operate on
+ * @checkpoint:         checkpoint to save to
+ *
+ * This saves the current position of @var in @checkpoint, so the reader can
+ * later return to it via c_dvar_checkpoint_restore(), any number of times.
+ * Only the active levels are saved, so this runs in O(depth).
+ *
+ * The checkpoint takes over all variant types the reader allocated so far,
+ * since the reader might release them when leaving their variants. Hence,
+ * every checkpoint must be released via c_dvar_checkpoint_release(). If
+ * multiple checkpoints are used, they must be released in reverse order.
+ */
+_c_public_ void c_dvar_checkpoint_save(CDVar *var, CDVarCheckpoint *checkpoint) {
+        CDVarLevel *level;
+
+        assert(var->ro);
+        assert(var->current);
+
+        checkpoint->poison = var->poison;
+        checkpoint->n_strings = var->deferred ? var->deferred->n_strings : 0;
+        checkpoint->n_levels = var->current - var->levels + 1;
+        memcpy(checkpoint->levels, var->levels, checkpoint->n_levels * sizeof(*checkpoint->levels));
+
+        for (level = var->levels; level <= var->current; ++level)
+                level->allocated_parent_types = false;
+}
+
+/**
+ * c_dvar_checkpoint_restore() - restore reader position
+ * @var:                variant to operate on
+ * @checkpoint:         checkpoint to restore
+ *
+ * This returns @var to the position saved in @checkpoint. Any variant types
+ * allocated since are released, strings deferred since by a lazy reader are
+ * dropped, and the poison of @var is reset to its state at the checkpoint.
+ * Hence, a reader can backtrack after a failed read. This runs in O(depth).
+ *
+ * The checkpoint must have been saved on @var, and @var must not have been
+ * reset since.
+ */
+_c_public_ void c_dvar_checkpoint_restore(CDVar *var, const CDVarCheckpoint *checkpoint) {
+        CDVarLevel *level;
+
+        assert(var->ro);
+        assert(var->current);
+        assert(checkpoint->n_levels);
+
+        for (level = var->levels; level <= var->current; ++level)
+                if (level->allocated_parent_types)
+                        c_dvar_release_types(level);
+
+        memcpy(var->levels, checkpoint->levels, checkpoint->n_levels * sizeof(*var->levels));
+        var->current = var->levels + checkpoint->n_levels - 1;
+        var->poison = checkpoint->poison;
+
+        /* strings deferred since are skipped again, if at all */
+        if (var->deferred && var->deferred->n_strings > checkpoint->n_strings)
+                var->deferred->n_strings = checkpoint->n_strings;
+
+        /* types stay owned by the checkpoint */
+        for (level = var->levels; level <= var->current; ++level)
+                level->allocated_parent_types = false;
+}
+
+/**
+ * c_dvar_checkpoint_release() - release checkpoint
+ * @var:                variant the checkpoint was saved on
+ * @checkpoint:         checkpoint to release
+ *
+ * This releases all resources of @checkpoint. Variant types still in use by
+ * @var are handed back to it. @var may have been reset since the checkpoint
+ * was saved, but must not have been freed.
+ */
+_c_public_ void c_dvar_checkpoint_release(CDVar *var, CDVarCheckpoint *checkpoint) {
+        CDVarLevel *level, *saved;
+        size_t i;
+
+        for (i = 0; i < checkpoint->n_levels; ++i) {
+                saved = checkpoint->levels + i;
+                if (!saved->allocated_parent_types)
+                        continue;
+
+                level = var->levels + i;
+                if (var->current && level <= var->current &&
+                    level->parent_types == saved->parent_types &&
+                    !level->allocated_parent_types)
+                        level->allocated_parent_types = true;
+                else
+                        c_dvar_release_types(saved);
+        }
+
+        checkpoint->n_levels = 0;
+}
+
+/**
+ * c_dvar_clone() - clone reader
+ * @var:                variant to operate on
+ * @clone:              variant to initialize as clone
+ *
+ * This initializes @clone as an independent reader of the same data as @var,
+ * positioned where @var currently is. Both readers can then be advanced
+ * separately. Any previous state of @clone is released first.
+ *
+ * Only the active levels of @var are copied, so this runs in O(depth) and
+ * does not allocate, unless variant types must be duplicated. This bounds the
+ * time, not the memory, of a clone: @clone is a full reader with room for the
+ * maximum depth, just like any other CDVar.
+ *
+ * The data and all caller-provided types are shared, rather than copied, and
+ * must outlive both readers. Variant types allocated by @var are duplicated,
+ * so each reader owns its own copies and they can be torn down in any order.
+ * This includes types currently owned by a checkpoint of @var. Values copied
+ * because they span segments are not shared, either. Strings pending
+ * verification on a lazy reader are recorded in both readers.
+ *
+ * If @var has a type cache attached, it is attached to @clone as well. Since
+ * type caches are not thread-safe, such clones must not be used concurrently.
+ *
+ * Return: 0 on success, negative error code on fatal failure.
+ */
+_c_public_ int c_dvar_clone(CDVar *var, CDVar *clone) {
+        const CDVarLevel *level;
+        CDVarLevel *dst;
+        CDVarType *types;
+        size_t n;
+
+        assert(var->ro);
+        assert(var->current);
+        assert(!var->pinned);
+        assert(clone != var);
+
+        c_dvar_deinit(clone);
+
+        n = var->current - var->levels + 1;
+        memcpy(clone, var, offsetof(CDVar, levels) + n * sizeof(*var->levels));
+        clone->bounces = NULL;
+        clone->deferred = NULL;
+        clone->current = clone->levels + n - 1;
+
+        if (var->deferred && var->deferred->n_strings) {
+                clone->deferred = malloc(sizeof(*var->deferred) + var->deferred->n_allocated * sizeof(*var->deferred->strings));
+                if (!clone->deferred) {
+                        for (dst = clone->levels; dst <= clone->current; ++dst)
+                                dst->allocated_parent_types = false;
+                        c_dvar_deinit(clone);
+                        return -ENOMEM;
+                }
+
+                memcpy(clone->deferred, var->deferred, sizeof(*var->deferred) + var->deferred->n_strings * sizeof(*var->deferred->strings));
+        }
+
+        /*
+         * Checkpoints take over the types of @var and clear their allocation
+         * flag. Hence, the types to duplicate are identified by whether @var
+         * parsed them, regardless of who currently owns them.
+         */
+        for (level = var->levels, dst = clone->levels; level <= var->current; ++level, ++dst) {
+                if (level->parsed_parent_types) {
+                        types = malloc(level->parent_types->length * sizeof(*types));
+                        if (!types) {
+                                for ( ; dst <= clone->current; ++dst)
+                                        dst->allocated_parent_types = false;
+                                c_dvar_deinit(clone);
+                                return -ENOMEM;
+                        }
+
+                        memcpy(types, level->parent_types, level->parent_types->length * sizeof(*types));
+                        dst->allocated_parent_types = true;
+                        dst->cached_parent_types = false;
+                } else if (level > var->levels && level->parent_types == (level - 1)->parent_types) {
+                        /* levels inside of a variant share its type */
+                        types = (dst - 1)->parent_types;
+                } else {
+                        continue;
+                }
+
+                dst->i_type = types + (level->i_type - level->parent_types);
+                dst->parent_types = types;
+        }
+
+        return 0;
+}
+
+/*
+ * Verify all strings deferred by a lazy reader. Rather than verifying them one
+ * by one, all of them are scanned for plain ASCII without zero-bytes in a
+ * single pass over their words, via c_dvar_scan_ascii(). If the scan passes,
+ * every string is valid, and only object paths and signatures need their own
+ * checks. Otherwise, all strings are verified one by one, to find the
+ * offending one.
+ */
+static bool c_dvar_verify_deferred(CDVar *var, const CDVarDeferred *deferred) {
+        uint64_t invalid = 0;
+        const char *str;
+        size_t i;
+        bool slow;
+
+        for (i = 0; i < deferred->n_strings; ++i)
+                invalid |= c_dvar_scan_ascii((const char *)var->data + deferred->strings[i].offset,
+                                             deferred->strings[i].n);
+
+        for (i = 0; i < deferred->n_strings; ++i) {
+                slow = invalid || deferred->strings[i].element != 's';
+                str = (const char *)var->data + deferred->strings[i].offset;
+
+                if (slow && !c_dvar_verify_string(var, deferred->strings[i].element, str, deferred->strings[i].n, false))
+                        return false;
+        }
+
+        return true;
 }
 
 /**
  * c_dvar_end_read() - XXX
  */
 _c_public_ int c_dvar_end_read(CDVar *var) {
+        CDVarDeferred *deferred = var->deferred;
         int r;
 
         assert(var->ro);
@@ -696,6 +2858,13 @@ _c_public_ int c_dvar_end_read(CDVar *var) {
         else
                 r = 0;
 
+        if (deferred) {
+                if (!r && !c_dvar_verify_deferred(var, deferred))
+                        r = C_DVAR_E_CORRUPT_DATA;
+
+                deferred->n_strings = 0;
+        }
+
         c_dvar_rewind(var);
         var->current->i_type = var->current->parent_types;
         var->current->n_type = var->n_root_type;
@@ -705,36 +2874,101 @@ _c_public_ int c_dvar_end_read(CDVar *var) {
         return r;
 }
 
+/*
+ * Character classes of the D-Bus type-system. This is used to classify
+ * characters of object paths and type signatures via a single table lookup,
+ * rather than a chain of comparisons.
+ */
+enum {
+        C_DVAR_CLASS_WORD               = 1 << 0,
+        C_DVAR_CLASS_SLASH              = 1 << 1,
+
+        C_DVAR_CLASS_BASIC              = 1 << 0,
+        C_DVAR_CLASS_ELEMENT            = 1 << 1,
+};
+
+static const uint8_t c_dvar_path_table[256] = {
+        ['0' ... '9'] = C_DVAR_CLASS_WORD,
+        ['A' ... 'Z'] = C_DVAR_CLASS_WORD,
+        ['a' ... 'z'] = C_DVAR_CLASS_WORD,
+        ['_'] = C_DVAR_CLASS_WORD,
+        ['/'] = C_DVAR_CLASS_SLASH,
+};
+
+static const uint8_t c_dvar_element_table[256] = {
+        ['y'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['b'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['n'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['q'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['i'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['u'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['x'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['t'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['h'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['d'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['s'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['o'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['g'] = C_DVAR_CLASS_BASIC | C_DVAR_CLASS_ELEMENT,
+        ['v'] = C_DVAR_CLASS_ELEMENT,
+};
+
 /**
- * c_dvar_is_path() - XXX
+ * c_dvar_is_path() - check whether string is a valid object path
+ * @str:                string to check
+ * @len:                length of @str in bytes
+ *
+ * This checks whether @str is a valid D-Bus object path. This means, it must
+ * start with a slash, must consist of non-empty elements of `[A-Za-z0-9_]`
+ * separated by single slashes, and must not end with a slash (unless it is
+ * the root path).
+ *
+ * The check is table-driven and free of data-dependent branches, except for
+ * the initial slash.
+ *
+ * Return: True if @str is a valid object path, false if not.
  */
 _c_public_ bool c_dvar_is_path(const char *str, size_t len) {
-        bool slash = true;
+        uint8_t class, prev, invalid = 0;
         size_t i;
 
         if (_c_unlikely_(len == 0 || *str != '/'))
                 return false;
 
+        prev = C_DVAR_CLASS_SLASH;
+
         for (i = 1; i < len; ++i) {
-                if (str[i] == '/') {
-                        if (_c_unlikely_(slash))
-                                return false;
-
-                        slash = true;
-                } else if (_c_unlikely_(!((str[i] >= 'A' && str[i] <= 'Z') ||
-                                          (str[i] >= 'a' && str[i] <= 'z') ||
-                                          (str[i] >= '0' && str[i] <= '9') ||
-                                          (str[i] == '_')))) {
-                        return false;
-                } else {
-                        slash = false;
-                }
+                class = c_dvar_path_table[(uint8_t)str[i]];
+
+                /* reject invalid characters and consecutive slashes */
+                invalid |= !class;
+                invalid |= !!(class & prev & C_DVAR_CLASS_SLASH);
+
+                prev = class;
         }
 
-        return !slash || len == 1;
+        return !invalid && (prev != C_DVAR_CLASS_SLASH || len == 1);
 }
 
 bool c_dvar_is_string(const char *str, size_t len) {
+        uint64_t w;
+        size_t i;
+
+        /*
+         * Skip over leading ASCII in words of 8 bytes, checking for embedded
+         * zero-bytes on the way. Anything else is left to the UTF-8
+         * validator, starting at the first word that is not plain ASCII.
+         * Since ASCII characters are always complete, this yields the same
+         * result as validating the entire string.
+         */
+        for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+                memcpy(&w, str + i, sizeof(w));
+                if (!c_dvar_word_is_ascii(w))
+                        break;
+        }
+
+        str += i;
+        len -= i;
+
         c_utf8_verify(&str, &len);
 
         return (*str == '\0' && len == 0);
@@ -756,10 +2990,7 @@ static const char *c_dvar_verify_type(const char *string, size_t n_string) {
                 if (container == '{') {
                         if (string[i - 1] == '{') {
                                 /* first type must be basic */
-                                if (_c_unlikely_(!(c == 'y' || c == 'b' || c == 'n' || c == 'q' ||
-                                                   c == 'i' || c == 'u' || c == 'x' || c == 't' ||
-                                                   c == 'h' || c == 'd' || c == 's' || c == 'o' ||
-                                                   c == 'g')))
+                                if (_c_unlikely_(!(c_dvar_element_table[(uint8_t)c] & C_DVAR_CLASS_BASIC)))
                                         return NULL;
                         } else if (string[i - 2] == '{') {
                                 /* there must be a second type */
@@ -821,24 +3052,11 @@ static const char *c_dvar_verify_type(const char *string, size_t n_string) {
 
                         break;
 
-                case 'y':
-                case 'b':
-                case 'n':
-                case 'q':
-                case 'i':
-                case 'u':
-                case 'x':
-                case 't':
-                case 'h':
-                case 'd':
-                case 's':
-                case 'o':
-                case 'g':
-                case 'v':
-                        break;
-
                 default:
-                        return NULL;
+                        if (_c_unlikely_(!(c_dvar_element_table[(uint8_t)c] & C_DVAR_CLASS_ELEMENT)))
+                                return NULL;
+
+                        break;
                 }
 
                 while (container == 'a') {
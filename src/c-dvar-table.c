@@ -0,0 +1,295 @@
+/*
+ * Dictionary Tables
+ *
+ * Dictionaries with string keys (e.g., 'a{sv}' property sets) are usually
+ * looked up by key many times after being received. This file implements
+ * dictionary tables, which read such a dictionary in a single validating pass
+ * and map each key to the position of its value. The table is an
+ * open-addressing hash table, stored in a single allocation together with the
+ * value type. Lookups hash the key and compare it in place, without scanning
+ * the data again.
+ *
+ * Keys are chosen by the peer. They are hashed with SipHash, keyed by a
+ * random per-process seed, so a peer cannot craft keys that collide in the
+ * table. The table starts small and grows with the number of distinct keys,
+ * rather than being sized for the worst case of the data.
+ */
+
+#include <assert.h>
+#include <c-siphash.h>
+#include <c-stdaux.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+#define C_DVAR_TABLE_SLOTS_MIN (16)
+
+static uint32_t c_dvar_table_hash(const char *key, size_t n_key) {
+        return c_siphash_hash(c_dvar_hash_seed(), (const uint8_t *)key, n_key);
+}
+
+static CDVarTableSlot *c_dvar_table_find(const CDVarTable *table, const char *key, uint32_t hash) {
+        const CDVarTableSlot *slot;
+        size_t i;
+
+        /*
+         * Linear probing. The table is grown before it is half full, so it
+         * always has empty slots. Values always follow their key, so an empty
+         * slot has a value offset of 0. Keys in the data are zero-terminated
+         * and contain no zero bytes, so they are compared as C strings.
+         */
+        for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+                slot = table->slots + i;
+
+                if (!slot->value)
+                        return (CDVarTableSlot *)slot;
+                if (slot->hash == hash &&
+                    !strcmp((const char *)table->data + slot->key, key))
+                        return (CDVarTableSlot *)slot;
+        }
+}
+
+static CDVarTable *c_dvar_table_new(size_t n_slots, const CDVarType *type) {
+        CDVarTable *table;
+
+        table = calloc(1, sizeof(*table) + n_slots * sizeof(*table->slots) + type->length * sizeof(*type));
+        if (!table)
+                return NULL;
+
+        table->mask = n_slots - 1;
+        table->type = (CDVarType *)(table->slots + n_slots);
+        memcpy(table->type, type, type->length * sizeof(*type));
+        return table;
+}
+
+static int c_dvar_table_grow(CDVarTable **tablep) {
+        CDVarTable *table, *old = *tablep;
+        CDVarTableSlot *slot;
+        size_t i;
+
+        table = c_dvar_table_new(2 * (old->mask + 1), old->type);
+        if (!table)
+                return -ENOMEM;
+
+        table->data = old->data;
+        table->shift = old->shift;
+        table->n_entries = old->n_entries;
+        table->big_endian = old->big_endian;
+
+        for (i = 0; i <= old->mask; ++i) {
+                if (!old->slots[i].value)
+                        continue;
+
+                for (slot = table->slots + (old->slots[i].hash & table->mask);
+                     slot->value;
+                     slot = table->slots + ((slot - table->slots + 1) & table->mask))
+                        ;
+
+                *slot = old->slots[i];
+        }
+
+        free(old);
+        *tablep = table;
+        return 0;
+}
+
+static int c_dvar_try_read_table(CDVar *var, CDVarTable **tablep) {
+        _c_cleanup_(c_dvar_table_freep) CDVarTable *table = NULL;
+        const CDVarType *type;
+        CDVarTableSlot *slot;
+        CDVarLayout layout;
+        const char *key;
+        CDVarSpan span;
+        CDVarKey entry;
+        uint32_t hash;
+        size_t start;
+        char c;
+        int r;
+
+        /*
+         * Keys and values are looked up in place later on, so this requires
+         * a single contiguous buffer, rather than segments.
+         */
+        if (_c_unlikely_(!var->current->n_type ||
+                         var->current->i_type[0].element != 'a' ||
+                         var->current->i_type[1].element != '{' ||
+                         var->vecs))
+                return -ENOTRECOVERABLE;
+
+        /* type[1] is the entry, type[2] the key, type[3] the value */
+        type = var->current->i_type + 1;
+        c = type[1].element;
+        if (_c_unlikely_(c != 's' && c != 'o' && c != 'g'))
+                return -ENOTRECOVERABLE;
+
+        table = c_dvar_table_new(C_DVAR_TABLE_SLOTS_MIN, type + 2);
+        if (!table)
+                return -ENOMEM;
+
+        table->big_endian = var->big_endian;
+
+        if (type[2].size)
+                c_dvar_layout_init(&layout, type + 2, var->big_endian);
+
+        r = c_dvar_read(var, "[");
+        if (r)
+                return r;
+
+        start = var->current->i_buffer;
+        table->data = var->data + start;
+        table->shift = var->shift + start;
+
+        /*
+         * Entries are read as a whole via c_dvar_read_entry(), which validates
+         * the key and jumps over the value. Readers on partial data read them
+         * piece by piece instead. Arrays are limited to 64MiB by the
+         * specification, so 32-bit offsets are sufficient.
+         */
+        while (c_dvar_more(var)) {
+                if (!var->partial) {
+                        r = c_dvar_read_entry(var, &layout, &entry, &span);
+                        if (r)
+                                return r;
+
+                        key = entry.str;
+                } else {
+                        r = c_dvar_read(var, (char [3]){ '{', c, 0 }, &key);
+                        if (r)
+                                return r;
+
+                        r = c_dvar_jump(var, &span);
+                        if (r)
+                                return r;
+
+                        r = c_dvar_read(var, "}");
+                        if (r)
+                                return r;
+                }
+
+                /* the first entry of a key wins, just like for lookups */
+                hash = c_dvar_table_hash(key, strlen(key));
+                slot = c_dvar_table_find(table, key, hash);
+                if (slot->value)
+                        continue;
+
+                if ((table->n_entries + 1) * 2 > table->mask + 1) {
+                        r = c_dvar_table_grow(&table);
+                        if (r)
+                                return r;
+
+                        slot = c_dvar_table_find(table, key, hash);
+                }
+
+                slot->hash = hash;
+                slot->key = (const uint8_t *)key - table->data;
+                slot->value = (const uint8_t *)span.data - table->data;
+                slot->n_value = span.n_data;
+                ++table->n_entries;
+        }
+
+        r = c_dvar_read(var, "]");
+        if (r)
+                return r;
+
+        *tablep = table;
+        table = NULL;
+        return 0;
+}
+
+/**
+ * c_dvar_read_table() - read dictionary into table
+ * @var:                variant to operate on
+ * @tablep:             output argument for newly allocated table
+ *
+ * This reads the next dictionary from @var, validating all its entries, and
+ * stores the position of every value in a newly allocated hash table, keyed
+ * by the entry keys. Only dictionaries with keys of type 's', 'o', or 'g' are
+ * supported. Values can then be looked up via c_dvar_table_lookup(), without
+ * scanning the dictionary again. If a key occurs multiple times, the first
+ * entry wins.
+ *
+ * The table is a single allocation, grown with the number of distinct keys.
+ * Keys are hashed with a random seed, so crafted keys cannot degrade it.
+ * Values are not entered, but jumped over as a whole, just like
+ * c_dvar_read_lookup_many() does.
+ *
+ * The table refers to the data of @var, rather than copying it. The caller
+ * must keep the data valid as long as the table is used. Readers on multiple
+ * segments are not supported.
+ *
+ * Return: 0 on success, negative error code on fatal failure, positive error
+ *         code on data errors.
+ */
+_c_public_ int c_dvar_read_table(CDVar *var, CDVarTable **tablep) {
+        CDVarLevel saved[C_DVAR_TYPE_DEPTH_MAX + 1], *current;
+        int r;
+
+        assert(var->ro);
+        assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        current = c_dvar_partial_save(var, saved);
+        r = c_dvar_try_read_table(var, tablep);
+        return c_dvar_partial_finish(var, saved, current, r);
+}
+
+/**
+ * c_dvar_table_free() - free dictionary table
+ * @table:              table to free, or NULL
+ *
+ * This deallocates @table. If @table is NULL, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ CDVarTable *c_dvar_table_free(CDVarTable *table) {
+        free(table);
+        return NULL;
+}
+
+/**
+ * c_dvar_table_get_n_entries() - query number of table entries
+ * @table:              table to query
+ *
+ * Return: The number of distinct keys of the dictionary.
+ */
+_c_public_ size_t c_dvar_table_get_n_entries(const CDVarTable *table) {
+        return table->n_entries;
+}
+
+/**
+ * c_dvar_table_lookup() - look up key in dictionary table
+ * @table:              table to operate on
+ * @key:                key to look up
+ * @span:               output argument for the value
+ *
+ * This looks up @key in @table. If found, @span is set to the value of the
+ * entry, just like c_dvar_read_span() would return it. It can be read via
+ * c_dvar_begin_read_span(). Its type is owned by @table. If not found, @span
+ * is set to a span without type.
+ *
+ * Return: True if @key was found, false if not.
+ */
+_c_public_ bool c_dvar_table_lookup(const CDVarTable *table, const char *key, CDVarSpan *span) {
+        const CDVarTableSlot *slot;
+
+        slot = c_dvar_table_find(table, key, c_dvar_table_hash(key, strlen(key)));
+        if (!slot->value) {
+                *span = (CDVarSpan){};
+                return false;
+        }
+
+        *span = (CDVarSpan){
+                .type = table->type,
+                .data = table->data + slot->value,
+                .n_data = slot->n_value,
+                .offset = table->shift + slot->value,
+                .big_endian = table->big_endian,
+        };
+        return true;
+}
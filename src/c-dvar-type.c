@@ -34,7 +34,7 @@ _c_public_ const CDVarType c_dvar_type_g[] = { C_DVAR_T_INIT(C_DVAR_T_g) };
 _c_public_ const CDVarType c_dvar_type_v[] = { C_DVAR_T_INIT(C_DVAR_T_v) };
 _c_public_ const CDVarType c_dvar_type_unit[] = { C_DVAR_T_INIT(C_DVAR_T_TUPLE0) };
 
-static const CDVarType *c_dvar_type_builtins[256] = {
+const CDVarType *const c_dvar_type_builtins[256] = {
         ['y'] = c_dvar_type_y,
         ['b'] = c_dvar_type_b,
         ['n'] = c_dvar_type_n,
@@ -0,0 +1,449 @@
+/*
+ * Validator
+ *
+ * This implements validation of entire values without reading them. It
+ * applies the same rules as the reader, but rather than interpreting format
+ * strings and re-entering the reader for every element, it walks the type and
+ * the data in a single loop with an explicit stack of containers.
+ */
+
+#include <assert.h>
+#include <c-stdaux.h>
+#include <endian.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+
+typedef struct CDVarFrame CDVarFrame;
+
+/**
+ * struct CDVarFrame - Container of the validator
+ * @i_type:             current type position
+ * @n_type:             remaining length after @i_type
+ * @container:          container element
+ * @allocated:          type array owned by this frame, or NULL
+ * @end:                end of the container data
+ */
+struct CDVarFrame {
+        const CDVarType *i_type;
+        size_t n_type;
+        char container;
+        CDVarType *allocated;
+        size_t end;
+};
+
+/*
+ * Align @pos to @alignment (given as power of 2) and verify @n bytes fit into
+ * the current container. Alignment bytes must be zero, unless @trusted is set.
+ * @shift is the offset of @data relative to 8-byte alignment.
+ */
+static int c_dvar_validate_data(const uint8_t *data,
+                                bool trusted,
+                                size_t shift,
+                                size_t *posp,
+                                size_t end,
+                                int alignment,
+                                size_t n) {
+        size_t i, pos, align;
+
+        pos = *posp;
+        align = c_align_to(pos + shift, 1 << alignment) - pos - shift;
+
+        if (_c_unlikely_(end - pos < align + n))
+                return C_DVAR_E_OUT_OF_BOUNDS;
+
+        if (!trusted)
+                for (i = 0; i < align; ++i)
+                        if (_c_unlikely_(data[pos + i]))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+        *posp = pos + align;
+        return 0;
+}
+
+static uint32_t c_dvar_validate_u32(const uint8_t *data, size_t pos, bool big_endian) {
+        return big_endian ? c_load_32be_aligned(data, pos) : c_load_32le_aligned(data, pos);
+}
+
+static int c_dvar_validate_array(const uint8_t *data, size_t pos, size_t n, const CDVarType *type, bool big_endian, bool trusted) {
+        CDVarLayout layout;
+
+        /*
+         * Arrays of fixed-size elements are verified as a whole. Unless the
+         * elements contain padding or booleans, this only needs to verify
+         * the array size is a valid multiple of the element size. Trusted
+         * data only ever needs the latter.
+         */
+        c_dvar_layout_init(&layout, type, big_endian);
+        layout.checked = layout.checked && !trusted;
+        return c_dvar_layout_verify(&layout, data + pos, n, NULL);
+}
+
+static int c_dvar_validate_frames(CDVarFrame *frames,
+                                  bool big_endian,
+                                  bool trusted,
+                                  const CDVarType *types,
+                                  size_t n_types,
+                                  const uint8_t *data,
+                                  size_t shift,
+                                  size_t *posp,
+                                  size_t end,
+                                  size_t base,
+                                  CDVarDeferred **deferredp,
+                                  size_t *depthp) {
+        const CDVarType *type;
+        const char *str;
+        size_t i, n, pos = *posp, depth = 0;
+        CDVarFrame *frame;
+        uint32_t u32;
+        int r;
+
+        frames[0].i_type = types;
+        frames[0].n_type = 0;
+        frames[0].container = 0;
+        frames[0].allocated = NULL;
+        frames[0].end = end;
+
+        for (i = 0; i < n_types; ++i) {
+                frames[0].n_type += types->length;
+                types += types->length;
+        }
+
+        for (;;) {
+                frame = frames + depth;
+                *depthp = depth;
+
+                /*
+                 * Fetch the next type to validate. Arrays repeat their
+                 * element type until their data is consumed, all other
+                 * containers advance until their type is consumed.
+                 */
+                if (frame->container == 'a') {
+                        if (pos == frame->end) {
+                                --depth;
+                                continue;
+                        }
+
+                        type = frame->i_type;
+                } else if (frame->n_type) {
+                        type = frame->i_type;
+                        frame->i_type += type->length;
+                        frame->n_type -= type->length;
+                } else if (depth) {
+                        frame->allocated = c_dvar_type_free(frame->allocated);
+                        --depth;
+                        continue;
+                } else {
+                        break;
+                }
+
+                switch (type->element) {
+                case 'y':
+                case 'n':
+                case 'q':
+                case 'i':
+                case 'h':
+                case 'u':
+                case 'x':
+                case 't':
+                case 'd':
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, type->alignment, type->size);
+                        if (r)
+                                return r;
+
+                        pos += type->size;
+                        break;
+
+                case 'b':
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 2, 4);
+                        if (r)
+                                return r;
+
+                        if (_c_unlikely_(!trusted && c_dvar_validate_u32(data, pos, big_endian) > 1))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+                        pos += 4;
+                        break;
+
+                case 's':
+                case 'o':
+                case 'g':
+                        if (type->element == 'g') {
+                                r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, 1);
+                                if (r)
+                                        return r;
+
+                                n = data[pos++];
+                        } else {
+                                r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 2, 4);
+                                if (r)
+                                        return r;
+
+                                n = c_dvar_validate_u32(data, pos, big_endian);
+                                pos += 4;
+                        }
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, n);
+                        if (r)
+                                return r;
+
+                        str = (const char *)data + pos;
+                        pos += n;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, 1);
+                        if (r)
+                                return r;
+
+                        if (_c_unlikely_(!trusted && data[pos]))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+                        ++pos;
+
+                        /* lazy readers verify the content on c_dvar_end_read() */
+                        if (trusted || (deferredp && c_dvar_defer(deferredp, type->element, str - (const char *)data, n)))
+                                break;
+
+                        if ((type->element == 's' && !c_dvar_is_string(str, n)) ||
+                            (type->element == 'o' && !c_dvar_is_path(str, n)) ||
+                            (type->element == 'g' && !c_dvar_is_signature(str, n)))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+                        break;
+
+                case 'a':
+                        if (_c_unlikely_(base + depth >= C_DVAR_TYPE_DEPTH_MAX - 1))
+                                return C_DVAR_E_DEPTH_OVERFLOW;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 2, 4);
+                        if (r)
+                                return r;
+
+                        u32 = c_dvar_validate_u32(data, pos, big_endian);
+                        pos += 4;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, type[1].alignment, 0);
+                        if (r)
+                                return r;
+
+                        if (_c_unlikely_(u32 > frame->end - pos))
+                                return C_DVAR_E_OUT_OF_BOUNDS;
+
+                        /*
+                         * Fixed-size arrays are jumped over as a whole. The
+                         * reader skips arrays of basic types in bulk, too,
+                         * but walks all other arrays element by element. To
+                         * report the same error, such arrays are walked on
+                         * failure.
+                         */
+                        if (type[1].size) {
+                                r = c_dvar_validate_array(data, pos, u32, type + 1, big_endian, trusted);
+                                if (!r) {
+                                        pos += u32;
+                                        break;
+                                } else if (r < 0 || (type[1].basic && type[1].element != 'b')) {
+                                        return r;
+                                }
+                        }
+
+                        frame = frames + ++depth;
+                        frame->i_type = type + 1;
+                        frame->n_type = type[1].length;
+                        frame->container = 'a';
+                        frame->allocated = NULL;
+                        frame->end = pos + u32;
+                        break;
+
+                case '(':
+                case '{':
+                        if (_c_unlikely_(base + depth >= C_DVAR_TYPE_DEPTH_MAX - 1))
+                                return C_DVAR_E_DEPTH_OVERFLOW;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 3, 0);
+                        if (r)
+                                return r;
+
+                        frame = frames + ++depth;
+                        frame->i_type = type + 1;
+                        frame->n_type = type->length - 2;
+                        frame->container = type->element;
+                        frame->allocated = NULL;
+                        frame->end = (frame - 1)->end;
+                        break;
+
+                case 'v':
+                        if (_c_unlikely_(base + depth >= C_DVAR_TYPE_DEPTH_MAX - 1))
+                                return C_DVAR_E_DEPTH_OVERFLOW;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, 1);
+                        if (r)
+                                return r;
+
+                        n = data[pos++];
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, n);
+                        if (r)
+                                return r;
+
+                        str = (const char *)data + pos;
+                        pos += n;
+
+                        r = c_dvar_validate_data(data, trusted, shift, &pos, frame->end, 0, 1);
+                        if (r)
+                                return r;
+
+                        if (!trusted && (data[pos] || !c_dvar_is_type(str, n)))
+                                return C_DVAR_E_CORRUPT_DATA;
+
+                        ++pos;
+
+                        frame = frames + ++depth;
+                        frame->container = 'v';
+                        frame->allocated = NULL;
+                        frame->end = (frame - 1)->end;
+                        *depthp = depth;
+
+                        /* basic types are by far the most common content */
+                        if (n == 1 && c_dvar_type_builtins[(uint8_t)*str]) {
+                                frame->i_type = c_dvar_type_builtins[(uint8_t)*str];
+                        } else {
+                                r = c_dvar_type_new_from_signature(&frame->allocated, str, n);
+                                if (r > 0 || (!r && frame->allocated->length != n))
+                                        return C_DVAR_E_CORRUPT_DATA;
+                                else if (r)
+                                        return r;
+
+                                frame->i_type = frame->allocated;
+                        }
+
+                        frame->n_type = frame->i_type->length;
+                        break;
+
+                default:
+                        return -ENOTRECOVERABLE;
+                }
+        }
+
+        *posp = pos;
+        return 0;
+}
+
+/**
+ * c_dvar_validate() - validate serialized data
+ * @big_endian:         whether the data is big-endian
+ * @types:              types of the data
+ * @n_types:            number of single complete types in @types
+ * @data:               data to validate
+ * @n_data:             length of @data in bytes
+ *
+ * This validates that @data is a valid serialization of @types. This applies
+ * exactly the same rules as the reader does. That is, the result is the same
+ * as reading the data via c_dvar_begin_read(), skipping all types via
+ * c_dvar_skip() with "*", and finally calling c_dvar_end_read(). However, no
+ * reader is involved, and the data is validated in a single pass without any
+ * format string interpretation.
+ *
+ * Arrays of fixed-size elements are validated as a whole. Unless their
+ * elements contain padding or booleans, this is a constant-time operation.
+ *
+ * Just like with c_dvar_begin_read(), @data must be 8-byte aligned.
+ *
+ * Return: 0 if valid, negative error code on fatal errors, positive error
+ *         code if @data is invalid.
+ */
+_c_public_ int c_dvar_validate(bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data) {
+        CDVarFrame frames[C_DVAR_TYPE_DEPTH_MAX + 1];
+        size_t i, pos = 0, depth = 0;
+        int r;
+
+        assert(data == (void *)c_align_to((unsigned long)data, 8));
+
+        r = c_dvar_validate_frames(frames, big_endian, false, types, n_types, data, 0, &pos, n_data, 0, NULL, &depth);
+
+        for (i = 1; i <= depth; ++i)
+                c_dvar_type_free(frames[i].allocated);
+
+        if (r)
+                return r;
+
+        /* trailing data is not allowed */
+        if (_c_unlikely_(pos != n_data))
+                return C_DVAR_E_CORRUPT_DATA;
+
+        return 0;
+}
+
+/**
+ * c_dvar_validate_token() - validate serialized data and return token
+ * @token:              output argument for the validation token
+ * @big_endian:         whether the data is big-endian
+ * @types:              types of the data
+ * @n_types:            number of single complete types in @types
+ * @data:               data to validate
+ * @n_data:             length of @data in bytes
+ *
+ * This validates @data just like c_dvar_validate() does. On success, @token
+ * is set to refer to @data and @types, so the data can be read via
+ * c_dvar_begin_read_token() without being validated again. The token does
+ * not copy anything. The caller must keep @types and @data valid, and must
+ * not modify @data as long as the token is used.
+ *
+ * Return: 0 if valid, negative error code on fatal errors, positive error
+ *         code if @data is invalid.
+ */
+_c_public_ int c_dvar_validate_token(CDVarToken *token,
+                                     bool big_endian,
+                                     const CDVarType *types,
+                                     size_t n_types,
+                                     const void *data,
+                                     size_t n_data) {
+        int r;
+
+        r = c_dvar_validate(big_endian, types, n_types, data, n_data);
+        if (r)
+                return r;
+
+        *token = (CDVarToken){
+                .types = types,
+                .n_types = n_types,
+                .data = data,
+                .n_data = n_data,
+                .big_endian = big_endian,
+        };
+        return 0;
+}
+
+/*
+ * Validate the single complete type @type, serialized at @posp in @data, and
+ * advance @posp past it. The value must end before @end. @shift is the offset
+ * of @data relative to 8-byte alignment, and @depth the number of containers
+ * the value is nested in, so the depth limit is enforced just like the reader
+ * does. The reader uses this to jump over values it does not need to enter.
+ * If @deferredp is non-NULL, the content of strings, object paths and
+ * signatures is not verified, but recorded there by their offset into @data,
+ * just like lazy readers do for strings they skip. If @trusted is set, only
+ * bounds and structure are verified, just like token readers do.
+ */
+int c_dvar_validate_value(bool big_endian,
+                          bool trusted,
+                          const CDVarType *type,
+                          const uint8_t *data,
+                          size_t shift,
+                          size_t *posp,
+                          size_t end,
+                          size_t depth,
+                          CDVarDeferred **deferredp) {
+        CDVarFrame frames[C_DVAR_TYPE_DEPTH_MAX + 1];
+        size_t i, n_frames = 0;
+        int r;
+
+        r = c_dvar_validate_frames(frames, big_endian, trusted, type, 1, data, shift, posp, end, depth, deferredp, &n_frames);
+
+        for (i = 1; i <= n_frames; ++i)
+                c_dvar_type_free(frames[i].allocated);
+
+        return r;
+}
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <c-stdaux.h>
+#include <endian.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -60,22 +61,29 @@ static int c_dvar_write_u8(CDVar *var, uint8_t v) {
         return c_dvar_write_data(var, 0, &v, sizeof(v));
 }
 
-static int c_dvar_write_u16(CDVar *var, uint16_t v) {
-        v = c_dvar_bswap16(var, v);
+static inline _c_always_inline_ int c_dvar_write_u16(CDVar *var, bool big_endian, uint16_t v) {
+        v = big_endian ? htobe16(v) : htole16(v);
         return c_dvar_write_data(var, 1, &v, sizeof(v));
 }
 
-static int c_dvar_write_u32(CDVar *var, uint32_t v) {
-        v = c_dvar_bswap32(var, v);
+static inline _c_always_inline_ int c_dvar_write_u32(CDVar *var, bool big_endian, uint32_t v) {
+        v = big_endian ? htobe32(v) : htole32(v);
         return c_dvar_write_data(var, 2, &v, sizeof(v));
 }
 
-static int c_dvar_write_u64(CDVar *var, uint64_t v) {
-        v = c_dvar_bswap64(var, v);
+static inline _c_always_inline_ int c_dvar_write_u64(CDVar *var, bool big_endian, uint64_t v) {
+        v = big_endian ? htobe64(v) : htole64(v);
         return c_dvar_write_data(var, 3, &v, sizeof(v));
 }
 
-static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
+/*
+ * Like the reader, the writer is instantiated once for each byte order, so
+ * scalar stores carry no test of the byte order.
+ */
+static inline _c_always_inline_ int c_dvar_try_vwrite_endian(CDVar *var,
+                                                             bool big_endian,
+                                                             const char *format,
+                                                             va_list *args) {
         const CDVarType *type;
         const char *str;
         uint64_t u64;
@@ -95,7 +103,7 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                 switch (c) {
                 case '[':
                         /* write and remember placeholder for array size */
-                        r = c_dvar_write_u32(var, 0);
+                        r = c_dvar_write_u32(var, big_endian, 0);
                         if (r)
                                 return r;
 
@@ -110,7 +118,7 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                         continue; /* do not advance type iterator */
 
                 case '<':
-                        type = va_arg(args, const CDVarType *);
+                        type = va_arg(*args, const CDVarType *);
 
                         r = c_dvar_write_u8(var, type->length);
                         if (r)
@@ -144,7 +152,8 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
 
                 case ']':
                         /* compute array size */
-                        u32 = c_dvar_bswap32(var, var->current->i_buffer - (var->current - 1)->i_buffer);
+                        u32 = var->current->i_buffer - (var->current - 1)->i_buffer;
+                        u32 = big_endian ? htobe32(u32) : htole32(u32);
                         /* write previously written placeholder */
                         *(uint32_t *)&var->data[(var->current - 1)->index] = u32;
 
@@ -158,7 +167,7 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                         break;
 
                 case 'y':
-                        u8 = va_arg(args, int);
+                        u8 = va_arg(*args, int);
                         r = c_dvar_write_u8(var, u8);
                         if (r)
                                 return r;
@@ -166,8 +175,8 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                         break;
 
                 case 'b':
-                        u32 = va_arg(args, int);
-                        r = c_dvar_write_u32(var, !!u32);
+                        u32 = va_arg(*args, int);
+                        r = c_dvar_write_u32(var, big_endian, !!u32);
                         if (r)
                                 return r;
 
@@ -175,8 +184,8 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
 
                 case 'n':
                 case 'q':
-                        u16 = va_arg(args, int);
-                        r = c_dvar_write_u16(var, u16);
+                        u16 = va_arg(*args, int);
+                        r = c_dvar_write_u16(var, big_endian, u16);
                         if (r)
                                 return r;
 
@@ -185,8 +194,8 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                 case 'i':
                 case 'h':
                 case 'u':
-                        u32 = va_arg(args, uint32_t);
-                        r = c_dvar_write_u32(var, u32);
+                        u32 = va_arg(*args, uint32_t);
+                        r = c_dvar_write_u32(var, big_endian, u32);
                         if (r)
                                 return r;
 
@@ -194,8 +203,8 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
 
                 case 'x':
                 case 't':
-                        u64 = va_arg(args, uint64_t);
-                        r = c_dvar_write_u64(var, u64);
+                        u64 = va_arg(*args, uint64_t);
+                        r = c_dvar_write_u64(var, big_endian, u64);
                         if (r)
                                 return r;
 
@@ -210,10 +219,10 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                          * so must be explicitly retrieved as double. We then
                          * copy into u64 to avoid aliasing restrictions.
                          */
-                        fp = va_arg(args, double);
+                        fp = va_arg(*args, double);
                         memcpy(&u64, &fp, sizeof(fp));
 
-                        r = c_dvar_write_u64(var, u64);
+                        r = c_dvar_write_u64(var, big_endian, u64);
                         if (r)
                                 return r;
 
@@ -222,12 +231,12 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
 
                 case 's':
                 case 'o':
-                        str = va_arg(args, const char *);
+                        str = va_arg(*args, const char *);
                         n = strlen(str);
                         if (_c_unlikely_(n > UINT32_MAX))
                                 return -ENOTRECOVERABLE;
 
-                        r = c_dvar_write_u32(var, n);
+                        r = c_dvar_write_u32(var, big_endian, n);
                         if (r)
                                 return r;
 
@@ -238,7 +247,7 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
                         break;
 
                 case 'g':
-                        str = va_arg(args, const char *);
+                        str = va_arg(*args, const char *);
                         n = strlen(str);
                         if (_c_unlikely_(n > UINT8_MAX))
                                 return -ENOTRECOVERABLE;
@@ -273,46 +282,406 @@ static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list args) {
         return 0;
 }
 
-/**
- * c_dvar_begin_write() - XXX
+static int c_dvar_try_vwrite_le(CDVar *var, const char *format, va_list *args) {
+        return c_dvar_try_vwrite_endian(var, false, format, args);
+}
+
+static int c_dvar_try_vwrite_be(CDVar *var, const char *format, va_list *args) {
+        return c_dvar_try_vwrite_endian(var, true, format, args);
+}
+
+static int c_dvar_try_vwrite(CDVar *var, const char *format, va_list *args) {
+        if (var->big_endian)
+                return c_dvar_try_vwrite_be(var, format, args);
+        else
+                return c_dvar_try_vwrite_le(var, format, args);
+}
+
+static inline _c_always_inline_ void c_dvar_run_advance(CDVar *var, size_t n_type) {
+        if (var->current->container != 'a') {
+                var->current->n_type -= n_type;
+                var->current->i_type += n_type;
+        }
+}
+
+/*
+ * Runs the operations of a compiled format program, the counterpart of the
+ * reader. Fixed-size runs are reserved as a whole, and their members are
+ * stored at offsets computed at compile-time.
  */
-_c_public_ void c_dvar_begin_write(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types) {
-        size_t i;
+static inline _c_always_inline_ int c_dvar_try_run_endian(CDVar *var,
+                                                          bool big_endian,
+                                                          const CDVarProgram *program,
+                                                          va_list *args) {
+        const CDVarOp *op, *member, *end;
+        const char *str;
+        uint64_t u64;
+        uint32_t u32;
+        uint16_t u16;
+        uint8_t *data;
+        double fp;
+        size_t n;
+        int r;
 
-        c_dvar_deinit(var);
+        end = program->ops + program->n_ops;
+        for (op = program->ops; op < end; ++op) {
+                switch (op->code) {
+                case C_DVAR_OP_FIXED:
+                        r = c_dvar_write_data(var, op->alignment, NULL, op->offset);
+                        if (r)
+                                return r;
 
-        var->big_endian = big_endian;
+                        data = var->data + var->current->i_buffer - op->offset;
+                        c_memzero(data, op->offset);
+
+                        for (member = op + 1; member <= op + op->n_ops; ++member) {
+                                switch (member->element) {
+                                case 'y':
+                                        data[member->offset] = va_arg(*args, int);
+                                        break;
+                                case 'b':
+                                case 'i':
+                                case 'h':
+                                case 'u':
+                                        if (member->element == 'b')
+                                                u32 = !!va_arg(*args, int);
+                                        else
+                                                u32 = va_arg(*args, uint32_t);
+                                        u32 = big_endian ? htobe32(u32) : htole32(u32);
+                                        memcpy(data + member->offset, &u32, sizeof(u32));
+                                        break;
+                                case 'n':
+                                case 'q':
+                                        u16 = va_arg(*args, int);
+                                        u16 = big_endian ? htobe16(u16) : htole16(u16);
+                                        memcpy(data + member->offset, &u16, sizeof(u16));
+                                        break;
+                                case 'd':
+                                        /* see c_dvar_try_vwrite_endian() */
+                                        fp = va_arg(*args, double);
+                                        memcpy(&u64, &fp, sizeof(fp));
+                                        u64 = big_endian ? htobe64(u64) : htole64(u64);
+                                        memcpy(data + member->offset, &u64, sizeof(u64));
+                                        break;
+                                default:
+                                        u64 = va_arg(*args, uint64_t);
+                                        u64 = big_endian ? htobe64(u64) : htole64(u64);
+                                        memcpy(data + member->offset, &u64, sizeof(u64));
+                                        break;
+                                }
+                        }
+
+                        c_dvar_run_advance(var, op->n_type);
+                        op += op->n_ops;
+                        break;
 
-        var->current = var->levels;
-        var->current->parent_types = (CDVarType *)types;
-        var->current->n_parent_types = n_types;
-        var->current->i_type = (CDVarType *)types;
-        var->current->n_type = 0;
-        var->current->container = 0;
-        var->current->allocated_parent_types = false;
-        var->current->i_buffer = 0;
-        var->current->index = 0;
+                case C_DVAR_OP_STRING:
+                        str = va_arg(*args, const char *);
+                        n = strlen(str);
+
+                        if (op->element == 'g') {
+                                if (_c_unlikely_(n > UINT8_MAX))
+                                        return -ENOTRECOVERABLE;
+
+                                r = c_dvar_write_u8(var, n);
+                        } else {
+                                if (_c_unlikely_(n > UINT32_MAX))
+                                        return -ENOTRECOVERABLE;
+
+                                r = c_dvar_write_u32(var, big_endian, n);
+                        }
+                        if (r)
+                                return r;
+
+                        r = c_dvar_write_data(var, 0, str, n + 1);
+                        if (r)
+                                return r;
+
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_ENTER_ARRAY:
+                        /* write and remember placeholder for array size */
+                        r = c_dvar_write_u32(var, big_endian, 0);
+                        if (r)
+                                return r;
+
+                        var->current->index = var->current->i_buffer - 4;
+
+                        if (op->alignment) {
+                                r = c_dvar_write_data(var, op->alignment, NULL, 0);
+                                if (r)
+                                        return r;
+                        }
+
+                        c_dvar_push(var);
+                        break;
+
+                case C_DVAR_OP_LEAVE_ARRAY:
+                        u32 = var->current->i_buffer - (var->current - 1)->i_buffer;
+                        u32 = big_endian ? htobe32(u32) : htole32(u32);
+                        *(uint32_t *)&var->data[(var->current - 1)->index] = u32;
+
+                        c_dvar_pop(var);
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_ENTER_STRUCT:
+                        if (op->alignment) {
+                                r = c_dvar_write_data(var, op->alignment, NULL, 0);
+                                if (r)
+                                        return r;
+                        }
+
+                        c_dvar_push(var);
+                        --var->current->n_type; /* truncate trailing bracket */
+                        break;
+
+                case C_DVAR_OP_LEAVE_STRUCT:
+                        c_dvar_pop(var);
+                        c_dvar_run_advance(var, op->n_type);
+                        break;
+
+                case C_DVAR_OP_VARIANT:
+                        r = c_dvar_try_vwrite(var, program->format + op->offset, args);
+                        if (r)
+                                return r;
+
+                        break;
 
-        for (i = 0; i < n_types; ++i) {
-                c_assert(var->n_root_type + (uint8_t)types->length >= (uint8_t)types->length);
-                var->n_root_type += types->length;
-                types += types->length;
+                default:
+                        return -ENOTRECOVERABLE;
+                }
         }
 
-        var->current->n_type = var->n_root_type;
+        return 0;
+}
+
+static int c_dvar_try_run_le(CDVar *var, const CDVarProgram *program, va_list *args) {
+        return c_dvar_try_run_endian(var, false, program, args);
+}
+
+static int c_dvar_try_run_be(CDVar *var, const CDVarProgram *program, va_list *args) {
+        return c_dvar_try_run_endian(var, true, program, args);
+}
+
+static int c_dvar_try_run(CDVar *var, const CDVarProgram *program, va_list *args) {
+        if (var->big_endian)
+                return c_dvar_try_run_be(var, program, args);
+        else
+                return c_dvar_try_run_le(var, program, args);
+}
+
+static int c_dvar_write_field(CDVar *var, const CDVarType *type, const CDVarField *fields, const uint8_t *object) {
+        size_t i, n, index, start;
+        const uint8_t *vector;
+        const char *str;
+        uint64_t u64;
+        uint32_t u32;
+        int r;
+
+        switch (type->element) {
+        case 'y':
+                return c_dvar_write_u8(var, *(const uint8_t *)(object + fields->offset));
+
+        case 'b':
+                return c_dvar_write_u32(var, var->big_endian, !!*(const bool *)(object + fields->offset));
+
+        case 'n':
+        case 'q':
+                return c_dvar_write_u16(var, var->big_endian, *(const uint16_t *)(object + fields->offset));
+
+        case 'i':
+        case 'h':
+        case 'u':
+                return c_dvar_write_u32(var, var->big_endian, *(const uint32_t *)(object + fields->offset));
+
+        case 'x':
+        case 't':
+        case 'd':
+                memcpy(&u64, object + fields->offset, sizeof(u64));
+                return c_dvar_write_u64(var, var->big_endian, u64);
+
+        case 's':
+        case 'o':
+        case 'g':
+                str = *(const char * const *)(object + fields->offset);
+                n = strlen(str);
+
+                if (type->element == 'g') {
+                        if (_c_unlikely_(n > UINT8_MAX))
+                                return -ENOTRECOVERABLE;
+
+                        r = c_dvar_write_u8(var, n);
+                } else {
+                        if (_c_unlikely_(n > UINT32_MAX))
+                                return -ENOTRECOVERABLE;
+
+                        r = c_dvar_write_u32(var, var->big_endian, n);
+                }
+                if (r)
+                        return r;
+
+                return c_dvar_write_data(var, 0, str, n + 1);
+
+        case '(':
+        case '{':
+                r = c_dvar_write_data(var, 3, NULL, 0);
+                if (r)
+                        return r;
+
+                for (i = 1; i < type->length - 1u; i += type[i].length) {
+                        r = c_dvar_write_field(var, type + i, fields + i, object);
+                        if (r)
+                                return r;
+                }
+
+                return 0;
+
+        case 'a':
+                /* write placeholder for array size */
+                r = c_dvar_write_u32(var, var->big_endian, 0);
+                if (r)
+                        return r;
+
+                index = var->current->i_buffer - 4;
+
+                /* all arrays contain alignment to enclosed type */
+                r = c_dvar_write_data(var, type[1].alignment, NULL, 0);
+                if (r)
+                        return r;
+
+                start = var->current->i_buffer;
+                vector = *(const uint8_t * const *)(object + fields->offset);
+                n = *(const size_t *)(object + fields->n_offset);
+
+                for (i = 0; i < n; ++i) {
+                        r = c_dvar_write_field(var, type + 1, fields + 1, vector + i * fields->stride);
+                        if (r)
+                                return r;
+                }
+
+                /* write previously written placeholder */
+                u32 = var->current->i_buffer - start;
+                u32 = var->big_endian ? htobe32(u32) : htole32(u32);
+                *(uint32_t *)&var->data[index] = u32;
+                return 0;
+
+        default:
+                /* variants cannot be described by fields */
+                return -ENOTRECOVERABLE;
+        }
+}
+
+static int c_dvar_try_write_struct(CDVar *var, const CDVarField *fields, const void *object) {
+        int r;
+
+        if (_c_unlikely_(!var->current->n_type))
+                return -ENOTRECOVERABLE;
+
+        r = c_dvar_write_field(var, var->current->i_type, fields, object);
+        if (r)
+                return r;
+
+        if (var->current->container != 'a') {
+                var->current->n_type -= var->current->i_type->length;
+                var->current->i_type += var->current->i_type->length;
+        }
+
+        return 0;
+}
+
+/**
+ * c_dvar_begin_write() - XXX
+ */
+_c_public_ void c_dvar_begin_write(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types) {
+        c_dvar_reset(var, big_endian, types, n_types);
 }
 
 /**
  * c_dvar_vwrite() - XXX
  */
 _c_public_ int c_dvar_vwrite(CDVar *var, const char *format, va_list args) {
+        va_list copy;
+        int r;
+
+        c_assert(!var->ro);
+        c_assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        /*
+         * A va_list parameter might decay to a pointer, so the helpers operate
+         * on a local copy, which can be passed on by reference.
+         */
+        va_copy(copy, args);
+        r = c_dvar_try_vwrite(var, format, &copy);
+        va_end(copy);
+
+        return var->poison = r;
+}
+
+/**
+ * c_dvar_program_vwrite() - write data to variant via compiled program
+ * @var:                variant to operate on
+ * @program:            compiled format program
+ * @args:               input arguments
+ *
+ * This is equivalent to c_dvar_vwrite() with the format string @program was
+ * compiled from. However, all type verification that was done when compiling
+ * @program is skipped. The writer must be positioned at the type @program was
+ * compiled against.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on builder failure.
+ */
+_c_public_ int c_dvar_program_vwrite(CDVar *var, const CDVarProgram *program, va_list args) {
+        va_list copy;
+        int r;
+
+        c_assert(!var->ro);
+        c_assert(var->current);
+
+        if (_c_unlikely_(var->poison))
+                return var->poison;
+
+        r = c_dvar_program_verify(var, program);
+        if (r)
+                return var->poison = r;
+
+        va_copy(copy, args);
+        r = c_dvar_try_run(var, program, &copy);
+        va_end(copy);
+
+        return var->poison = r;
+}
+
+/**
+ * c_dvar_write_struct() - write value from C structure
+ * @var:                variant to operate on
+ * @fields:             field descriptors
+ * @object:             C structure to write from
+ *
+ * This is the counterpart of c_dvar_read_struct(). It writes the next single
+ * complete type of @var, taking all values from the caller-defined C
+ * structure @object, as described by @fields. The capacity of arrays is not
+ * used, but the number of elements is taken from the respective counter in
+ * @object.
+ *
+ * Values of variant type cannot be written by this function.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on builder failure.
+ */
+_c_public_ int c_dvar_write_struct(CDVar *var, const CDVarField *fields, const void *object) {
         c_assert(!var->ro);
         c_assert(var->current);
 
         if (_c_unlikely_(var->poison))
                 return var->poison;
 
-        return var->poison = c_dvar_try_vwrite(var, format, args);
+        return var->poison = c_dvar_try_write_struct(var, fields, object);
 }
 
 /**
@@ -38,9 +38,18 @@ _c_public_ void c_dvar_init(CDVar *var) {
  * The object is left in a state equivalent to calling c_dvar_init() on it.
  */
 _c_public_ void c_dvar_deinit(CDVar *var) {
+        CDVarBounce *bounce;
+
         if (var->current)
                 c_dvar_rewind(var);
 
+        while ((bounce = var->bounces)) {
+                var->bounces = bounce->next;
+                free(bounce);
+        }
+
+        free(var->deferred);
+
         if (!var->ro)
                 free(var->data);
 
@@ -121,10 +130,72 @@ _c_public_ void c_dvar_get_parent_types(CDVar *var, const CDVarType **typesp, si
                 *n_typesp = var->current ? var->current->n_parent_types : 0;
 }
 
+/**
+ * c_dvar_set_cache() - attach type cache
+ * @var:                variant to operate on
+ * @cache:              type cache to attach, or NULL
+ *
+ * This attaches the type cache @cache to @var, replacing any previously
+ * attached cache. If @cache is NULL, the current cache is detached.
+ *
+ * Whenever the reader enters a variant without a type provided by the caller,
+ * it looks up the signature in the attached cache first. Only if the
+ * signature was not cached, it is validated, parsed, and then added to the
+ * cache.
+ *
+ * The cache stays attached across c_dvar_begin_read() and
+ * c_dvar_begin_write(), but is detached by c_dvar_deinit(). The caller must
+ * make sure @cache outlives the attachment. Types returned by
+ * c_dvar_get_parent_types() might be owned by the cache. The reader holds a
+ * reference on every cached type it entered, so they stay valid until the
+ * reader leaves them, even if evicted from the cache meanwhile.
+ */
+_c_public_ void c_dvar_set_cache(CDVar *var, CDVarCache *cache) {
+        var->cache = cache;
+}
+
+/**
+ * c_dvar_set_lazy() - enable lazy string verification
+ * @var:                variant to operate on
+ * @lazy:               whether to verify skipped strings lazily
+ *
+ * This enables or disables lazy verification of strings on @var. By default,
+ * the reader verifies the content of every string, object path, and
+ * signature it crosses. A lazy reader verifies only those returned to the
+ * caller right away. Those the caller skips, by passing NULL as output
+ * argument or via c_dvar_skip(), are recorded and verified by
+ * c_dvar_end_read() in a single sweep. Hence, a reader that only picks a few
+ * strings out of a large message defers most of the verification, but still
+ * reports invalid data on c_dvar_end_read(). The sweep verifies all deferred
+ * strings as a batch, which is considerably cheaper than verifying them one
+ * by one while reading.
+ *
+ * Note that the terminating zero of strings is always verified right away.
+ * Values returned as a whole, e.g., by c_dvar_read_span(), are verified right
+ * away as well.
+ *
+ * The setting stays in effect across c_dvar_begin_read() and
+ * c_dvar_begin_write(), but is reset by c_dvar_deinit().
+ */
+_c_public_ void c_dvar_set_lazy(CDVar *var, bool lazy) {
+        var->lazy = lazy;
+}
+
+/*
+ * Release the types owned by @level. Types are either allocated by the
+ * reader, or references to cached types.
+ */
+void c_dvar_release_types(const CDVarLevel *level) {
+        if (level->cached_parent_types)
+                c_dvar_cache_unref(level->parent_types);
+        else
+                free(level->parent_types);
+}
+
 void c_dvar_rewind(CDVar *var) {
         for ( ; var->current > var->levels; --var->current)
                 if (var->current->allocated_parent_types)
-                        free(var->current->parent_types);
+                        c_dvar_release_types(var->current);
 
         /* root-level type is always caller-owned */
         c_assert(!var->current->allocated_parent_types);
@@ -230,6 +301,8 @@ void c_dvar_push(CDVar *var) {
         var->current->n_type = (var->current - 1)->i_type->length - 1;
         var->current->container = (var->current - 1)->i_type->element;
         var->current->allocated_parent_types = false;
+        var->current->parsed_parent_types = false;
+        var->current->cached_parent_types = false;
         var->current->i_buffer = (var->current - 1)->i_buffer;
 
         if (var->ro)
@@ -241,8 +314,15 @@ void c_dvar_push(CDVar *var) {
 void c_dvar_pop(CDVar *var) {
         size_t n;
 
-        if (var->current->allocated_parent_types)
-                free(var->current->parent_types);
+        /*
+         * Levels up to @pinned are saved by the reader, so it can restore
+         * them if a partial read runs out of data. Their types must stay
+         * valid until the reader decides whether to restore them.
+         */
+        if (var->pinned && var->current <= var->pinned)
+                var->pinned = var->current - 1;
+        else if (var->current->allocated_parent_types)
+                c_dvar_release_types(var->current);
 
         --var->current;
 
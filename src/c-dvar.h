@@ -26,8 +26,22 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 
+struct iovec;
+
 typedef struct CDVar CDVar;
+typedef struct CDVarBounce CDVarBounce;
+typedef struct CDVarCache CDVarCache;
+typedef struct CDVarCheckpoint CDVarCheckpoint;
+typedef struct CDVarDeferred CDVarDeferred;
+typedef struct CDVarField CDVarField;
+typedef struct CDVarIndex CDVarIndex;
+typedef struct CDVarKey CDVarKey;
 typedef struct CDVarLevel CDVarLevel;
+typedef struct CDVarPath CDVarPath;
+typedef struct CDVarProgram CDVarProgram;
+typedef struct CDVarSpan CDVarSpan;
+typedef struct CDVarTable CDVarTable;
+typedef struct CDVarToken CDVarToken;
 typedef struct CDVarType CDVarType;
 
 /**
@@ -60,6 +74,29 @@ typedef struct CDVarType CDVarType;
  */
 #define C_DVAR_TYPE_DEPTH_MAX (64)
 
+/**
+ * C_DVAR_CACHE_MAX - Maximum number of types in a type cache
+ *
+ * A type cache stores the parsed types of variant signatures, so they do not
+ * have to be parsed again. Real-world D-Bus traffic uses only a handful of
+ * distinct variant signatures, so a cache is bounded to this number of types.
+ */
+#define C_DVAR_CACHE_MAX (128)
+
+/**
+ * C_DVAR_STRING_ARRAY_MAX() - Maximum number of strings in an array
+ * @_element:           element type, either 's', 'o', or 'g'
+ * @_n_data:            size of the array in bytes
+ *
+ * This evaluates to the maximum number of elements an array of @_n_data bytes
+ * can hold, if its elements are strings, object paths, or signatures. Strings
+ * and object paths occupy at least 8 bytes including padding, except for the
+ * last one, which is not followed by padding. Signatures occupy at least 2
+ * bytes. See c_dvar_read_string_array().
+ */
+#define C_DVAR_STRING_ARRAY_MAX(_element, _n_data) \
+        ((_element) == 'g' ? (_n_data) / 2 : ((_n_data) + 3) / 8)
+
 enum {
         _C_DVAR_E_SUCCESS,
 
@@ -72,6 +109,9 @@ enum {
         C_DVAR_E_CORRUPT_DATA,
         C_DVAR_E_OUT_OF_BOUNDS,
         C_DVAR_E_TYPE_MISMATCH,
+
+        /* stream status */
+        C_DVAR_E_INCOMPLETE_DATA,
 };
 
 /**
@@ -101,6 +141,99 @@ struct CDVarType {
         uint32_t __padding : 3;
 };
 
+/**
+ * struct CDVarField - Field descriptor
+ * @offset:             offset of the member in the C structure
+ * @n_offset:           offset of the element counter, arrays only
+ * @capacity:           capacity of the element vector, arrays only
+ * @stride:             size of a single vector element, arrays only
+ *
+ * Field descriptors map values of a D-Bus type to members of a C structure.
+ * An array of field descriptors is always used in parallel to a CDVarType
+ * array. That is, the i-th descriptor describes the i-th type entry.
+ *
+ * For basic types, @offset is the offset of the member in the C structure.
+ * The member must be a uint8_t for 'y', a bool for 'b', a uint16_t or
+ * int16_t for 'n' and 'q', a uint32_t or int32_t for 'i', 'h' and 'u', a
+ * uint64_t or int64_t for 'x' and 't', a double for 'd', and a `const char *`
+ * for 's', 'o' and 'g'.
+ *
+ * For arrays, @offset is the offset of a pointer to the element vector, and
+ * @n_offset is the offset of a size_t with the number of elements in the
+ * vector. The vector can hold up to @capacity elements, each being @stride
+ * bytes in size. The descriptors following the array describe its element
+ * type, with offsets relative to the start of each vector element.
+ *
+ * The descriptors of tuples, dict entries and their closing brackets are
+ * unused, since their members are described by the following descriptors
+ * with offsets relative to the same structure. Variants cannot be described.
+ */
+struct CDVarField {
+        size_t offset;
+        size_t n_offset;
+        size_t capacity;
+        size_t stride;
+};
+
+/**
+ * struct CDVarKey - Dictionary key
+ * @str:                key of dictionaries with 's', 'o' or 'g' keys
+ * @u64:                key of dictionaries with any other key type
+ *
+ * Dictionary keys are basic types. String-like keys are given as @str.
+ * Integer keys are given as @u64, with signed types sign-extended, so a
+ * negative key can be given as a negative int64_t cast to uint64_t. Booleans
+ * are given as 0 or 1, doubles as their binary representation.
+ */
+struct CDVarKey {
+        const char *str;
+        uint64_t u64;
+};
+
+/**
+ * struct CDVarSpan - Serialized value
+ * @type:               type of the value, or NULL if there is none
+ * @data:               serialized value
+ * @n_data:             length of @data in bytes
+ * @offset:             offset of @data in the surrounding data
+ * @big_endian:         whether @data is big-endian
+ *
+ * A span refers to a single complete value in place, without copying it. It
+ * is returned by c_dvar_read_span(), and can be read via
+ * c_dvar_begin_read_span(). @offset is the position of the
+ * value in the data the span was taken from, as passed to c_dvar_begin_read().
+ * It defines the alignment of the value, and thus its padding.
+ */
+struct CDVarSpan {
+        const CDVarType *type;
+        const void *data;
+        size_t n_data;
+        size_t offset;
+        bool big_endian;
+};
+
+/**
+ * struct CDVarToken - Validation token
+ * @types:              types the data was validated against
+ * @n_types:            number of single complete types in @types
+ * @data:               validated data
+ * @n_data:             length of @data in bytes
+ * @big_endian:         whether @data is big-endian
+ *
+ * A validation token states that @data is a valid serialization of @types.
+ * It is returned by c_dvar_validate_token(), and can be passed to
+ * c_dvar_begin_read_token() to read the data without validating it again.
+ * Producers that are trusted to only ever write valid data can fill in a
+ * token themselves.
+ */
+struct CDVarToken {
+        const CDVarType *types;
+        size_t n_types;
+        const void *data;
+        size_t n_data;
+        bool big_endian;
+};
+
 /**
  * struct CDVarLevel - D-Bus Variant Level information
  * @parent_types:               type information of the parent signature
@@ -109,6 +242,10 @@ struct CDVarType {
  * @n_type:                     remaining length after @i_type
  * @container:                  cached parent container element
  * @allocated_parent_types:     whether @parent_types is owned and allocated
+ * @parsed_parent_types:        whether @parent_types was parsed by the reader,
+ *                              even if owned by a checkpoint
+ * @cached_parent_types:        whether @parent_types is a reference to a cached
+ *                              type, rather than allocated by the reader
  * @i_buffer:                   current data position
  * @n_buffer:                   remaining length after @i_buffer
  * @index:                      cached container-dependent index
@@ -120,6 +257,8 @@ struct CDVarLevel {
         uint8_t n_type;
         uint8_t container : 7;
         uint8_t allocated_parent_types : 1;
+        uint8_t parsed_parent_types : 1;
+        uint8_t cached_parent_types : 1;
         size_t i_buffer;
         union {
                 /* reader */
@@ -133,26 +272,74 @@ struct CDVarLevel {
  * struct CDVar - D-Bus Variant
  * @data:               data buffer to parse or write
  * @n_data:             length of @data in bytes
+ * @n_available:        number of bytes of @data already available, partial reads only
  * @poison:             current object poison error code, or 0
  * @n_root_type:        cached total signature length of the root type
+ * @shift:              offset of @data relative to 8-byte alignment
  * @ro:                 object is read-only
  * @big_endian:         data is provided as big-endian
+ * @partial:            not all data is available, yet
+ * @trusted:            data is known to be valid, content is not verified
+ * @lazy:               skipped strings are verified by c_dvar_end_read()
+ * @cache:              attached type cache, or NULL
+ * @deferred:           skipped strings pending verification, lazy readers only
+ * @vecs:               segments of the data, if read from multiple segments
+ * @n_vecs:             number of segments in @vecs
+ * @i_vec:              cached index of the current segment
+ * @o_vec:              cached data offset of the current segment
+ * @bounces:            linearized copies of values spanning segments
+ * @pinned:             levels up to this one are saved, or NULL
+ * @n_pinned:           number of deferred strings before the current read
  * @current:            current level position
  * @levels:             container levels
  */
 struct CDVar {
         uint8_t *data;
         size_t n_data;
+        size_t n_available;
 
         int poison;
         uint8_t n_root_type;
+        uint8_t shift;
         bool ro : 1;
         bool big_endian : 1;
+        bool partial : 1;
+        bool trusted : 1;
+        bool lazy : 1;
+
+        CDVarCache *cache;
+        CDVarDeferred *deferred;
 
+        const struct iovec *vecs;
+        size_t n_vecs;
+        size_t i_vec;
+        size_t o_vec;
+        CDVarBounce *bounces;
+
+        CDVarLevel *pinned;
+        size_t n_pinned;
         CDVarLevel *current;
         CDVarLevel levels[C_DVAR_TYPE_DEPTH_MAX + 1];
 };
 
+/**
+ * struct CDVarCheckpoint - Reader checkpoint
+ * @poison:             saved poison of the reader
+ * @n_strings:          saved number of deferred strings of the reader
+ * @n_levels:           number of saved levels
+ * @levels:             saved levels
+ *
+ * A checkpoint saves the position of a reader, so it can return to it later.
+ * Only the first @n_levels entries of @levels are used. A checkpoint owns the
+ * variant types of the saved levels the reader allocated.
+ */
+struct CDVarCheckpoint {
+        int poison;
+        size_t n_strings;
+        size_t n_levels;
+        CDVarLevel levels[C_DVAR_TYPE_DEPTH_MAX + 1];
+};
+
 #define C_DVAR_INIT { .big_endian = !!(__BYTE_ORDER == __BIG_ENDIAN) }
 
 /* builtin */
@@ -195,6 +382,39 @@ CDVarType *c_dvar_type_free(CDVarType *type);
 
 int c_dvar_type_compare_string(const CDVarType *subject, const char *object, size_t n_object);
 
+int c_dvar_type_intern(const CDVarType **typep, const char *signature, size_t n_signature);
+const CDVarType *c_dvar_type_ref(const CDVarType *type);
+const CDVarType *c_dvar_type_unref(const CDVarType *type);
+
+/* type cache */
+
+int c_dvar_cache_new(CDVarCache **cachep);
+CDVarCache *c_dvar_cache_free(CDVarCache *cache);
+
+/* format programs */
+
+int c_dvar_program_new(CDVarProgram **programp, const CDVarType *type, const char *format);
+CDVarProgram *c_dvar_program_free(CDVarProgram *program);
+
+/* array index */
+
+CDVarIndex *c_dvar_index_free(CDVarIndex *index);
+size_t c_dvar_index_get_n_elements(const CDVarIndex *index);
+
+CDVarTable *c_dvar_table_free(CDVarTable *table);
+size_t c_dvar_table_get_n_entries(const CDVarTable *table);
+bool c_dvar_table_lookup(const CDVarTable *table, const char *key, CDVarSpan *span);
+
+/* path expressions */
+
+int c_dvar_path_new(CDVarPath **pathp, const CDVarType *type, const char *expression);
+CDVarPath *c_dvar_path_free(CDVarPath *path);
+
+/* validation */
+
+int c_dvar_validate(bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data);
+int c_dvar_validate_token(CDVarToken *token, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data);
+
 /* variant management */
 
 int c_dvar_new(CDVar **varp);
@@ -207,17 +427,47 @@ int c_dvar_get_poison(CDVar *var);
 void c_dvar_get_data(CDVar *var, void **datap, size_t *n_datap);
 void c_dvar_get_root_types(CDVar *var, const CDVarType **typesp, size_t *n_typesp);
 void c_dvar_get_parent_types(CDVar *var, const CDVarType **typesp, size_t *n_typesp);
+void c_dvar_set_cache(CDVar *var, CDVarCache *cache);
+void c_dvar_set_lazy(CDVar *var, bool lazy);
 
 void c_dvar_begin_read(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data);
+void c_dvar_begin_read_shifted(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data, size_t offset);
+void c_dvar_begin_read_vecs(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const struct iovec *vecs, size_t n_vecs);
+void c_dvar_begin_read_partial(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types, const void *data, size_t n_data, size_t n_total);
+void c_dvar_begin_read_token(CDVar *var, const CDVarToken *token);
+void c_dvar_feed(CDVar *var, const void *data, size_t n_data);
 bool c_dvar_more(CDVar *var);
+int c_dvar_peek_type(CDVar *var, const CDVarType **typep);
+int c_dvar_peek_array(CDVar *var, size_t *n_datap, size_t *n_elementsp);
+int c_dvar_peek_variant(CDVar *var, const char **signaturep, size_t *n_signaturep);
 int c_dvar_vread(CDVar *var, const char *format, va_list args);
 int c_dvar_vskip(CDVar *var, const char *format, va_list args);
+int c_dvar_skip_rest(CDVar *var);
+int c_dvar_read_array_view(CDVar *var, const void **elementsp, size_t *n_elementsp, size_t *stridep);
+int c_dvar_read_array_copy(CDVar *var, void *elements, size_t n_elements, size_t *n_elementsp);
+int c_dvar_read_string_array(CDVar *var, const char **strings, size_t *lengths, size_t n_strings, size_t *n_stringsp);
+int c_dvar_program_vread(CDVar *var, const CDVarProgram *program, va_list args);
+int c_dvar_read_struct(CDVar *var, const CDVarField *fields, void *object);
+int c_dvar_read_index(CDVar *var, CDVarIndex **indexp);
+void c_dvar_begin_read_index(CDVar *var, const CDVarIndex *index, size_t i);
+int c_dvar_read_table(CDVar *var, CDVarTable **tablep);
+int c_dvar_read_lookup(CDVar *var, const CDVarKey *key, bool *foundp);
+int c_dvar_read_lookup_many(CDVar *var, const CDVarKey *keys, size_t n_keys, CDVarSpan *values);
+int c_dvar_read_span(CDVar *var, CDVarSpan *span);
+void c_dvar_begin_read_span(CDVar *var, const CDVarSpan *span);
+int c_dvar_read_path(CDVar *var, const CDVarPath *path, CDVarSpan *span);
+void c_dvar_checkpoint_save(CDVar *var, CDVarCheckpoint *checkpoint);
+void c_dvar_checkpoint_restore(CDVar *var, const CDVarCheckpoint *checkpoint);
+void c_dvar_checkpoint_release(CDVar *var, CDVarCheckpoint *checkpoint);
+int c_dvar_clone(CDVar *var, CDVar *clone);
 int c_dvar_end_read(CDVar *var);
 
 bool c_dvar_is_path(const char *string, size_t n_string);
 
 void c_dvar_begin_write(CDVar *var, bool big_endian, const CDVarType *types, size_t n_types);
 int c_dvar_vwrite(CDVar *var, const char *format, va_list args);
+int c_dvar_program_vwrite(CDVar *var, const CDVarProgram *program, va_list args);
+int c_dvar_write_struct(CDVar *var, const CDVarField *fields, const void *object);
 int c_dvar_end_write(CDVar *var, void **datap, size_t *n_datap);
 
 /* inline helpers */
@@ -266,6 +516,72 @@ static inline void c_dvar_type_freep(CDVarType **type) {
                 c_dvar_type_free(*type);
 }
 
+/**
+ * c_dvar_type_unrefp() - release reference to interned type
+ * @type:               interned type to release reference to
+ *
+ * This is the cleanup-helper for c_dvar_type_unref().
+ */
+static inline void c_dvar_type_unrefp(const CDVarType **type) {
+        if (*type)
+                c_dvar_type_unref(*type);
+}
+
+/**
+ * c_dvar_program_freep() - free format program
+ * @program:            program to free
+ *
+ * This is the cleanup-helper for c_dvar_program_free().
+ */
+static inline void c_dvar_program_freep(CDVarProgram **program) {
+        if (*program)
+                c_dvar_program_free(*program);
+}
+
+/**
+ * c_dvar_index_freep() - free array index
+ * @index:              array index to free
+ *
+ * This is the cleanup-helper for c_dvar_index_free().
+ */
+static inline void c_dvar_index_freep(CDVarIndex **index) {
+        if (*index)
+                c_dvar_index_free(*index);
+}
+
+/**
+ * c_dvar_table_freep() - free dictionary table
+ * @table:              dictionary table to free
+ *
+ * This is the cleanup-helper for c_dvar_table_free().
+ */
+static inline void c_dvar_table_freep(CDVarTable **table) {
+        if (*table)
+                c_dvar_table_free(*table);
+}
+
+/**
+ * c_dvar_path_freep() - free path expression
+ * @path:               path expression to free
+ *
+ * This is the cleanup-helper for c_dvar_path_free().
+ */
+static inline void c_dvar_path_freep(CDVarPath **path) {
+        if (*path)
+                c_dvar_path_free(*path);
+}
+
+/**
+ * c_dvar_cache_freep() - free type cache
+ * @cache:              type cache to free
+ *
+ * This is the cleanup-helper for c_dvar_cache_free().
+ */
+static inline void c_dvar_cache_freep(CDVarCache **cache) {
+        if (*cache)
+                c_dvar_cache_free(*cache);
+}
+
 /**
  * c_dvar_freep() - free variant
  * @var:                variant to free
@@ -351,6 +667,48 @@ static inline int c_dvar_write(CDVar *var, const char *format, ...) {
         return r;
 }
 
+/**
+ * c_dvar_program_read() - read data from variant via compiled program
+ * @var:                variant to operate on
+ * @program:            compiled format program
+ *
+ * This is the va_arg-based equivalent of c_dvar_program_vread(). See its
+ * documentation for details.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on parser failure.
+ */
+static inline int c_dvar_program_read(CDVar *var, const CDVarProgram *program, ...) {
+        va_list args;
+        int r;
+
+        va_start(args, program);
+        r = c_dvar_program_vread(var, program, args);
+        va_end(args);
+        return r;
+}
+
+/**
+ * c_dvar_program_write() - write data to variant via compiled program
+ * @var:                variant to operate on
+ * @program:            compiled format program
+ *
+ * This is the va_arg-based equivalent of c_dvar_program_vwrite(). See its
+ * documentation for details.
+ *
+ * Return: 0 on success, negative error code on fatal errors, positive error
+ *         code on builder failure.
+ */
+static inline int c_dvar_program_write(CDVar *var, const CDVarProgram *program, ...) {
+        va_list args;
+        int r;
+
+        va_start(args, program);
+        r = c_dvar_program_vwrite(var, program, args);
+        va_end(args);
+        return r;
+}
+
 #ifdef __cplusplus
 }
 #endif
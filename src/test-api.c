@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include "c-dvar.h"
 #include "c-dvar-type.h"
 
@@ -19,7 +20,14 @@ static void test_api(void) {
         __attribute__((__cleanup__(c_dvar_type_freep))) CDVarType *type = NULL;
         __attribute__((__unused__)) __attribute__((__cleanup__(c_dvar_deinitp))) CDVar *varp = NULL;
         __attribute__((__cleanup__(c_dvar_deinit))) CDVar var = C_DVAR_INIT;
+        __attribute__((__cleanup__(c_dvar_deinit))) CDVar clone = C_DVAR_INIT;
         __attribute__((__cleanup__(c_dvar_freep))) CDVar *heap_var = NULL;
+        __attribute__((__cleanup__(c_dvar_cache_freep))) CDVarCache *cache = NULL;
+        __attribute__((__cleanup__(c_dvar_type_unrefp))) const CDVarType *interned = NULL;
+        __attribute__((__cleanup__(c_dvar_program_freep))) CDVarProgram *program = NULL;
+        __attribute__((__cleanup__(c_dvar_index_freep))) CDVarIndex *index = NULL;
+        __attribute__((__cleanup__(c_dvar_table_freep))) CDVarTable *table = NULL;
+        __attribute__((__cleanup__(c_dvar_path_freep))) CDVarPath *path = NULL;
         static const alignas(8) uint32_t u32 = 7;
         static const CDVarType t = {
                 .size = 4,
@@ -28,8 +36,18 @@ static void test_api(void) {
                 .length = 1,
                 .basic = 1,
         };
+        static const CDVarField field = {};
+        static const CDVarKey key = { .str = "key" };
+        const struct iovec vec = { .iov_base = (void *)&u32, .iov_len = sizeof(u32) };
+        CDVarCheckpoint checkpoint;
+        CDVarToken token;
+        const CDVarType *peeked;
+        const char *signature;
+        CDVarSpan span;
         uint32_t value;
-        size_t n_data;
+        size_t n_data, n, stride;
+        bool found;
+        const void *view;
         void *data;
         int r;
 
@@ -64,12 +82,30 @@ static void test_api(void) {
 
         type = c_dvar_type_free(type);
 
+        r = c_dvar_type_intern(&interned, "u", 1);
+        assert(!r);
+        assert(c_dvar_type_ref(interned) == interned);
+        c_dvar_type_unref(interned);
+        interned = c_dvar_type_unref(interned);
+
         /* heap-allocated variant */
         r = c_dvar_new(&heap_var);
         assert(!r);
 
         heap_var = c_dvar_free(heap_var);
 
+        /* type cache */
+
+        r = c_dvar_cache_new(&cache);
+        assert(!r);
+
+        cache = c_dvar_cache_free(cache);
+
+        /* format programs */
+
+        r = c_dvar_program_new(&program, &t, "u");
+        assert(!r);
+
         /* variant management */
 
         c_dvar_init(&var);
@@ -80,6 +116,8 @@ static void test_api(void) {
         c_dvar_get_data(&var, NULL, NULL);
         c_dvar_get_root_types(&var, NULL, NULL);
         c_dvar_get_parent_types(&var, NULL, NULL);
+        c_dvar_set_cache(&var, NULL);
+        c_dvar_set_lazy(&var, false);
 
         c_dvar_deinit(&var);
 
@@ -95,10 +133,164 @@ static void test_api(void) {
         assert(!r);
         assert(value == 7);
 
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_skip_rest(&var);
+        assert(!r);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+
         assert(c_dvar_is_path("/", strlen("/")));
 
         c_dvar_deinit(&var);
 
+        /* reader extensions */
+
+        c_dvar_init(&var);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_array_view(&var, &view, &n, &stride);
+        assert(r == -ENOTRECOVERABLE);
+        r = c_dvar_read_array_copy(&var, &value, 1, &n);
+        assert(r == -ENOTRECOVERABLE);
+        r = c_dvar_read_string_array(&var, &signature, &n_data, C_DVAR_STRING_ARRAY_MAX('s', 8), &n);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(&var);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_program_read(&var, program, &value);
+        assert(!r);
+        assert(value == 7);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_struct(&var, &field, &value);
+        assert(!r);
+        assert(value == 7);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+
+        r = c_dvar_validate(c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        assert(!r);
+
+        r = c_dvar_validate_token(&token, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        assert(!r);
+        c_dvar_begin_read_token(&var, &token);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        assert(value == 7);
+
+        c_dvar_begin_read_vecs(&var, c_dvar_is_big_endian(&var), &t, 1, &vec, 1);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        assert(value == 7);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_index(&var, &index);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(&var);
+        assert(!index);
+        assert(!c_dvar_index_free(NULL));
+        if (index) {
+                assert(c_dvar_index_get_n_elements(index) == 0);
+                c_dvar_begin_read_index(&var, index, 0);
+        }
+
+        c_dvar_begin_read_shifted(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32), 8);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        assert(value == 7);
+
+        c_dvar_begin_read_partial(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, 0, sizeof(u32));
+        r = c_dvar_read(&var, "u", &value);
+        assert(r == C_DVAR_E_INCOMPLETE_DATA);
+        c_dvar_feed(&var, &u32, sizeof(u32));
+        r = c_dvar_read(&var, "u", &value);
+        assert(!r);
+        assert(value == 7);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_lookup(&var, &key, &found);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(&var);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_lookup_many(&var, &key, 1, &span);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(&var);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_table(&var, &table);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(&var);
+        assert(!table);
+        assert(!c_dvar_table_free(NULL));
+        if (table) {
+                assert(c_dvar_table_get_n_entries(table) == 0);
+                assert(!c_dvar_table_lookup(table, "key", &span));
+        }
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_span(&var, &span);
+        assert(!r);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        assert(span.type == &t && span.data == &u32 && span.n_data == sizeof(u32));
+
+        c_dvar_begin_read_span(&var, &span);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        assert(value == 7);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_peek_type(&var, &peeked);
+        assert(!r);
+        assert(peeked == &t);
+        r = c_dvar_peek_array(&var, &n_data, &n);
+        assert(r == -ENOTRECOVERABLE);
+        r = c_dvar_peek_variant(&var, &signature, &n);
+        assert(r == -ENOTRECOVERABLE);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        c_dvar_checkpoint_save(&var, &checkpoint);
+        c_dvar_read(&var, "u", &value);
+        c_dvar_checkpoint_restore(&var, &checkpoint);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        c_dvar_checkpoint_release(&var, &checkpoint);
+
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_clone(&var, &clone);
+        assert(!r);
+        c_dvar_read(&clone, "u", &value);
+        r = c_dvar_end_read(&clone);
+        assert(!r);
+        c_dvar_read(&var, "u", &value);
+        r = c_dvar_end_read(&var);
+        assert(!r);
+        c_dvar_deinit(&clone);
+
+        r = c_dvar_path_new(&path, &t, "");
+        assert(!r);
+        c_dvar_begin_read(&var, c_dvar_is_big_endian(&var), &t, 1, &u32, sizeof(u32));
+        r = c_dvar_read_path(&var, path, &span);
+        assert(!r);
+        assert(span.type == &t);
+        path = c_dvar_path_free(path);
+        c_dvar_end_read(&var);
+
+        c_dvar_deinit(&var);
+
         /* writer */
 
         c_dvar_init(&var);
@@ -111,6 +303,18 @@ static void test_api(void) {
         assert(n_data);
         free(data);
 
+        c_dvar_begin_write(&var, (__BYTE_ORDER == __BIG_ENDIAN), &t, 1);
+        c_dvar_program_write(&var, program, 0);
+        r = c_dvar_end_write(&var, &data, &n_data);
+        assert(!r);
+        free(data);
+
+        c_dvar_begin_write(&var, (__BYTE_ORDER == __BIG_ENDIAN), &t, 1);
+        c_dvar_write_struct(&var, &field, &value);
+        r = c_dvar_end_write(&var, &data, &n_data);
+        assert(!r);
+        free(data);
+
         c_dvar_deinit(&var);
 }
 
@@ -0,0 +1,3165 @@
+/*
+ * Tests for Reader Extensions
+ *
+ * The basic reader operates on format-strings, one element at a time. This
+ * tests the additional reader operations that work on entire values.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <c-stdaux.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "c-dvar.h"
+#include "c-dvar-private.h"
+#include "c-dvar-type.h"
+
+#define NATIVE_BIG_ENDIAN (__BYTE_ORDER == __BIG_ENDIAN)
+
+static void test_array_view_basic(void) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const uint64_t *elements;
+        size_t n_data, n, stride;
+        const void *p;
+        void *data;
+        int r;
+
+        /*
+         * Write an array of fixed-size integers and verify it can be read as
+         * a view into the buffer, rather than element by element.
+         */
+
+        r = c_dvar_type_new_from_string(&type, "(yat)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, NATIVE_BIG_ENDIAN, type, 1);
+        c_dvar_write(var, "(y[ttt])", 7, UINT64_C(1), UINT64_C(2), UINT64_C(3));
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        c_dvar_read(var, "(y", NULL);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(!r);
+        c_assert(n == 3);
+        c_assert(stride == sizeof(uint64_t));
+        c_assert(p == (uint8_t *)data + 8);
+        elements = p;
+        c_assert(elements[0] == 1);
+        c_assert(elements[1] == 2);
+        c_assert(elements[2] == 3);
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* the view must be rejected for foreign-endian data */
+
+        c_dvar_begin_read(var, !NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        c_dvar_read(var, "(y", NULL);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(r == -ENOTRECOVERABLE);
+        c_assert(!p && !n && !stride);
+        c_dvar_end_read(var);
+
+        /* variable-size elements cannot be viewed */
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_array_view_struct(bool big_endian) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_ARRAY(
+                                C_DVAR_T_TUPLE2(
+                                        C_DVAR_T_y,
+                                        C_DVAR_T_y
+                                )
+                        )
+                ),
+        };
+        static const CDVarType type_padded[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_ARRAY(
+                                C_DVAR_T_TUPLE2(
+                                        C_DVAR_T_u,
+                                        C_DVAR_T_y
+                                )
+                        )
+                ),
+        };
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t n_data, n, stride;
+        const uint8_t *elements;
+        const void *p;
+        uint8_t *data;
+        int r;
+
+        /*
+         * Arrays of fixed-size structures can be viewed as well. Byte-arrays
+         * are independent of the byte-order, so they work in both modes.
+         */
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "[(yy)(yy)]", 1, 2, 3, 4);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(!r);
+        c_assert(n == 2);
+        c_assert(stride == 8);
+        elements = p;
+        c_assert(elements[0] == 1);
+        c_assert(elements[1] == 2);
+        c_assert(elements[8] == 3);
+        c_assert(elements[9] == 4);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* non-zero padding between elements must be rejected */
+
+        data[10] = 0xff;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+
+        /* a trailing partial element must be rejected */
+
+        c_dvar_begin_write(var, NATIVE_BIG_ENDIAN, type_padded, 1);
+        c_dvar_write(var, "[(uy)(uy)]", 1, 2, 3, 4);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+        c_assert(n_data == 8 + 13);
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type_padded, 1, data, n_data);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(!r);
+        c_assert(n == 2);
+        c_assert(stride == 8);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        if (NATIVE_BIG_ENDIAN)
+                data[3] = 12;
+        else
+                data[0] = 12;
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type_padded, 1, data, n_data - 1);
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_array_view_bool(void) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_ARRAY(
+                                C_DVAR_T_b
+                        )
+                ),
+        };
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i, n_data, n, stride;
+        const uint32_t *elements;
+        const void *p;
+        uint32_t *data;
+        int r;
+
+        /*
+         * Booleans must be 0 or 1. Verify a long array of booleans is checked
+         * entirely, including its tail.
+         */
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        n_data = 1 + 67;
+        data = calloc(n_data, sizeof(*data));
+        c_assert(data);
+
+        data[0] = 67 * sizeof(*data);
+        for (i = 1; i < n_data; ++i)
+                data[i] = i % 2;
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data * sizeof(*data));
+        r = c_dvar_read_array_view(var, &p, &n, &stride);
+        c_assert(!r);
+        c_assert(n == 67);
+        c_assert(stride == 4);
+        elements = p;
+        for (i = 0; i < n; ++i)
+                c_assert(elements[i] == (i + 1) % 2);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        for (i = 1; i < n_data; ++i) {
+                data[i] = 2;
+
+                c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data * sizeof(*data));
+                r = c_dvar_read_array_view(var, &p, &n, &stride);
+                c_assert(r == C_DVAR_E_CORRUPT_DATA);
+                c_dvar_end_read(var);
+
+                data[i] = i % 2;
+        }
+
+        free(data);
+}
+
+static void test_array_copy(bool big_endian) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_TUPLE2(
+                                C_DVAR_T_ARRAY(
+                                        C_DVAR_T_t
+                                ),
+                                C_DVAR_T_ARRAY(
+                                        C_DVAR_T_TUPLE4(
+                                                C_DVAR_T_y,
+                                                C_DVAR_T_q,
+                                                C_DVAR_T_b,
+                                                C_DVAR_T_t
+                                        )
+                                )
+                        )
+                ),
+        };
+        struct {
+                uint8_t y;
+                uint16_t q;
+                uint32_t b;
+                uint64_t t;
+        } tuples[3];
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        uint64_t integers[1024];
+        size_t i, n_data, n;
+        void *data;
+        int r;
+
+        static_assert(sizeof(tuples[0]) == 16, "Unexpected structure layout");
+
+        /*
+         * Write arrays of fixed-size elements in either byte-order and verify
+         * they are converted to native byte-order when copied out. This covers
+         * uniform elements, as well as structures with mixed member sizes.
+         */
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "([");
+        for (i = 0; i < 1000; ++i)
+                c_dvar_write(var, "t", (uint64_t)i << 40 | i);
+        c_dvar_write(var, "][");
+        for (i = 0; i < 2; ++i)
+                c_dvar_write(var, "(yqbt)", (int)i + 1, (int)i + 0x100, (int)i, (uint64_t)i << 32 | 7);
+        c_dvar_write(var, "])");
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+        r = c_dvar_read_array_copy(var, integers, sizeof(integers) / sizeof(*integers), &n);
+        c_assert(!r);
+        c_assert(n == 1000);
+        for (i = 0; i < n; ++i)
+                c_assert(integers[i] == ((uint64_t)i << 40 | i));
+        r = c_dvar_read_array_copy(var, tuples, sizeof(tuples) / sizeof(*tuples), &n);
+        c_assert(!r);
+        c_assert(n == 2);
+        for (i = 0; i < n; ++i) {
+                c_assert(tuples[i].y == i + 1);
+                c_assert(tuples[i].q == i + 0x100);
+                c_assert(tuples[i].b == i);
+                c_assert(tuples[i].t == ((uint64_t)i << 32 | 7));
+        }
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* arrays exceeding the buffer are rejected, but can be retried */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+        r = c_dvar_read_array_copy(var, integers, 999, &n);
+        c_assert(r == -ENOBUFS);
+        c_assert(n == 1000);
+        c_assert(!c_dvar_get_poison(var));
+        r = c_dvar_read_array_copy(var, integers, n, &n);
+        c_assert(!r);
+        c_assert(n == 1000);
+        r = c_dvar_read_array_copy(var, tuples, 1, &n);
+        c_assert(r == -ENOBUFS);
+        c_assert(n == 2);
+        r = c_dvar_skip(var, "*)");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data);
+}
+
+static void test_array_copy_padding(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        struct {
+                uint64_t t;
+                uint8_t y;
+        } tuples[2];
+        size_t i, n_data, n;
+        void *data;
+        int r;
+
+        static_assert(sizeof(tuples[0]) == 16, "Unexpected structure layout");
+
+        r = c_dvar_type_new_from_string(&type, "a(ty)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "[(ty)(ty)]", UINT64_C(1), 2, UINT64_C(3), 4);
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        /* the trailing padding of the last element is not left undefined */
+
+        memset(tuples, 0xff, sizeof(tuples));
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_array_copy(var, tuples, 2, &n);
+        c_assert(!r && n == 2);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(tuples[0].t == 1 && tuples[0].y == 2);
+        c_assert(tuples[1].t == 3 && tuples[1].y == 4);
+        for (i = 9; i < sizeof(tuples[1]); ++i)
+                c_assert(!((uint8_t *)&tuples[1])[i]);
+
+        free(data);
+}
+
+static void test_cache(void) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_TUPLE2(
+                                C_DVAR_T_v,
+                                C_DVAR_T_v
+                        )
+                ),
+        };
+        static const CDVarType type_su[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_TUPLE2(
+                                C_DVAR_T_s,
+                                C_DVAR_T_u
+                        )
+                ),
+        };
+        _c_cleanup_(c_dvar_cache_freep) CDVarCache *cache = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const CDVarType *t1, *t2;
+        const char *str;
+        size_t n_data, n;
+        uint32_t u32;
+        void *data;
+        int r;
+
+        /*
+         * Read the same variant signature twice with a cache attached. Both
+         * reads must yield the very same type array, owned by the cache.
+         */
+
+        r = c_dvar_cache_new(&cache);
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_set_cache(var, cache);
+
+        c_dvar_begin_write(var, NATIVE_BIG_ENDIAN, type, 1);
+        c_dvar_write(var, "(<(su)><(su)>)", type_su, "foo", 7, type_su, "bar", 8);
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        c_dvar_read(var, "(<", NULL);
+        c_dvar_get_parent_types(var, &t1, &n);
+        c_assert(n == 1);
+        c_assert(!c_dvar_type_compare_string(t1, "(su)", 4));
+        c_dvar_read(var, "(su)><", &str, &u32, NULL);
+        c_assert(!strcmp(str, "foo"));
+        c_assert(u32 == 7);
+        c_dvar_get_parent_types(var, &t2, &n);
+        c_assert(t1 == t2);
+        c_dvar_read(var, "(su)>)", &str, &u32);
+        c_assert(!strcmp(str, "bar"));
+        c_assert(u32 == 8);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* the cache persists across readers */
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        c_dvar_read(var, "(<", NULL);
+        c_dvar_get_parent_types(var, &t2, &n);
+        c_assert(t1 == t2);
+        c_dvar_skip(var, "*>*)");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* invalid signatures are never cached */
+
+        ((uint8_t *)data)[2] = 'X';
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        r = c_dvar_read(var, "(<", NULL);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        r = c_dvar_read(var, "(<", NULL);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* detached readers allocate their own types */
+
+        c_dvar_deinit(var);
+
+        ((uint8_t *)data)[2] = 's';
+
+        c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+        c_dvar_read(var, "(<", NULL);
+        c_dvar_get_parent_types(var, &t2, &n);
+        c_assert(t1 != t2);
+        c_assert(!c_dvar_type_compare_string(t2, "(su)", 4));
+        c_dvar_skip(var, "*>*)");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data);
+}
+
+static void test_cache_overflow(void) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_ARRAY(
+                                C_DVAR_T_v
+                        )
+                ),
+        };
+        _c_cleanup_(c_dvar_cache_freep) CDVarCache *cache = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *other = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        char format[] = "<(yyyyyyyy)>";
+        size_t i, j, n, n_data, n_data_other;
+        void *data, *data_other;
+        const CDVarType *t1;
+        CDVarType *element;
+        const char *str;
+        int r;
+
+        /*
+         * Use more distinct signatures than fit into the cache. Reading must
+         * succeed regardless, evicting cached types once full.
+         */
+
+        r = c_dvar_cache_new(&cache);
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        r = c_dvar_new(&other);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, NATIVE_BIG_ENDIAN, type, 1);
+        c_dvar_write(var, "[");
+        for (i = 0; i < 2 * C_DVAR_CACHE_MAX; ++i) {
+                for (j = 0; j < 8; ++j)
+                        format[2 + j] = (i & (1 << j)) ? 'u' : 'y';
+
+                element = NULL;
+                r = c_dvar_type_new_from_signature(&element, format + 1, 10);
+                c_assert(!r);
+
+                c_dvar_write(var, format, element, 0, 0, 0, 0, 0, 0, 0, 0);
+                c_dvar_type_free(element);
+        }
+        c_dvar_write(var, "]");
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        c_dvar_set_cache(var, cache);
+
+        for (i = 0; i < 2; ++i) {
+                c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+                c_dvar_read(var, "[");
+                while (c_dvar_more(var))
+                        c_dvar_skip(var, "<*>", NULL);
+                c_dvar_read(var, "]");
+                r = c_dvar_end_read(var);
+                c_assert(!r);
+
+                c_assert(cache->n_types == C_DVAR_CACHE_MAX);
+        }
+
+        /* evicted types stay valid for readers still inside of them */
+
+        element = NULL;
+        r = c_dvar_type_new_from_string(&element, "(s)");
+        c_assert(!r);
+
+        c_dvar_begin_write(other, NATIVE_BIG_ENDIAN, type, 1);
+        c_dvar_write(other, "[<(s)>]", element, "foo");
+        r = c_dvar_end_write(other, &data_other, &n_data_other);
+        c_assert(!r);
+        c_dvar_type_free(element);
+
+        c_dvar_set_cache(other, cache);
+        c_dvar_begin_read(other, NATIVE_BIG_ENDIAN, type, 1, data_other, n_data_other);
+        c_dvar_read(other, "[<", NULL);
+        c_dvar_get_parent_types(other, &t1, &n);
+
+        for (i = 0; i < 2; ++i) {
+                c_dvar_begin_read(var, NATIVE_BIG_ENDIAN, type, 1, data, n_data);
+                c_dvar_read(var, "[");
+                while (c_dvar_more(var))
+                        c_dvar_skip(var, "<*>", NULL);
+                c_dvar_read(var, "]");
+                r = c_dvar_end_read(var);
+                c_assert(!r);
+        }
+
+        for (i = 0; i < C_DVAR_CACHE_SLOTS; ++i)
+                c_assert(cache->slots[i].type != t1);
+
+        c_assert(!c_dvar_type_compare_string(t1, "(s)", 3));
+        c_dvar_read(other, "(s)>]", &str);
+        c_assert(!strcmp(str, "foo"));
+        r = c_dvar_end_read(other);
+        c_assert(!r);
+
+        free(data_other);
+        free(data);
+}
+
+static void test_program(bool big_endian) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_TUPLE4(
+                                C_DVAR_T_y,
+                                C_DVAR_T_ARRAY(
+                                        C_DVAR_T_TUPLE2(
+                                                C_DVAR_T_s,
+                                                C_DVAR_T_u
+                                        )
+                                ),
+                                C_DVAR_T_v,
+                                C_DVAR_T_t
+                        )
+                ),
+        };
+        _c_cleanup_(c_dvar_program_freep) CDVarProgram *program = NULL;
+        _c_cleanup_(c_dvar_program_freep) CDVarProgram *element = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        void *data1, *data2;
+        size_t n_data1, n_data2;
+        const char *s1, *s2;
+        uint32_t u1, u2, u3;
+        uint64_t t;
+        uint8_t y;
+        int r;
+
+        /*
+         * Compile a format string against a type, and verify reading and
+         * writing through the program is equivalent to using the format
+         * string directly.
+         */
+
+        r = c_dvar_program_new(&program, type, "(y[(su)(su)]<u>t)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y[(su)(su)]<u>t)", 7, "foo", 1, "bar", 2, c_dvar_type_u, 3, UINT64_C(4));
+        r = c_dvar_end_write(var, &data1, &n_data1);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_program_write(var, program, 7, "foo", 1, "bar", 2, c_dvar_type_u, 3, UINT64_C(4));
+        r = c_dvar_end_write(var, &data2, &n_data2);
+        c_assert(!r);
+
+        c_assert(n_data1 == n_data2);
+        c_assert(!memcmp(data1, data2, n_data1));
+
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        c_dvar_program_read(var, program, &y, &s1, &u1, &s2, &u2, NULL, &u3, &t);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        c_assert(y == 7);
+        c_assert(!strcmp(s1, "foo") && u1 == 1);
+        c_assert(!strcmp(s2, "bar") && u2 == 2);
+        c_assert(u3 == 3);
+        c_assert(t == 4);
+
+        /* programs can be run repeatedly on array elements */
+
+        r = c_dvar_program_new(&element, type + 3, "(su)");
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        c_dvar_read(var, "(y[", NULL);
+        r = c_dvar_program_read(var, element, &s1, &u1);
+        c_assert(!r);
+        r = c_dvar_program_read(var, element, &s2, &u2);
+        c_assert(!r);
+        c_assert(!strcmp(s1, "foo") && u1 == 1);
+        c_assert(!strcmp(s2, "bar") && u2 == 2);
+        c_dvar_read(var, "]<u>t)", NULL, &u3, &t);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* the content of variants is verified at runtime */
+
+        element = c_dvar_program_free(element);
+        r = c_dvar_program_new(&element, type + 7, "<s>");
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        c_dvar_read(var, "(y[(su)(su)]", NULL, NULL, NULL, NULL, NULL);
+        r = c_dvar_program_read(var, element, NULL, &s1);
+        c_assert(r == -ENOTRECOVERABLE);
+        c_assert(!strcmp(s1, ""));
+        c_dvar_end_read(var);
+
+        /* programs must be run at the type they were compiled against */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        c_dvar_read(var, "(", NULL);
+        r = c_dvar_program_read(var, element, NULL, &s1);
+        c_assert(r == -ENOTRECOVERABLE);
+        c_dvar_end_read(var);
+
+        free(data2);
+        free(data1);
+}
+
+static void test_program_fixed(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_program_freep) CDVarProgram *program = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        void *data1, *data2;
+        size_t n_data1, n_data2;
+        CDVarToken token;
+        uint16_t q;
+        uint32_t i1, i2;
+        uint8_t y1, y2;
+        bool b1, b2, b3;
+        double d;
+        int r;
+
+        /*
+         * Consecutive fixed-size values are combined into runs, with their
+         * padding resolved at compile-time. Verify the result matches the
+         * format string based writer, and that the reader still rejects
+         * non-zero padding and invalid booleans.
+         */
+
+        r = c_dvar_type_new_from_string(&type, "(yb(qy)a(ib)d)");
+        c_assert(!r);
+
+        r = c_dvar_program_new(&program, type, "(yb(qy)[(ib)(ib)]d)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(yb(qy)[(ib)(ib)]d)", 1, true, 2, 3, 4, false, 5, true, 6.5);
+        r = c_dvar_end_write(var, &data1, &n_data1);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_program_write(var, program, 1, true, 2, 3, 4, false, 5, true, 6.5);
+        r = c_dvar_end_write(var, &data2, &n_data2);
+        c_assert(!r);
+
+        c_assert(n_data1 == n_data2);
+        c_assert(!memcmp(data1, data2, n_data1));
+
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        c_dvar_program_read(var, program, &y1, &b1, &q, &y2, &i1, &b2, &i2, &b3, &d);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        c_assert(y1 == 1 && b1 && q == 2 && y2 == 3);
+        c_assert(i1 == 4 && !b2 && i2 == 5 && b3);
+        c_assert(d == 6.5);
+
+        r = c_dvar_validate_token(&token, big_endian, type, 1, data2, n_data2);
+        c_assert(!r);
+
+        /* padding between members of a run must be zero */
+
+        ((uint8_t *)data2)[1] = 1;
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        r = c_dvar_program_read(var, program, &y1, &b1, &q, &y2, &i1, &b2, &i2, &b3, &d);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_assert(!y1 && !b1 && !q && !d);
+        c_dvar_end_read(var);
+
+        /* booleans must be 0 or 1 */
+
+        ((uint8_t *)data2)[1] = 0;
+        ((uint8_t *)data2)[big_endian ? 7 : 4] = 2;
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        r = c_dvar_program_read(var, program, &y1, &b1, &q, &y2, &i1, &b2, &i2, &b3, &d);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_assert(!y1 && !b1);
+        c_dvar_end_read(var);
+
+        /* trusted readers skip both checks */
+
+        ((uint8_t *)data2)[1] = 1;
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_program_read(var, program, &y1, &b1, &q, &y2, &i1, &b2, &i2, &b3, &d);
+        c_assert(!r);
+        c_assert(y1 == 1 && b1 && i2 == 5 && d == 6.5);
+        c_dvar_end_read(var);
+
+        free(data2);
+        free(data1);
+}
+
+static void test_program_invalid(void) {
+        static const char *formats[] = {
+                "(u",
+                "(y[]<u>t))",
+                "(y[]<u>tu",
+                "(y[]<u",
+                "(y[]vt)",
+                "(y[(s)]<u>t)",
+                "(yat)",
+                "*",
+        };
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        CDVarProgram *program;
+        size_t i;
+        int r;
+
+        /*
+         * Formats that do not match the type must be rejected at compile
+         * time, rather than at runtime.
+         */
+
+        r = c_dvar_type_new_from_string(&type, "(ya(su)vt)");
+        c_assert(!r);
+
+        for (i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+                r = c_dvar_program_new(&program, type, formats[i]);
+                c_assert(r == -ENOTRECOVERABLE);
+        }
+
+        r = c_dvar_program_new(&program, type, "(y[]<<<u>>>t)");
+        c_assert(!r);
+        c_dvar_program_free(program);
+}
+
+struct test_item {
+        uint16_t q;
+        bool b;
+};
+
+struct test_object {
+        uint8_t y;
+        const char *s;
+        struct test_item *items;
+        size_t n_items;
+        const char **strings;
+        size_t n_strings;
+        double d;
+};
+
+static void test_struct(bool big_endian) {
+        static const CDVarType type[] = {
+                C_DVAR_T_INIT(
+                        C_DVAR_T_TUPLE5(
+                                C_DVAR_T_y,
+                                C_DVAR_T_s,
+                                C_DVAR_T_ARRAY(
+                                        C_DVAR_T_TUPLE2(
+                                                C_DVAR_T_q,
+                                                C_DVAR_T_b
+                                        )
+                                ),
+                                C_DVAR_T_ARRAY(
+                                        C_DVAR_T_s
+                                ),
+                                C_DVAR_T_d
+                        )
+                ),
+        };
+        CDVarField fields[] = {
+                [1] = { .offset = offsetof(struct test_object, y) },
+                [2] = { .offset = offsetof(struct test_object, s) },
+                [3] = {
+                        .offset = offsetof(struct test_object, items),
+                        .n_offset = offsetof(struct test_object, n_items),
+                        .capacity = 4,
+                        .stride = sizeof(struct test_item),
+                },
+                [5] = { .offset = offsetof(struct test_item, q) },
+                [6] = { .offset = offsetof(struct test_item, b) },
+                [8] = {
+                        .offset = offsetof(struct test_object, strings),
+                        .n_offset = offsetof(struct test_object, n_strings),
+                        .capacity = 4,
+                        .stride = sizeof(const char *),
+                },
+                [9] = { .offset = 0 },
+                [10] = { .offset = offsetof(struct test_object, d) },
+                [11] = {},
+        };
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        struct test_item items[4];
+        const char *strings[4];
+        struct test_object object;
+        void *data1, *data2;
+        size_t n_data1, n_data2;
+        CDVarToken token;
+        int r;
+
+        static_assert(sizeof(fields) / sizeof(*fields) == 12, "Unexpected type length");
+
+        /*
+         * Write a value via the format-string based writer and read it into a
+         * C structure via field descriptors. Then write the structure back
+         * and verify the serialization is identical.
+         */
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(ys[(qb)(qb)(qb)][ss]d)",
+                     7, "foo",
+                     1, true, 2, false, 3, true,
+                     "bar", "baz",
+                     1.5);
+        r = c_dvar_end_write(var, &data1, &n_data1);
+        c_assert(!r);
+
+        memset(&object, 0, sizeof(object));
+        object.items = items;
+        object.strings = strings;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(object.y == 7);
+        c_assert(!strcmp(object.s, "foo"));
+        c_assert(object.n_items == 3);
+        c_assert(items[0].q == 1 && items[0].b);
+        c_assert(items[1].q == 2 && !items[1].b);
+        c_assert(items[2].q == 3 && items[2].b);
+        c_assert(object.n_strings == 2);
+        c_assert(!strcmp(strings[0], "bar"));
+        c_assert(!strcmp(strings[1], "baz"));
+        c_assert(object.d == 1.5);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        r = c_dvar_write_struct(var, fields, &object);
+        c_assert(!r);
+        r = c_dvar_end_write(var, &data2, &n_data2);
+        c_assert(!r);
+
+        c_assert(n_data1 == n_data2);
+        c_assert(!memcmp(data1, data2, n_data1));
+        free(data2);
+
+        /* arrays exceeding the vector capacity must be reported */
+
+        object.n_items = 4;
+        object.n_strings = 0;
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        r = c_dvar_write_struct(var, fields, &object);
+        c_assert(!r);
+        r = c_dvar_end_write(var, &data2, &n_data2);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(!r);
+        c_assert(object.n_items == 4);
+        c_assert(object.n_strings == 0);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        memset(&object, 0, sizeof(object));
+        object.items = items;
+        object.strings = strings;
+        fields[3].capacity = 3;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data2, n_data2);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(r == -ENOBUFS);
+        c_assert(object.n_items == 4);
+        c_assert(!c_dvar_get_poison(var));
+
+        fields[3].capacity = 4;
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(!r);
+        c_assert(object.n_items == 4);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data2);
+
+        fields[8].capacity = 1;
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(r == -ENOBUFS);
+        c_assert(object.n_strings == 2);
+        c_assert(!c_dvar_get_poison(var));
+        c_dvar_end_read(var);
+
+        /*
+         * Lazy readers defer strings that are not stored, but forget them
+         * again if the read is retried with larger vectors.
+         */
+
+        c_dvar_set_lazy(var, true);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(r == -ENOBUFS);
+        c_assert(!var->deferred || !var->deferred->n_strings);
+        c_dvar_end_read(var);
+
+        fields[8].capacity = 4;
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        r = c_dvar_read_struct(var, fields, NULL);
+        c_assert(!r);
+        c_assert(var->deferred->n_strings == 3);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_dvar_set_lazy(var, false);
+
+        r = c_dvar_validate_token(&token, big_endian, type, 1, data1, n_data1);
+        c_assert(!r);
+
+        /* invalid booleans in fixed-size elements must be rejected */
+
+        ((uint8_t *)data1)[24 + 8 + 4 + (big_endian ? 3 : 0)] = 2;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data1, n_data1);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* trusted readers skip all content checks */
+
+        ((uint8_t *)data1)[9] = 0xff;
+        ((uint8_t *)data1)[26] = 0xff;
+
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read_struct(var, fields, &object);
+        c_assert(!r);
+        c_assert(object.s[1] == '\xff');
+        c_assert(items[1].q == 2 && !items[1].b && items[2].b);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data1);
+}
+
+static int test_validate_skip(bool big_endian, const CDVarType *type, const void *data, size_t n_data) {
+        CDVar var = C_DVAR_INIT;
+        int r;
+
+        c_dvar_begin_read(&var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(&var, "*");
+        r = c_dvar_end_read(&var);
+        c_dvar_deinit(&var);
+
+        return r;
+}
+
+static void test_validate_message(bool big_endian) {
+        static const uint8_t values[] = { 0x00, 0x01, 0x2f, 0x61, 0x80, 0xff };
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *type_bs = NULL, *type_at = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i, j, n_data;
+        uint8_t *data, *copy, c;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(yba{sv}aoga(qb)atvd)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&type_bs, "(bs)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&type_at, "at");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(yb[{s<s>}{s<u>}{s<(bs)>}{s<<s>>}{s<[tt]>}][oo]g[(qb)(qb)][tt]<y>d)",
+                     7, true,
+                     "foo", c_dvar_type_s, "bar",
+                     "foo", c_dvar_type_u, 7,
+                     "foo", type_bs, false, "bar",
+                     "foo", c_dvar_type_v, c_dvar_type_s, "bar",
+                     "foo", type_at, 1, 2,
+                     "/foo", "/foo/bar",
+                     "a{sv}",
+                     1, true, 2, false,
+                     UINT64_C(1), UINT64_C(2),
+                     c_dvar_type_y, 7,
+                     1.5);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        r = c_dvar_validate(big_endian, type, 1, data, n_data);
+        c_assert(!r);
+        r = c_dvar_validate(!big_endian, type, 1, data, n_data);
+        c_assert(r == test_validate_skip(!big_endian, type, data, n_data));
+
+        /*
+         * Mutate every single byte of the message and verify the validator
+         * agrees with skipping the message via the reader. This covers
+         * padding, lengths, strings, signatures and booleans.
+         */
+
+        for (i = 0; i < n_data; ++i) {
+                c = data[i];
+
+                for (j = 0; j < sizeof(values) / sizeof(*values); ++j) {
+                        data[i] = values[j];
+                        r = c_dvar_validate(big_endian, type, 1, data, n_data);
+                        c_assert(r == test_validate_skip(big_endian, type, data, n_data));
+                }
+
+                data[i] = c;
+        }
+
+        /* truncated and over-long messages */
+
+        copy = malloc(n_data + 8);
+        c_assert(copy);
+        memcpy(copy, data, n_data);
+        c_memzero(copy + n_data, 8);
+
+        for (i = 0; i <= n_data + 8; ++i) {
+                r = c_dvar_validate(big_endian, type, 1, copy, i);
+                c_assert(r == test_validate_skip(big_endian, type, copy, i));
+                c_assert(!r == (i == n_data));
+        }
+
+        free(copy);
+        free(data);
+}
+
+static void test_validate_depth(void) {
+        alignas(8) uint8_t data[(C_DVAR_TYPE_DEPTH_MAX + 4) * 3 + 1];
+        size_t i, n, n_data;
+        int r;
+
+        /*
+         * Nest variants until the maximum depth is exceeded. The validator
+         * must fail at the same depth as the reader does.
+         */
+
+        for (n = 1; n < C_DVAR_TYPE_DEPTH_MAX + 4; ++n) {
+                n_data = 0;
+
+                for (i = 0; i < n; ++i) {
+                        data[n_data++] = 1;
+                        data[n_data++] = (i + 1 < n) ? 'v' : 'y';
+                        data[n_data++] = 0;
+                }
+
+                data[n_data++] = 7;
+
+                r = c_dvar_validate(NATIVE_BIG_ENDIAN, c_dvar_type_v, 1, data, n_data);
+                c_assert(r == test_validate_skip(NATIVE_BIG_ENDIAN, c_dvar_type_v, data, n_data));
+                c_assert(!r || r == C_DVAR_E_DEPTH_OVERFLOW);
+        }
+}
+
+static void test_vecs_read(bool big_endian, const CDVarType *type, const struct iovec *vecs, size_t n_vecs) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const char *str[10];
+        uint64_t t[3];
+        uint32_t u32;
+        uint8_t y;
+        size_t i, j;
+        int r;
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_read_vecs(var, big_endian, type, 1, vecs, n_vecs);
+        c_dvar_read(var, "(ys[{s<s>}{s<u>}{s<s>}][ooo][ttt]g)",
+                    &y, &str[0],
+                    &str[1], NULL, &str[2],
+                    &str[3], NULL, &u32,
+                    &str[4], NULL, &str[5],
+                    &str[6], &str[7], &str[8],
+                    &t[0], &t[1], &t[2],
+                    &str[9]);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(y == 7);
+        c_assert(!strcmp(str[0], "a string spanning more than a single segment"));
+        c_assert(!strcmp(str[1], "foo"));
+        c_assert(!strcmp(str[2], "bar"));
+        c_assert(!strcmp(str[3], "foobar"));
+        c_assert(u32 == 0xdeadbeef);
+        c_assert(!strcmp(str[4], "baz"));
+        c_assert(!strcmp(str[5], "another string spanning more than a single segment"));
+        c_assert(!strcmp(str[6], "/"));
+        c_assert(!strcmp(str[7], "/foo"));
+        c_assert(!strcmp(str[8], "/foo/bar"));
+        c_assert(t[0] == 1 && t[1] == UINT64_MAX && t[2] == 3);
+        c_assert(!strcmp(str[9], "a{sv}"));
+
+        /*
+         * Strings are either returned in place, including their terminating
+         * zero, or copied if they span segments.
+         */
+        for (i = 0; i < 10; ++i) {
+                for (j = 0; j < n_vecs; ++j)
+                        if (str[i] >= (const char *)vecs[j].iov_base &&
+                            str[i] < (const char *)vecs[j].iov_base + vecs[j].iov_len)
+                                break;
+
+                if (j < n_vecs)
+                        c_assert(str[i] + strlen(str[i]) < (const char *)vecs[j].iov_base + vecs[j].iov_len);
+                else if (n_vecs < 2)
+                        c_assert(0);
+        }
+
+        c_dvar_skip(var, "*");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+}
+
+static void test_vecs(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        struct iovec vecs[128];
+        size_t i, n_vecs, n_data, segment;
+        uint8_t *data;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ysa{sv}aoatg)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(ys[{s<s>}{s<u>}{s<s>}][ooo][ttt]g)",
+                     7, "a string spanning more than a single segment",
+                     "foo", c_dvar_type_s, "bar",
+                     "foobar", c_dvar_type_u, 0xdeadbeef,
+                     "baz", c_dvar_type_s, "another string spanning more than a single segment",
+                     "/", "/foo", "/foo/bar",
+                     UINT64_C(1), UINT64_MAX, UINT64_C(3),
+                     "a{sv}");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /*
+         * Split the message into separately allocated segments of all
+         * possible sizes, and verify it reads the same as in one piece.
+         */
+
+        for (segment = 8; segment <= n_data + 8; segment += 8) {
+                for (i = 0, n_vecs = 0; i < n_data; i += segment, ++n_vecs) {
+                        c_assert(n_vecs + 1 < sizeof(vecs) / sizeof(*vecs));
+                        vecs[n_vecs].iov_len = c_min(segment, n_data - i);
+                        vecs[n_vecs].iov_base = malloc(vecs[n_vecs].iov_len);
+                        c_assert(vecs[n_vecs].iov_base);
+                        memcpy(vecs[n_vecs].iov_base, data + i, vecs[n_vecs].iov_len);
+                }
+
+                test_vecs_read(big_endian, type, vecs, n_vecs);
+
+                /* empty segments are skipped */
+                memmove(vecs + 1, vecs, n_vecs * sizeof(*vecs));
+                vecs[0] = (struct iovec){};
+                test_vecs_read(big_endian, type, vecs, n_vecs + 1);
+                memmove(vecs, vecs + 1, n_vecs * sizeof(*vecs));
+
+                /* truncated data is out of bounds, just like contiguous data */
+                --vecs[n_vecs - 1].iov_len;
+                c_dvar_begin_read_vecs(var, big_endian, type, 1, vecs, n_vecs);
+                c_dvar_skip(var, "*");
+                r = c_dvar_end_read(var);
+                c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+
+                for (i = 0; i < n_vecs; ++i)
+                        free(vecs[i].iov_base);
+        }
+
+        free(data);
+}
+
+static int test_vecs_jump_read(bool big_endian, const CDVarType *type, const uint8_t *data, size_t n_data, size_t segment) {
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        struct iovec vecs[32];
+        size_t i, n_vecs;
+        int r;
+
+        for (i = 0, n_vecs = 0; i < n_data; i += segment, ++n_vecs) {
+                c_assert(n_vecs < sizeof(vecs) / sizeof(*vecs));
+                vecs[n_vecs].iov_len = c_min(segment, n_data - i);
+                vecs[n_vecs].iov_base = (uint8_t *)data + i;
+        }
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_read_vecs(var, big_endian, type, 1, vecs, n_vecs);
+        r = c_dvar_skip(var, "(u**u)", NULL, NULL);
+        if (!r)
+                c_assert(!var->bounces);
+        r = c_dvar_end_read(var);
+
+        return r;
+}
+
+static void test_vecs_jump(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t i, n_data, segment;
+        uint8_t *data;
+        int r;
+
+        /*
+         * Arrays of fixed-size elements are jumped over as a whole, even on
+         * segments. Elements spanning segments must neither be copied into
+         * bounce buffers, nor escape validation. The layout is:
+         *
+         *     0: u, 8: 5x (ybt) of 16 bytes, 88: length, 96: 4x (qy) with a
+         *     stride of 8 bytes, 124: u
+         */
+
+        r = c_dvar_type_new_from_string(&type, "(ua(ybt)a(qy)u)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(u[", 1);
+        for (i = 0; i < 5; ++i)
+                c_dvar_write(var, "(ybt)", (uint8_t)i, !!(i % 2), (uint64_t)i);
+        c_dvar_write(var, "][");
+        for (i = 0; i < 4; ++i)
+                c_dvar_write(var, "(qy)", (uint16_t)i, (uint8_t)i);
+        c_dvar_write(var, "]u)", 2);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+        c_assert(n_data == 128);
+
+        for (segment = 8; segment <= n_data; segment += 8) {
+                r = test_vecs_jump_read(big_endian, type, data, n_data, segment);
+                c_assert(!r);
+
+                /* padding inside an element */
+                data[8 + 3 * 16 + 1] = 1;
+                r = test_vecs_jump_read(big_endian, type, data, n_data, segment);
+                c_assert(r == C_DVAR_E_CORRUPT_DATA);
+                data[8 + 3 * 16 + 1] = 0;
+
+                /* invalid boolean */
+                data[8 + 2 * 16 + (big_endian ? 7 : 4)] = 2;
+                r = test_vecs_jump_read(big_endian, type, data, n_data, segment);
+                c_assert(r == C_DVAR_E_CORRUPT_DATA);
+                data[8 + 2 * 16 + (big_endian ? 7 : 4)] = 0;
+
+                /* padding between elements */
+                data[96 + 1 * 8 + 5] = 1;
+                r = test_vecs_jump_read(big_endian, type, data, n_data, segment);
+                c_assert(r == C_DVAR_E_CORRUPT_DATA);
+                data[96 + 1 * 8 + 5] = 0;
+        }
+
+        free(data);
+}
+
+static void test_partial_feed(CDVar *var, const void *data, size_t *n_availablep, size_t n_data, size_t step) {
+        *n_availablep = c_min(*n_availablep + step, n_data);
+        c_dvar_feed(var, data, *n_availablep);
+}
+
+static void test_partial(size_t step) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *type_bs = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const char *key, *str1, *str2, *str3, *path[3];
+        size_t n_available, n_data;
+        uint64_t t[3];
+        void *data;
+        bool b;
+        uint8_t y;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ysa{sv}aoat)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&type_bs, "(bs)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, NATIVE_BIG_ENDIAN, type, 1);
+        c_dvar_write(var, "(ys[{s<(bs)>}{s<s>}{s<<s>>}][ooo][ttt])",
+                     7, "foo",
+                     "key1", type_bs, true, "bar",
+                     "key2", c_dvar_type_s, "baz",
+                     "key3", c_dvar_type_v, c_dvar_type_s, "foobar",
+                     "/", "/foo", "/foo/bar",
+                     UINT64_C(1), UINT64_C(2), UINT64_C(3));
+        r = c_dvar_end_write(var, &data, &n_data);
+        c_assert(!r);
+
+        /*
+         * Feed the data in chunks of @step bytes, and retry each read until
+         * it no longer runs out of data. Reads are split so they end inside
+         * of variants with allocated types, which must survive retries.
+         */
+
+        n_available = 0;
+        c_dvar_begin_read_partial(var, NATIVE_BIG_ENDIAN, type, 1, data, n_available, n_data);
+
+        while ((r = c_dvar_read(var, "(ys", &y, &str1)) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(y == 7 && !strcmp(str1, "foo"));
+
+        while ((r = c_dvar_read(var, "[{s<", &key, NULL)) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(!strcmp(key, "key1"));
+        c_assert(!c_dvar_get_poison(var));
+
+        while ((r = c_dvar_read(var, "(bs)>}{s<", &b, &str1, &key, NULL)) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(b && !strcmp(str1, "bar"));
+        c_assert(!strcmp(key, "key2"));
+
+        while ((r = c_dvar_read(var, "s>}{s<<", &str2, &key, NULL, NULL)) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(!strcmp(str2, "baz"));
+        c_assert(!strcmp(key, "key3"));
+
+        while ((r = c_dvar_read(var, "s>>}][ooo]", &str3, &path[0], &path[1], &path[2])) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(!strcmp(str3, "foobar"));
+        c_assert(!strcmp(path[0], "/") && !strcmp(path[1], "/foo") && !strcmp(path[2], "/foo/bar"));
+
+        while ((r = c_dvar_read(var, "[ttt])", &t[0], &t[1], &t[2])) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+        c_assert(t[0] == 1 && t[1] == 2 && t[2] == 3);
+
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* skipping resumes just like reading */
+
+        n_available = 0;
+        c_dvar_begin_read_partial(var, NATIVE_BIG_ENDIAN, type, 1, data, n_available, n_data);
+
+        while ((r = c_dvar_skip(var, "*")) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data, step);
+        c_assert(!r);
+
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* data beyond the total length is still out of bounds */
+
+        c_dvar_begin_read_partial(var, NATIVE_BIG_ENDIAN, type, 1, data, 0, n_data - 1);
+        n_available = 0;
+
+        while ((r = c_dvar_skip(var, "*")) == C_DVAR_E_INCOMPLETE_DATA)
+                test_partial_feed(var, data, &n_available, n_data - 1, step);
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_assert(c_dvar_get_poison(var) == C_DVAR_E_OUT_OF_BOUNDS);
+
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_shifted(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        const char *str1, *str2, *str3;
+        uint32_t u1, u2;
+        uint64_t t1, t2;
+        size_t n_data, offset;
+        uint8_t *data, y;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ysa(ut)as)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(ys[(ut)(ut)][ss])",
+                     7, "foo",
+                     1, UINT64_C(2), 3, UINT64_C(4),
+                     "bar", "baz");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /*
+         * Read the message up to some position, and then read the remaining
+         * members in place via a shifted reader. The members are found in
+         * the type array of the tuple, right after the members read so far.
+         */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        c_assert(y == 7);
+        offset = var->current->i_buffer;
+        c_assert(offset % 8);
+
+        c_dvar_begin_read_shifted(sub, big_endian, type + 2, 3, data + offset, n_data - offset, offset);
+        c_dvar_read(sub, "s[(ut)(ut)][ss]", &str1, &u1, &t1, &u2, &t2, &str2, &str3);
+        r = c_dvar_end_read(sub);
+        c_assert(!r);
+        c_assert(!strcmp(str1, "foo"));
+        c_assert(u1 == 1 && t1 == 2 && u2 == 3 && t2 == 4);
+        c_assert(!strcmp(str2, "bar") && !strcmp(str3, "baz"));
+
+        c_dvar_read(var, "s", &str1);
+        offset = var->current->i_buffer;
+        c_assert(offset % 8);
+
+        c_dvar_begin_read_shifted(sub, big_endian, type + 3, 2, data + offset, n_data - offset, offset);
+        c_dvar_skip(sub, "**");
+        r = c_dvar_end_read(sub);
+        c_assert(!r);
+
+        /* only the offset modulo 8 is relevant */
+
+        c_dvar_begin_read_shifted(sub, big_endian, type + 3, 2, data + offset, n_data - offset, offset + 8);
+        c_dvar_skip(sub, "**");
+        r = c_dvar_end_read(sub);
+        c_assert(!r);
+
+        c_dvar_skip(var, "**)");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data);
+}
+
+static void test_index(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_index_freep) CDVarIndex *index = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        const char *str, *key;
+        size_t i, j, n_data;
+        uint32_t u32;
+        uint8_t *data, y;
+        char name[32];
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ya(sa{sv})y)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y[", 7);
+        for (i = 0; i < 100; ++i) {
+                sprintf(name, "/object/%zu", i);
+                c_dvar_write(var, "(s[", name);
+                for (j = 0; j < i % 4; ++j)
+                        c_dvar_write(var, "{s<u>}", "Property", c_dvar_type_u, (uint32_t)(i * j));
+                c_dvar_write(var, "])");
+        }
+        c_dvar_write(var, "]y)", 8);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* index the array while reading the surrounding message */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_index(var, &index);
+        c_assert(!r);
+        c_dvar_read(var, "y)", &y);
+        c_assert(y == 8);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(c_dvar_index_get_n_elements(index) == 100);
+
+        /* read elements in arbitrary order */
+
+        for (i = 0; i < 100; ++i) {
+                c_dvar_begin_read_index(sub, index, (i * 37) % 100);
+                c_dvar_read(sub, "(s[", &str);
+                sprintf(name, "/object/%zu", (i * 37) % 100);
+                c_assert(!strcmp(str, name));
+
+                for (j = 0; c_dvar_more(sub); ++j) {
+                        c_dvar_read(sub, "{s<u>}", &key, c_dvar_type_u, &u32);
+                        c_assert(!strcmp(key, "Property"));
+                        c_assert(u32 == (i * 37) % 100 * j);
+                }
+
+                c_dvar_read(sub, "])");
+                r = c_dvar_end_read(sub);
+                c_assert(!r);
+                c_assert(j == (i * 37) % 100 % 4);
+        }
+
+        /* corrupt elements are rejected when indexing */
+
+        index = c_dvar_index_free(index);
+        for (i = 0; strcmp((const char *)data + i, "/object/99"); ++i)
+                c_assert(i < n_data);
+        data[i + strlen("/object/99")] = 'X';
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_index(var, &index);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_assert(!index);
+        c_dvar_end_read(var);
+
+        free(data);
+        type = c_dvar_type_free(type);
+
+        /* elements of fixed size are indexed by their stride */
+
+        r = c_dvar_type_new_from_string(&type, "(ya(qb)y)");
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y[", 7);
+        for (i = 0; i < 100; ++i)
+                c_dvar_write(var, "(qb)", (uint16_t)i, i % 3 == 0);
+        c_dvar_write(var, "]y)", 8);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_index(var, &index);
+        c_assert(!r);
+        c_dvar_read(var, "y)", &y);
+        c_assert(y == 8);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(c_dvar_index_get_n_elements(index) == 100);
+        c_assert(!index->ends);
+
+        for (i = 0; i < 100; ++i) {
+                uint16_t q;
+                bool b;
+
+                c_dvar_begin_read_index(sub, index, (i * 37) % 100);
+                c_dvar_read(sub, "(qb)", &q, &b);
+                r = c_dvar_end_read(sub);
+                c_assert(!r);
+                c_assert(q == (i * 37) % 100);
+                c_assert(b == (q % 3 == 0));
+        }
+
+        /* invalid booleans are rejected when indexing */
+
+        index = c_dvar_index_free(index);
+        data[8 + 8 * 10 + 4 + (big_endian ? 3 : 0)] = 2;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_index(var, &index);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_assert(!index);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_lookup(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *inner = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        CDVarKey keys[3];
+        CDVarSpan values[3];
+        const char *str;
+        uint64_t u64;
+        uint32_t u32;
+        size_t i, n_data;
+        uint8_t *data;
+        bool found, b;
+        int32_t i32;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(a{sv}a{nt}a{o(ib)})");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "([");
+        c_dvar_write(var, "{s<u>}", "Foo", c_dvar_type_u, 7);
+        c_dvar_write(var, "{s<s>}", "Bar", c_dvar_type_s, "bar");
+        c_dvar_write(var, "{s<s>}", "Bar", c_dvar_type_s, "duplicate");
+        c_dvar_write(var, "{s<u>}", "Baz", c_dvar_type_u, 9);
+        c_dvar_write(var, "][");
+        c_dvar_write(var, "{nt}", (int16_t)1, (uint64_t)10);
+        c_dvar_write(var, "{nt}", (int16_t)-1, (uint64_t)11);
+        c_dvar_write(var, "][");
+        c_dvar_write(var, "{o(ib)}", "/a", -1, true);
+        c_dvar_write(var, "{o(ib)}", "/b", -2, false);
+        c_dvar_write(var, "{o(ib)}", "/c", -3, true);
+        c_dvar_write(var, "])");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* look up single keys and leave the dictionaries as usual */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "Bar" }, &found);
+        c_assert(!r && found);
+        c_dvar_read(var, "<s>}", c_dvar_type_s, &str);
+        c_assert(!strcmp(str, "bar"));
+        for (i = 0; c_dvar_more(var); ++i)
+                c_dvar_skip(var, "*");
+        c_assert(i == 2);
+        c_dvar_read(var, "]");
+
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .u64 = (uint64_t)-1 }, &found);
+        c_assert(!r && found);
+        c_dvar_read(var, "t}", &u64);
+        c_assert(u64 == 11);
+        c_dvar_read(var, "]");
+
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "/d" }, &found);
+        c_assert(!r && !found);
+
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* look up multiple keys in one pass */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+
+        keys[0] = (CDVarKey){ .str = "Baz" };
+        keys[1] = (CDVarKey){ .str = "Qux" };
+        keys[2] = (CDVarKey){ .str = "Bar" };
+        r = c_dvar_read_lookup_many(var, keys, 3, values);
+        c_assert(!r);
+        c_assert(values[0].type && !values[1].type && values[2].type);
+
+        c_dvar_begin_read_span(sub, &values[0]);
+        c_dvar_read(sub, "<u>", c_dvar_type_u, &u32);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && u32 == 9);
+
+        c_dvar_begin_read_span(sub, &values[2]);
+        c_dvar_read(sub, "<s>", c_dvar_type_s, &str);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && !strcmp(str, "bar"));
+
+        c_dvar_skip(var, "*");
+
+        keys[0] = (CDVarKey){ .str = "/c" };
+        keys[1] = (CDVarKey){ .str = "/a" };
+        r = c_dvar_read_lookup_many(var, keys, 2, values);
+        c_assert(!r);
+
+        c_dvar_begin_read_span(sub, &values[0]);
+        c_dvar_read(sub, "(ib)", &i32, &b);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && i32 == -3 && b);
+
+        c_dvar_begin_read_span(sub, &values[1]);
+        c_dvar_read(sub, "(ib)", &i32, &b);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && i32 == -1 && b);
+
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* values jumped over are still validated */
+
+        for (i = 0; strcmp((const char *)data + i, "/b"); ++i)
+                c_assert(i < n_data);
+        data[c_align_to(i + 3, 8) + 4] = 2;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(var, "(**");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "/a" }, &found);
+        c_assert(!r && found);
+        c_dvar_end_read(var);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(var, "(**");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "/c" }, &found);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* so are the keys of entries that do not match */
+
+        for (i = 0; strcmp((const char *)data + i, "Foo"); ++i)
+                c_assert(i < n_data);
+        data[i + 1] = 0xff;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "Baz" }, &found);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        data[i + 1] = 'o';
+
+        for (i = 0; strcmp((const char *)data + i, "duplicate"); ++i)
+                c_assert(i < n_data);
+        data[i + strlen("duplicate")] = 'X';
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "Baz" }, &found);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* lazy readers defer the strings of values jumped over */
+
+        data[i + strlen("duplicate")] = 0;
+        data[i] = 0xff;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_set_lazy(var, true);
+        c_dvar_read(var, "(");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .str = "Baz" }, &found);
+        c_assert(!r && found);
+        c_dvar_read(var, "<u>}]", c_dvar_type_u, &u32);
+        c_assert(u32 == 9);
+        c_dvar_skip(var, "**)");
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_set_lazy(var, true);
+        c_dvar_read(var, "(");
+        keys[0] = (CDVarKey){ .str = "Bar" };
+        r = c_dvar_read_lookup_many(var, keys, 1, values);
+        c_assert(!r && values[0].type);
+        c_dvar_skip(var, "**)");
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        free(data);
+        type = c_dvar_type_free(type);
+
+        /* entries count towards the maximum depth */
+
+        r = c_dvar_type_new_from_string(&type, "(((((((((((((((((((((((((((((((v)))))))))))))))))))))))))))))))");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&inner, "((((((((((((((((((((((((((((((a{yy}))))))))))))))))))))))))))))))");
+        c_assert(!r);
+
+        data = calloc(1, 82);
+        c_assert(data);
+        data[0] = strlen("((((((((((((((((((((((((((((((a{yy}))))))))))))))))))))))))))))))");
+        strcpy((char *)data + 1, "((((((((((((((((((((((((((((((a{yy}))))))))))))))))))))))))))))))");
+        data[big_endian ? 75 : 72] = 2;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, 82);
+        for (i = 0; i < 31; ++i)
+                c_dvar_read(var, "(");
+        c_dvar_read(var, "<", inner);
+        for (i = 0; i < 30; ++i)
+                c_dvar_read(var, "(");
+        r = c_dvar_read_lookup(var, &(CDVarKey){ .u64 = 1 }, &found);
+        c_assert(r == C_DVAR_E_DEPTH_OVERFLOW);
+        c_dvar_end_read(var);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, 82);
+        for (i = 0; i < 31; ++i)
+                c_dvar_read(var, "(");
+        c_dvar_read(var, "<", inner);
+        for (i = 0; i < 30; ++i)
+                c_dvar_read(var, "(");
+        r = c_dvar_read(var, "[{");
+        c_assert(r == C_DVAR_E_DEPTH_OVERFLOW);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_path(bool big_endian) {
+        static const char *const invalid[] = {
+                "[0]", ".4", ".1.0", ".1[", ".1[x]", ".1[0]]", ".2{x}", ".2{-1}",
+                ".2{4294967296}", ".1[0].2{Foo", ".0.", "x",
+        };
+        static const char *const out_of_range[] = {
+                ".0{2}", ".0{9}", ".0{10}", ".1{256}", ".2{-32769}", ".2{32768}",
+        };
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *keys = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        CDVarPath *path;
+        CDVarSpan span;
+        const char *str;
+        size_t i, n_data;
+        uint64_t u64;
+        uint8_t *data;
+        int32_t i32;
+        char name[32];
+        bool b;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ya(sua{sv})a{ut}a(ib))");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y[", 7);
+        for (i = 0; i < 4; ++i) {
+                sprintf(name, "/object/%zu", i);
+                c_dvar_write(var, "(su[", name, (uint32_t)i);
+                c_dvar_write(var, "{s<u>}", "Foo", c_dvar_type_u, (uint32_t)i * 10);
+                c_dvar_write(var, "{s<s>}", "Bar", c_dvar_type_s, name);
+                c_dvar_write(var, "])");
+        }
+        c_dvar_write(var, "][");
+        c_dvar_write(var, "{ut}", 1, (uint64_t)10);
+        c_dvar_write(var, "{ut}", 5, (uint64_t)50);
+        c_dvar_write(var, "][");
+        for (i = 0; i < 8; ++i)
+                c_dvar_write(var, "(ib)", -(int32_t)i, !!(i % 2));
+        c_dvar_write(var, "])");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* invalid paths are rejected at compile time */
+
+        for (i = 0; i < sizeof(invalid) / sizeof(*invalid); ++i) {
+                path = NULL;
+                r = c_dvar_path_new(&path, type, invalid[i]);
+                c_assert(r == -ENOTRECOVERABLE);
+                c_assert(!path);
+        }
+
+        /* keys must be in range of the key type, even single digits */
+
+        r = c_dvar_type_new_from_string(&keys, "(a{bu}a{yu}a{nu})");
+        c_assert(!r);
+
+        for (i = 0; i < sizeof(out_of_range) / sizeof(*out_of_range); ++i) {
+                path = NULL;
+                r = c_dvar_path_new(&path, keys, out_of_range[i]);
+                c_assert(r == -ENOTRECOVERABLE);
+                c_assert(!path);
+        }
+
+        r = c_dvar_path_new(&path, keys, ".0{1}");
+        c_assert(!r);
+        path = c_dvar_path_free(path);
+        r = c_dvar_path_new(&path, keys, ".1{255}");
+        c_assert(!r);
+        path = c_dvar_path_free(path);
+        r = c_dvar_path_new(&path, keys, ".2{-32768}");
+        c_assert(!r);
+        path = c_dvar_path_free(path);
+
+        /* the empty path selects the entire value */
+
+        r = c_dvar_path_new(&path, type, "");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r);
+        c_assert(span.type == type && span.data == data && span.n_data == n_data);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        path = c_dvar_path_free(path);
+
+        /* struct members of array elements, and dictionary values */
+
+        r = c_dvar_path_new(&path, type, ".1[2].0");
+        c_assert(!r);
+        for (i = 0; i < 3; ++i) {
+                /* paths are reusable across messages */
+                c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+                r = c_dvar_read_path(var, path, &span);
+                c_assert(!r);
+                c_dvar_begin_read_span(sub, &span);
+                c_dvar_read(sub, "s", &str);
+                r = c_dvar_end_read(sub);
+                c_assert(!r && !strcmp(str, "/object/2"));
+        }
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".1[3].2{Bar}");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r);
+        c_dvar_begin_read_span(sub, &span);
+        c_dvar_read(sub, "<s>", c_dvar_type_s, &str);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && !strcmp(str, "/object/3"));
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".2{5}");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r);
+        c_dvar_begin_read_span(sub, &span);
+        c_dvar_read(sub, "t", &u64);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && u64 == 50);
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".3[5]");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r);
+        c_dvar_begin_read_span(sub, &span);
+        c_dvar_read(sub, "(ib)", &i32, &b);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && i32 == -5 && b);
+        path = c_dvar_path_free(path);
+
+        /* missing values yield an empty span */
+
+        r = c_dvar_path_new(&path, type, ".1[4].1");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r && !span.type);
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".3[8]");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r && !span.type);
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".2{6}");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r && !span.type);
+        path = c_dvar_path_free(path);
+
+        /* paths must run on the type they were compiled against */
+
+        r = c_dvar_path_new(&path, type + 2, "[0]");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(r == -ENOTRECOVERABLE);
+        path = c_dvar_path_free(path);
+
+        /* skipped elements are verified, elements behind the target are not */
+
+        r = c_dvar_path_new(&path, type, ".3[6]");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r && span.type);
+        i = (const uint8_t *)span.data - data;
+        path = c_dvar_path_free(path);
+
+        data[i + 4] = 2;
+
+        r = c_dvar_path_new(&path, type, ".3[5].1");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(!r && span.type);
+        path = c_dvar_path_free(path);
+
+        r = c_dvar_path_new(&path, type, ".3[7]");
+        c_assert(!r);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_path(var, path, &span);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        path = c_dvar_path_free(path);
+
+        free(data);
+}
+
+static void test_peek(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const CDVarType *peeked;
+        const char *signature, *str;
+        size_t n_msg, n_data, n_elements, n;
+        uint32_t u32;
+        uint8_t *data;
+        int32_t a, b;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ua(ii)asv)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(u[(ii)(ii)(ii)][ss]<s>)",
+                     7, 1, 2, 3, 4, 5, 6, "foo", "bar", c_dvar_type_s, "baz");
+        r = c_dvar_end_write(var, (void **)&data, &n_msg);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_msg);
+
+        r = c_dvar_peek_type(var, &peeked);
+        c_assert(!r && peeked == type);
+        c_dvar_read(var, "(");
+        r = c_dvar_peek_type(var, &peeked);
+        c_assert(!r && peeked == type + 1);
+        c_dvar_read(var, "u", &u32);
+
+        /* peeking is idempotent and does not advance the reader */
+        for (n = 0; n < 2; ++n) {
+                r = c_dvar_peek_array(var, &n_data, &n_elements);
+                c_assert(!r && n_data == 24 && n_elements == 3);
+        }
+        r = c_dvar_peek_variant(var, &signature, NULL);
+        c_assert(r == -ENOTRECOVERABLE);
+        c_assert(!c_dvar_get_poison(var));
+
+        c_dvar_read(var, "[");
+        for (n = 0; c_dvar_more(var); ++n)
+                c_dvar_read(var, "(ii)", &a, &b);
+        c_assert(n == 3);
+        r = c_dvar_peek_type(var, &peeked);
+        c_assert(!r && !peeked);
+        c_dvar_read(var, "]");
+
+        r = c_dvar_peek_array(var, &n_data, &n_elements);
+        c_assert(!r && n_data == 16 && n_elements == SIZE_MAX);
+        c_dvar_skip(var, "*");
+
+        r = c_dvar_peek_variant(var, &signature, &n);
+        c_assert(!r && n == 1 && !strcmp(signature, "s"));
+        c_dvar_read(var, "<s>)", c_dvar_type_s, &str);
+        c_assert(!strcmp(str, "baz"));
+
+        r = c_dvar_peek_type(var, &peeked);
+        c_assert(!r && !peeked);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* errors are reported, but only poison the reader when read */
+
+        data[4 + (big_endian ? 0 : 3)] = 0xff;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_msg);
+        c_dvar_read(var, "(u", &u32);
+        r = c_dvar_peek_array(var, &n_data, &n_elements);
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_assert(!c_dvar_get_poison(var));
+        r = c_dvar_read(var, "[");
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_assert(c_dvar_get_poison(var) == C_DVAR_E_OUT_OF_BOUNDS);
+        r = c_dvar_peek_type(var, &peeked);
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_dvar_end_read(var);
+
+        /* partial data is reported as incomplete */
+
+        c_dvar_begin_read_partial(var, big_endian, type, 1, data, 6, n_msg);
+        c_dvar_read(var, "(u", &u32);
+        r = c_dvar_peek_array(var, &n_data, &n_elements);
+        c_assert(r == C_DVAR_E_INCOMPLETE_DATA);
+        c_assert(!c_dvar_get_poison(var));
+        c_dvar_deinit(var);
+
+        free(data);
+}
+
+static void test_span(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        CDVarSpan spans[5], segmented;
+        const CDVarType *member;
+        struct iovec vecs[64];
+        size_t i, n_data, n_vecs;
+        const char *str;
+        uint8_t *data, y;
+        uint64_t t[3];
+        int32_t i32;
+        bool b;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ysa{sv}at(ib))");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(ys[{s<s>}{s<u>}][ttt](ib))",
+                     7, "a string spanning more than a single segment",
+                     "foo", c_dvar_type_s, "bar",
+                     "foobar", c_dvar_type_u, 0xdeadbeef,
+                     UINT64_C(1), UINT64_MAX, UINT64_C(3),
+                     -7, true);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* spans of all members, and of the entire value */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+        for (i = 0, member = type + 1; i < 5; ++i, member += member->length) {
+                r = c_dvar_read_span(var, spans + i);
+                c_assert(!r);
+                c_assert(spans[i].type == member);
+                c_assert(spans[i].data == data + spans[i].offset);
+        }
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_assert(spans[0].n_data == 1 && spans[0].offset == 0);
+        c_assert(spans[4].n_data == 8 && spans[4].offset + 8 == n_data);
+
+        c_dvar_begin_read_span(sub, spans + 0);
+        c_dvar_read(sub, "y", &y);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && y == 7);
+
+        c_dvar_begin_read_span(sub, spans + 1);
+        c_dvar_read(sub, "s", &str);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && !strcmp(str, "a string spanning more than a single segment"));
+
+        c_dvar_begin_read_span(sub, spans + 2);
+        c_dvar_read(sub, "[{s<s>}", &str, c_dvar_type_s, &str);
+        c_dvar_skip(sub, "{s*}]", NULL);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && !strcmp(str, "bar"));
+
+        c_dvar_begin_read_span(sub, spans + 3);
+        c_dvar_read(sub, "[ttt]", &t[0], &t[1], &t[2]);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && t[0] == 1 && t[1] == UINT64_MAX && t[2] == 3);
+
+        c_dvar_begin_read_span(sub, spans + 4);
+        c_dvar_read(sub, "(ib)", &i32, &b);
+        r = c_dvar_end_read(sub);
+        c_assert(!r && i32 == -7 && b);
+
+        /* segmented readers return the same spans, copied if needed */
+
+        for (i = 0, n_vecs = 0; i < n_data; i += 8, ++n_vecs) {
+                vecs[n_vecs].iov_len = c_min(n_data - i, (size_t)8);
+                vecs[n_vecs].iov_base = malloc(8);
+                c_assert(vecs[n_vecs].iov_base);
+                memcpy(vecs[n_vecs].iov_base, data + i, vecs[n_vecs].iov_len);
+        }
+
+        c_dvar_begin_read_vecs(var, big_endian, type, 1, vecs, n_vecs);
+        c_dvar_read(var, "(");
+        for (i = 0; i < 5; ++i) {
+                r = c_dvar_read_span(var, &segmented);
+                c_assert(!r);
+                c_assert(segmented.type == spans[i].type);
+                c_assert(segmented.offset == spans[i].offset);
+                c_assert(segmented.n_data == spans[i].n_data);
+                c_assert((uintptr_t)segmented.data % 8 == segmented.offset % 8);
+                c_assert(!memcmp(segmented.data, spans[i].data, segmented.n_data));
+        }
+        c_dvar_read(var, ")");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        c_dvar_deinit(var);
+
+        for (i = 0; i < n_vecs; ++i)
+                free(vecs[i].iov_base);
+
+        /* fixed-size values with booleans are still verified */
+
+        data[n_data - 4 + (big_endian ? 0 : 3)] = 1;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(****");
+        c_assert(!r);
+        r = c_dvar_read_span(var, spans);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_checkpoint(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *inner = NULL, *strv = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        CDVarCheckpoint outer, nested;
+        size_t i, n_data;
+        const char *str;
+        uint32_t u32;
+        uint8_t *data;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ua{sv}v)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&inner, "(sv)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&strv, "as");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(u[{s<s>}{s<u>}]<(s<[ss]>)>)",
+                     7, "Foo", c_dvar_type_s, "foo", "Bar", c_dvar_type_u, 9,
+                     inner, "Baz", strv, "a", "b");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* backtrack from failed interpretations inside an array */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(u[", &u32);
+        c_dvar_checkpoint_save(var, &outer);
+
+        for (i = 0; i < 3; ++i) {
+                r = c_dvar_read(var, "{s<u>}", &str, c_dvar_type_u, &u32);
+                c_assert(r == C_DVAR_E_TYPE_MISMATCH);
+                c_assert(c_dvar_get_poison(var) == r);
+                c_dvar_checkpoint_restore(var, &outer);
+                c_assert(!c_dvar_get_poison(var));
+
+                r = c_dvar_read(var, "{s<s>}", &str, c_dvar_type_s, &str);
+                c_assert(!r && !strcmp(str, "foo"));
+                c_dvar_checkpoint_restore(var, &outer);
+        }
+
+        c_dvar_skip(var, "**]");
+
+        /* backtrack into variants, whose types were allocated by the reader */
+
+        c_dvar_read(var, "<(s<", NULL, &str, NULL);
+        c_dvar_checkpoint_save(var, &nested);
+
+        for (i = 0; i < 3; ++i) {
+                r = c_dvar_read(var, "[ss]>)>)", &str, &str);
+                c_assert(!r && !strcmp(str, "b"));
+                r = c_dvar_end_read(var);
+                c_assert(!r);
+
+                c_dvar_checkpoint_restore(var, &nested);
+        }
+
+        c_dvar_checkpoint_release(var, &nested);
+        c_dvar_checkpoint_restore(var, &outer);
+        c_dvar_skip(var, "**]<(s<", NULL, NULL);
+        c_dvar_read(var, "[ss]>)>)", &str, &str);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        c_dvar_checkpoint_release(var, &outer);
+
+        /* types still in use are handed back to the reader on release */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(var, "(u*<(s<", NULL, NULL);
+        c_dvar_checkpoint_save(var, &nested);
+        c_dvar_checkpoint_release(var, &nested);
+        c_dvar_read(var, "[ss]>)>)", &str, &str);
+        r = c_dvar_end_read(var);
+        c_assert(!r && !strcmp(str, "b"));
+
+        free(data);
+}
+
+static void test_clone(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL, *inner = NULL, *strv = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *clone = NULL, *nested = NULL;
+        CDVarCheckpoint checkpoint;
+        const char *str, *str2;
+        size_t n_data;
+        uint32_t u32;
+        uint8_t *data;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ua{sv}v)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&inner, "(sv)");
+        c_assert(!r);
+        r = c_dvar_type_new_from_string(&strv, "as");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&clone);
+        c_assert(!r);
+        r = c_dvar_new(&nested);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(u[{s<s>}{s<u>}]<(s<[ss]>)>)",
+                     7, "Foo", c_dvar_type_s, "foo", "Bar", c_dvar_type_u, 9,
+                     inner, "Baz", strv, "a", "b");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* clones advance independently of each other */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(u[", &u32);
+        r = c_dvar_clone(var, clone);
+        c_assert(!r);
+
+        r = c_dvar_read(var, "{s<s>}", &str, c_dvar_type_s, &str);
+        c_assert(!r && !strcmp(str, "foo"));
+        c_dvar_skip(clone, "*");
+        r = c_dvar_read(clone, "{s<u>}]", &str2, c_dvar_type_u, &u32);
+        c_assert(!r && !strcmp(str2, "Bar") && u32 == 9);
+
+        c_dvar_skip(var, "*]*)");
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+        r = c_dvar_read(clone, "<(s<[ss]>)>)", NULL, &str, NULL, &str, &str2);
+        c_assert(!r && !strcmp(str2, "b"));
+        r = c_dvar_end_read(clone);
+        c_assert(!r);
+
+        /* clones own their variant types, and can outlive the original */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(var, "(u*<(s<[", NULL, NULL);
+        r = c_dvar_clone(var, clone);
+        c_assert(!r);
+        r = c_dvar_clone(clone, nested);
+        c_assert(!r);
+
+        c_dvar_skip(var, "*");
+        c_dvar_deinit(var);
+
+        r = c_dvar_read(clone, "ss]>)>)", &str, &str2);
+        c_assert(!r && !strcmp(str, "a") && !strcmp(str2, "b"));
+        r = c_dvar_end_read(clone);
+        c_assert(!r);
+        c_dvar_deinit(clone);
+
+        r = c_dvar_read(nested, "s", &str);
+        c_assert(!r && !strcmp(str, "a"));
+        c_dvar_deinit(nested);
+
+        /* clones start out with the poison of the original */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(u[{s<u>}", &u32, &str, c_dvar_type_u, &u32);
+        c_assert(r == C_DVAR_E_TYPE_MISMATCH);
+        r = c_dvar_clone(var, clone);
+        c_assert(!r);
+        c_assert(c_dvar_get_poison(clone) == C_DVAR_E_TYPE_MISMATCH);
+
+        /* clones duplicate variant types even if a checkpoint owns them */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_skip(var, "(u*<(", NULL);
+        c_dvar_checkpoint_save(var, &checkpoint);
+        r = c_dvar_clone(var, clone);
+        c_assert(!r);
+        c_dvar_checkpoint_release(var, &checkpoint);
+        c_dvar_deinit(var);
+
+        r = c_dvar_read(clone, "s<[ss]>)>)", &str, NULL, &str, &str2);
+        c_assert(!r && !strcmp(str, "a") && !strcmp(str2, "b"));
+        r = c_dvar_end_read(clone);
+        c_assert(!r);
+
+        free(data);
+}
+
+static void test_fixed_tuple(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        size_t n_data;
+        uint64_t u64;
+        uint32_t u32;
+        uint16_t u16;
+        uint8_t u8, *data;
+        bool b;
+        int r;
+
+        /*
+         * The bounds of fixed-size tuples are checked as a whole when they
+         * are entered. Their members are then read without bounds checks, so
+         * verify truncation is caught on entry, and corruption still caught
+         * on the members.
+         */
+
+        r = c_dvar_type_new_from_string(&type, "(y(bq)tu)");
+        c_assert(!r);
+        c_assert(type->size == 28);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y(bq)tu)", 1, true, 2, (uint64_t)3, 4);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+        c_assert(n_data == 28);
+
+        /* members can be read across multiple calls */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(y", &u8);
+        c_assert(!r && u8 == 1);
+        r = c_dvar_read(var, "(bq)", &b, &u16);
+        c_assert(!r && b && u16 == 2);
+        r = c_dvar_read(var, "tu)", &u64, &u32);
+        c_assert(!r && u64 == 3 && u32 == 4);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* the bounds of the entire tuple are checked on entry */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data - 1);
+        r = c_dvar_read(var, "(", NULL);
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_dvar_end_read(var);
+
+        /* padding is still verified */
+        data[14] = 1;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(y(bq)tu)", &u8, &b, &u16, &u64, &u32);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+        data[14] = 0;
+
+        /* so are booleans */
+        data[big_endian ? 11 : 8] = 2;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(y(bq)tu)", &u8, &b, &u16, &u64, &u32);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+        data[big_endian ? 11 : 8] = 1;
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        free(data);
+}
+
+static void test_token(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const char *str, *path, *signature;
+        CDVarToken token = {};
+        CDVarSpan span;
+        size_t n_data;
+        uint32_t u32;
+        uint8_t *data;
+        bool b;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(sbogva{sv})");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(sbog<u>[{s<s>}])",
+                     "foo", true, "/foo", "a{sv}", c_dvar_type_u, 7,
+                     "bar", c_dvar_type_s, "baz");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* tokens are only returned for valid data */
+        r = c_dvar_validate_token(&token, big_endian, type, 1, data, n_data - 1);
+        c_assert(r > 0);
+        c_assert(!token.data);
+
+        r = c_dvar_validate_token(&token, big_endian, type, 1, data, n_data);
+        c_assert(!r);
+        c_assert(token.types == type && token.data == data && token.n_data == n_data);
+
+        /* trusted readers return the same values */
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read(var, "(sbog<u>[{s<s>}])",
+                        &str, &b, &path, &signature, NULL, &u32, &str, NULL, &str);
+        c_assert(!r);
+        c_assert(b && u32 == 7 && !strcmp(str, "baz"));
+        c_assert(!strcmp(path, "/foo") && !strcmp(signature, "a{sv}"));
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* but still check types and bounds */
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read(var, "(sbog<s>", &str, &b, &path, &signature, c_dvar_type_s, &str);
+        c_assert(r == C_DVAR_E_TYPE_MISMATCH);
+        c_dvar_end_read(var);
+
+        token.n_data = 6;
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read(var, "(s", &str);
+        c_assert(r == C_DVAR_E_OUT_OF_BOUNDS);
+        c_dvar_end_read(var);
+
+        /* a regular reader on the same var verifies content again */
+        data[4] = 0xff;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(s", &str);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* corrupt a boolean, an object path, padding and a nested string */
+        c_assert(n_data == 60);
+        data[9] = 1;
+        data[17] = '/';
+        data[31] = 1;
+        data[56] = 0xff;
+        token.n_data = n_data;
+
+        /* values skipped or spanned by trusted readers are not verified */
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_skip(var, "*");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_span(var, &span);
+        c_assert(!r && span.n_data == 8);
+        r = c_dvar_read_span(var, &span);
+        c_assert(!r && span.n_data == 4);
+        r = c_dvar_read_span(var, &span);
+        c_assert(!r && span.n_data == 9);
+        r = c_dvar_skip_rest(var);
+        c_assert(!r);
+        r = c_dvar_read(var, ")");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_lazy(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *clone = NULL;
+        CDVarCheckpoint checkpoint;
+        const char *str;
+        size_t n_data;
+        uint8_t *data;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(sas)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        r = c_dvar_new(&clone);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(s[ss])", "foo", "bar", "baz");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+        c_assert(n_data == 28);
+
+        c_dvar_set_lazy(var, true);
+
+        /* valid data reads the same, regardless of the setting */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(s*)");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* reads that run out of data do not record their strings twice */
+        c_dvar_begin_read_partial(var, big_endian, type, 1, data, 20, n_data);
+        r = c_dvar_skip(var, "(s[ss])");
+        c_assert(r == C_DVAR_E_INCOMPLETE_DATA);
+        c_assert(var->deferred->n_strings == 0);
+        c_dvar_feed(var, data, n_data);
+        r = c_dvar_skip(var, "(s[ss])");
+        c_assert(!r);
+        c_assert(var->deferred->n_strings == 3);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* restoring a checkpoint drops the strings recorded since */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(s");
+        c_assert(!r);
+        c_dvar_checkpoint_save(var, &checkpoint);
+        r = c_dvar_skip(var, "[ss]");
+        c_assert(!r);
+        c_assert(var->deferred->n_strings == 3);
+        c_dvar_checkpoint_restore(var, &checkpoint);
+        c_assert(var->deferred->n_strings == 1);
+        r = c_dvar_skip(var, "[ss])");
+        c_assert(!r);
+        c_assert(var->deferred->n_strings == 3);
+        c_dvar_checkpoint_release(var, &checkpoint);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* corrupt the first element */
+        data[16] = 0xff;
+
+        /* skipped strings are verified when ending the read */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(s[ss])", &str, NULL, NULL);
+        c_assert(!r);
+        c_assert(!strcmp(str, "foo"));
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        /* values jumped over as a whole defer their strings as well */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(s*)");
+        c_assert(!r);
+        c_assert(var->deferred->n_strings == 3);
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        /* clone the reader while a string is pending */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(s[s");
+        c_assert(!r);
+        r = c_dvar_clone(var, clone);
+        c_assert(!r);
+        r = c_dvar_skip(var, "s])");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        /* clones verify the strings pending at the time of cloning */
+        r = c_dvar_read(clone, "s])", &str);
+        c_assert(!r);
+        c_assert(!strcmp(str, "baz"));
+        r = c_dvar_end_read(clone);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_deinit(clone);
+
+        /* strings returned to the caller are still verified right away */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(s[ss])", NULL, &str, NULL);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        /* eager readers verify skipped strings as well */
+        c_dvar_set_lazy(var, false);
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(s[ss])", NULL, NULL, NULL);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+        type = c_dvar_type_free(type);
+
+        r = c_dvar_type_new_from_string(&type, "(sao)");
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(s[oo])", "b\xc3\xa4r.example", "/foo", "/foo/bar");
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+        c_assert(n_data == 49);
+
+        c_dvar_set_lazy(var, true);
+
+        /* strings beyond plain ASCII are verified one by one */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* object paths are verified, even if all strings are plain ASCII */
+        data[5] = 'a';
+        data[6] = 'a';
+        data[45] = '/';
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        /* the tail of a string is scanned as well */
+        data[45] = 'b';
+        data[15] = 0x80;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(!r);
+        r = c_dvar_end_read(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+
+        free(data);
+}
+
+static void test_string_array(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const char *strings[8];
+        CDVarToken token;
+        size_t lengths[8], n_data, n_elements, n;
+        uint32_t u32;
+        uint8_t *data;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(asagaou)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "([sss][gg][]u)",
+                     "org.example.Foo", "", "bar",
+                     "a{sv}", "",
+                     7);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(");
+
+        /* the array size bounds the number of elements */
+        r = c_dvar_peek_array(var, &n, &n_elements);
+        c_assert(!r && n_elements == SIZE_MAX);
+        c_assert(C_DVAR_STRING_ARRAY_MAX('s', n) >= 3);
+        c_assert(C_DVAR_STRING_ARRAY_MAX('s', n) <= sizeof(strings) / sizeof(*strings));
+
+        r = c_dvar_read_string_array(var, strings, lengths, sizeof(strings) / sizeof(*strings), &n);
+        c_assert(!r && n == 3);
+        c_assert(!strcmp(strings[0], "org.example.Foo") && lengths[0] == 15);
+        c_assert(!strcmp(strings[1], "") && lengths[1] == 0);
+        c_assert(!strcmp(strings[2], "bar") && lengths[2] == 3);
+
+        /* the capacity is checked per element if it is below the bound */
+        r = c_dvar_read_string_array(var, strings, lengths, 2, &n);
+        c_assert(!r && n == 2);
+        c_assert(!strcmp(strings[0], "a{sv}") && lengths[0] == 5);
+        c_assert(!strcmp(strings[1], "") && lengths[1] == 0);
+
+        r = c_dvar_read_string_array(var, strings, lengths, 0, &n);
+        c_assert(!r && n == 0);
+
+        r = c_dvar_read(var, "u)", &u32);
+        c_assert(!r && u32 == 7);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* only arrays of strings are supported */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "(***");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 8, &n);
+        c_assert(r == -ENOTRECOVERABLE && !n);
+        c_dvar_end_read(var);
+
+        /* too many elements report their number, without consuming them */
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 2, &n);
+        c_assert(r == -ENOBUFS && n == 3);
+        c_assert(!c_dvar_get_poison(var));
+        r = c_dvar_read_string_array(var, strings, lengths, n, &n);
+        c_assert(!r && n == 3);
+        c_assert(!strcmp(strings[2], "bar") && lengths[2] == 3);
+        c_dvar_end_read(var);
+
+        /* the content is validated */
+        data[10] = 0xff;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 8, &n);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA && !n);
+        c_dvar_end_read(var);
+
+        /* including embedded zero-bytes */
+        data[10] = 0;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 8, &n);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA && !n);
+        c_dvar_end_read(var);
+        data[10] = 'g';
+
+        /* trusted readers skip all content checks, including the terminator */
+        r = c_dvar_validate_token(&token, big_endian, type, 1, data, n_data);
+        c_assert(!r);
+        data[39] = 'X';
+        c_dvar_begin_read_token(var, &token);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 8, &n);
+        c_assert(!r && n == 3);
+        c_assert(!strncmp(strings[2], "bar", 3) && lengths[2] == 3);
+        c_dvar_end_read(var);
+        data[39] = 0;
+
+        /* as is the padding between elements */
+        data[29] = 1;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "(");
+        c_assert(!r);
+        r = c_dvar_read_string_array(var, strings, lengths, 8, &n);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA && !n);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_table(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_table_freep) CDVarTable *table = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL, *sub = NULL;
+        const char *str;
+        size_t i, n_data;
+        CDVarSpan span;
+        uint32_t u32;
+        uint8_t *data, y;
+        char name[32];
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(ya{sv}y)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+        r = c_dvar_new(&sub);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "(y[", 7);
+        for (i = 0; i < 100; ++i) {
+                sprintf(name, "Property%zu", i);
+                if (i % 2)
+                        c_dvar_write(var, "{s<u>}", name, c_dvar_type_u, (uint32_t)i);
+                else
+                        c_dvar_write(var, "{s<s>}", name, c_dvar_type_s, name);
+        }
+        c_dvar_write(var, "{s<u>}", "Property1", c_dvar_type_u, 0);
+        c_dvar_write(var, "{s<u>}", "", c_dvar_type_u, 200);
+        c_dvar_write(var, "]y)", 8);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* build the table while reading the surrounding message */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_table(var, &table);
+        c_assert(!r);
+        c_dvar_read(var, "y)", &y);
+        c_assert(y == 8);
+        r = c_dvar_end_read(var);
+        c_assert(!r);
+
+        /* duplicate keys are only counted once */
+        c_assert(c_dvar_table_get_n_entries(table) == 101);
+
+        /* look up values in arbitrary order */
+
+        for (i = 0; i < 100; ++i) {
+                sprintf(name, "Property%zu", (i * 37) % 100);
+                c_assert(c_dvar_table_lookup(table, name, &span));
+                c_assert(span.type && span.type->element == 'v');
+
+                c_dvar_begin_read_span(sub, &span);
+                if ((i * 37) % 2) {
+                        c_dvar_read(sub, "<u>", c_dvar_type_u, &u32);
+                        c_assert(u32 == (i * 37) % 100);
+                } else {
+                        c_dvar_read(sub, "<s>", c_dvar_type_s, &str);
+                        c_assert(!strcmp(str, name));
+                }
+                r = c_dvar_end_read(sub);
+                c_assert(!r);
+        }
+
+        /* the first entry of a key wins */
+        c_assert(c_dvar_table_lookup(table, "Property1", &span));
+        c_dvar_begin_read_span(sub, &span);
+        c_dvar_read(sub, "<u>", c_dvar_type_u, &u32);
+        c_assert(u32 == 1);
+        r = c_dvar_end_read(sub);
+        c_assert(!r);
+
+        c_assert(c_dvar_table_lookup(table, "", &span));
+        c_dvar_begin_read_span(sub, &span);
+        c_dvar_read(sub, "<u>", c_dvar_type_u, &u32);
+        c_assert(u32 == 200);
+        r = c_dvar_end_read(sub);
+        c_assert(!r);
+
+        c_assert(!c_dvar_table_lookup(table, "Property100", &span));
+        c_assert(!span.type);
+        c_assert(!c_dvar_table_lookup(table, "Property", &span));
+
+        table = c_dvar_table_free(table);
+
+        /* only dictionaries with string keys are supported */
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read_table(var, &table);
+        c_assert(r == -ENOTRECOVERABLE && !table);
+        c_dvar_end_read(var);
+
+        /* entries are validated */
+
+        data[8 + 4 + 2] = 0xff;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        c_dvar_read(var, "(y", &y);
+        r = c_dvar_read_table(var, &table);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA && !table);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+static void test_skip_rest(bool big_endian) {
+        _c_cleanup_(c_dvar_type_freep) CDVarType *type = NULL;
+        _c_cleanup_(c_dvar_freep) CDVar *var = NULL;
+        const char *str;
+        size_t i, n_data;
+        uint32_t u32;
+        uint8_t *data;
+        bool b;
+        int r;
+
+        r = c_dvar_type_new_from_string(&type, "(a(yb)a(ii)asva{sv}u)");
+        c_assert(!r);
+
+        r = c_dvar_new(&var);
+        c_assert(!r);
+
+        c_dvar_begin_write(var, big_endian, type, 1);
+        c_dvar_write(var, "([");
+        for (i = 0; i < 16; ++i)
+                c_dvar_write(var, "(yb)", (uint8_t)i, !!(i % 2));
+        c_dvar_write(var, "][");
+        for (i = 0; i < 16; ++i)
+                c_dvar_write(var, "(ii)", (int32_t)i, -(int32_t)i);
+        c_dvar_write(var, "][sss]<s>[{s<u>}{s<s>}]u)",
+                     "foo", "bar", "baz",
+                     c_dvar_type_s, "variant",
+                     "a", c_dvar_type_u, 1, "b", c_dvar_type_s, "b",
+                     7);
+        r = c_dvar_end_write(var, (void **)&data, &n_data);
+        c_assert(!r);
+
+        /* skip the rest of each container, after reading its first element */
+        for (i = 0; i < 2; ++i) {
+                c_dvar_set_lazy(var, i);
+                c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+
+                r = c_dvar_read(var, "([(yb)", NULL, &b);
+                c_assert(!r && !b);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, "][(i", &u32);
+                c_assert(!r && u32 == 0);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, ")");
+                c_assert(!r);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, "][s", &str);
+                c_assert(!r && !strcmp(str, "foo"));
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, "]<", c_dvar_type_s);
+                c_assert(!r);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, ">[{s", &str);
+                c_assert(!r && !strcmp(str, "a"));
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, "}");
+                c_assert(!r);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, "]");
+                c_assert(!r);
+                r = c_dvar_skip_rest(var);
+                c_assert(!r);
+                r = c_dvar_read(var, ")");
+                c_assert(!r);
+                r = c_dvar_end_read(var);
+                c_assert(!r);
+        }
+
+        /* a truncated element is corrupt, just like when reading "]" */
+        data[big_endian ? 3 : 0] = 8 * 16 - 3;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "([(yb)", NULL, &b);
+        c_assert(!r);
+        r = c_dvar_skip_rest(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        data[big_endian ? 3 : 0] = 8 * 16;
+
+        /* fixed-size elements are still validated */
+        data[4 + 4 * 16 + 3] = 2;
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_read(var, "([");
+        c_assert(!r);
+        r = c_dvar_skip_rest(var);
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        c_dvar_begin_read(var, big_endian, type, 1, data, n_data);
+        r = c_dvar_skip(var, "*");
+        c_assert(r == C_DVAR_E_CORRUPT_DATA);
+        c_dvar_end_read(var);
+
+        free(data);
+}
+
+int main(int argc, char **argv) {
+        test_array_view_basic();
+        test_array_view_struct(true);
+        test_array_view_struct(false);
+        test_array_view_bool();
+        test_array_copy(true);
+        test_array_copy(false);
+        test_array_copy_padding(true);
+        test_array_copy_padding(false);
+        test_cache();
+        test_cache_overflow();
+        test_program(true);
+        test_program(false);
+        test_program_fixed(true);
+        test_program_fixed(false);
+        test_program_invalid();
+        test_struct(true);
+        test_struct(false);
+        test_validate_message(true);
+        test_validate_message(false);
+        test_validate_depth();
+        test_vecs(true);
+        test_vecs(false);
+        test_vecs_jump(true);
+        test_vecs_jump(false);
+        test_partial(1);
+        test_partial(3);
+        test_partial(8);
+        test_partial(64);
+        test_shifted(true);
+        test_shifted(false);
+        test_index(true);
+        test_index(false);
+        test_lookup(true);
+        test_lookup(false);
+        test_path(true);
+        test_path(false);
+        test_peek(true);
+        test_peek(false);
+        test_span(true);
+        test_span(false);
+        test_checkpoint(true);
+        test_checkpoint(false);
+        test_clone(true);
+        test_clone(false);
+        test_fixed_tuple(true);
+        test_fixed_tuple(false);
+        test_token(true);
+        test_token(false);
+        test_lazy(true);
+        test_lazy(false);
+        test_string_array(true);
+        test_string_array(false);
+        test_table(true);
+        test_table(false);
+        test_skip_rest(true);
+        test_skip_rest(false);
+        return 0;
+}
@@ -43,6 +43,42 @@ static void test_path(void) {
         c_assert(!c_dvar_is_path("/\0foobar", 8));
 }
 
+static void test_string(void) {
+        char str[64 + 1];
+        size_t i;
+
+        /*
+         * Strings are checked word-wise as long as they are plain ASCII. Make
+         * sure zero-bytes and non-ASCII sequences are caught at any offset,
+         * including the trailing bytes that do not fill an entire word. Like
+         * on the wire, strings are followed by a terminating zero-byte.
+         */
+
+        memset(str, 'a', sizeof(str) - 1);
+        str[sizeof(str) - 1] = 0;
+        c_assert(c_dvar_is_string(str, sizeof(str) - 1));
+        c_assert(!c_dvar_is_string(str, sizeof(str) - 4));
+        c_assert(c_dvar_is_string(str + sizeof(str) - 1, 0));
+
+        for (i = 0; i < sizeof(str) - 1; ++i) {
+                str[i] = 0;
+                c_assert(!c_dvar_is_string(str, sizeof(str) - 1));
+                str[i] = 0x80;
+                c_assert(!c_dvar_is_string(str, sizeof(str) - 1));
+                str[i] = 'a';
+        }
+
+        for (i = 0; i + 2 < sizeof(str); ++i) {
+                /* U+00E4 */
+                str[i] = 0xc3;
+                str[i + 1] = 0xa4;
+                c_assert(c_dvar_is_string(str, sizeof(str) - 1));
+                c_assert(!c_dvar_is_string(str, i + 1));
+                str[i] = 'a';
+                str[i + 1] = 'a';
+        }
+}
+
 static void test_signature(void) {
         static const char *valid[] = {
                 "u",
@@ -133,6 +169,7 @@ static void test_type(void) {
 
 int main(int argc, char **argv) {
         test_path();
+        test_string();
         test_signature();
         test_type();
         return 0;
@@ -8,6 +8,7 @@
 #undef NDEBUG
 #include <assert.h>
 #include <c-stdaux.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -218,11 +219,157 @@ static void test_invalid_types(void) {
         }
 }
 
+static void test_intern(void) {
+        const CDVarType *t1 = NULL, *t2 = NULL, *types[512];
+        char signature[] = "(yyyyyyyyy)";
+        size_t i, j, k;
+        int r;
+
+        /*
+         * Intern the same signature twice and verify both calls return the
+         * same type. Invalid signatures, or signatures with more than a single
+         * complete type, must be rejected.
+         */
+
+        r = c_dvar_type_intern(&t1, "a{sv}", 5);
+        c_assert(!r);
+        c_assert(!c_dvar_type_compare_string(t1, "a{sv}", 5));
+        c_assert(t1->length == 5);
+
+        r = c_dvar_type_intern(&t2, "a{sv}", 5);
+        c_assert(!r);
+        c_assert(t1 == t2);
+
+        c_assert(c_dvar_type_ref(t2) == t2);
+        c_dvar_type_unref(t2);
+        t2 = c_dvar_type_unref(t2);
+        c_assert(!t2);
+
+        r = c_dvar_type_intern(&t2, "a{sv}u", 6);
+        c_assert(r == C_DVAR_E_INVALID_TYPE);
+        r = c_dvar_type_intern(&t2, "a{vs}", 5);
+        c_assert(r == C_DVAR_E_INVALID_TYPE);
+        c_assert(!t2);
+
+        t1 = c_dvar_type_unref(t1);
+
+        /*
+         * Intern enough distinct types to force the registry to grow, then
+         * release and intern them again, so entries are recycled.
+         */
+
+        for (j = 0; j < 2; ++j) {
+                for (i = 0; i < sizeof(types) / sizeof(*types); ++i) {
+                        for (k = 0; k < 9; ++k)
+                                signature[1 + k] = (i & (1 << k)) ? 'u' : 'y';
+
+                        r = c_dvar_type_intern(&types[i], signature, strlen(signature));
+                        c_assert(!r);
+                        c_assert(!c_dvar_type_compare_string(types[i], signature, strlen(signature)));
+                }
+
+                for (i = 0; i < sizeof(types) / sizeof(*types); ++i) {
+                        for (k = 0; k < 9; ++k)
+                                signature[1 + k] = (i & (1 << k)) ? 'u' : 'y';
+
+                        r = c_dvar_type_intern(&t1, signature, strlen(signature));
+                        c_assert(!r);
+                        c_assert(t1 == types[i]);
+                        t1 = c_dvar_type_unref(t1);
+                }
+
+                for (i = 0; i < sizeof(types) / sizeof(*types); ++i)
+                        c_dvar_type_unref(types[i]);
+        }
+}
+
+static void test_intern_bounded(void) {
+        const CDVarType *types[16] = {}, *entries[32] = {};
+        char signature[] = "(yyyyyyyyyyyyyyyy)";
+        size_t i, j, k, n_entries = 0;
+        int r;
+
+        /*
+         * Intern a long series of distinct types, but keep only the most
+         * recent ones alive. Every released type leaves a tombstone behind.
+         * Entries of released types must be recycled, so only a bounded set
+         * of entries is ever handed out.
+         */
+
+        for (i = 0; i < 1 << 16; ++i) {
+                for (k = 0; k < 16; ++k)
+                        signature[1 + k] = (i & (1 << k)) ? 'u' : 'y';
+
+                types[i % 16] = c_dvar_type_unref(types[i % 16]);
+                r = c_dvar_type_intern(&types[i % 16], signature, strlen(signature));
+                c_assert(!r);
+                c_assert(!c_dvar_type_compare_string(types[i % 16], signature, strlen(signature)));
+
+                for (j = 0; j < n_entries && entries[j] != types[i % 16]; ++j)
+                        ;
+                if (j == n_entries) {
+                        c_assert(n_entries < sizeof(entries) / sizeof(*entries));
+                        entries[n_entries++] = types[i % 16];
+                }
+        }
+
+        for (i = 0; i < 16; ++i)
+                c_dvar_type_unref(types[i]);
+}
+
+static void *test_intern_thread(void *userdata) {
+        static const char *signatures[] = {
+                "s", "u", "b", "as", "a{sv}", "(su)", "a{sa{sv}}", "(yyyyuua(yv))",
+        };
+        const CDVarType *types[sizeof(signatures) / sizeof(*signatures)];
+        size_t i, j, n;
+        int r;
+
+        for (i = 0; i < 20000; ++i) {
+                for (j = 0; j < sizeof(signatures) / sizeof(*signatures); ++j) {
+                        n = strlen(signatures[j]);
+                        r = c_dvar_type_intern(&types[j], signatures[j], n);
+                        c_assert(!r);
+                        c_assert(!c_dvar_type_compare_string(types[j], signatures[j], n));
+                }
+
+                for (j = 0; j < sizeof(signatures) / sizeof(*signatures); ++j)
+                        c_dvar_type_unref(types[j]);
+        }
+
+        return NULL;
+}
+
+static void test_intern_threads(void) {
+        pthread_t threads[8];
+        size_t i;
+        int r;
+
+        /*
+         * Intern and release the same set of types from several threads in
+         * parallel, so entries are constantly removed and recycled while
+         * other threads look them up.
+         */
+
+        for (i = 0; i < sizeof(threads) / sizeof(*threads); ++i) {
+                r = pthread_create(&threads[i], NULL, test_intern_thread, NULL);
+                c_assert(!r);
+        }
+
+        for (i = 0; i < sizeof(threads) / sizeof(*threads); ++i) {
+                r = pthread_join(threads[i], NULL);
+                c_assert(!r);
+        }
+}
+
 int main(int argc, char **argv) {
         test_base();
         test_common();
         test_known_types();
         test_valid_types();
         test_invalid_types();
+        test_intern();
+        test_intern_bounded();
+        test_intern_threads();
         return 0;
 }